@@ -355,6 +355,7 @@
 #define UART_PE                 2
 #define UART_OE                 1
 #define UART_DR                 0
+#define UART_ERBFI              0
 #define UART_LOOPBACK           4
 #define UART_FBEN               15
 #define UART_FBN                0
@@ -37,6 +37,7 @@
 
 #include "aduc.h"
 #include "defs.h"
+#include "init.h"
 
 
 /*-----------------------------------------------------------------------------
@@ -68,6 +69,7 @@ void ISR_TIMER1(void)                   __stub(_isr_trap);
 void ISR_WAKEUP_TIMER2(void)            __stub(_isr_trap);
 void ISR_WATCHDOG_TIMER3(void)          __stub(_isr_trap);
 void ISR_PLL_LOCK(void)                 __stub(_isr_trap);
+void ISR_UART(void)                     __stub(_isr_trap);
 void ISR_PLA_INT0(void)                 __stub(_isr_trap);
 
 
@@ -81,6 +83,100 @@ void ISR_PLA_INT0(void)                 __stub(_isr_trap);
 static void _isr_trap(void){ while (1){} }
 
 
+#ifdef ISR_PROFILE
+
+volatile isr_profile_t isr_profile[ISR_PROFILE_SOURCES];
+
+const uint8_t isr_profile_irq[ISR_PROFILE_SOURCES] = {
+  INT_ADC_CHANNEL,
+  INT_TIMER0,
+  INT_TIMER1,
+  INT_WAKEUP_TIMER2,
+  INT_WATCHDOG_TIMER3,
+  INT_PLL_LOCK,
+  INT_UART,
+  INT_PLA_IRQ0
+};
+
+
+/** Configure 16 bit Timer0 as free running stop watch
+ *
+ * Same configuration as the live time stop watch (see live-time.c),
+ * so both can share the timer. Timer0 counts down at HCLK.
+ */
+static
+void __init isr_profile_init(void)
+{
+  /* clear TIMER0_MODE (free running), no prescaler */
+  T0CON = _FS(TIMER0_PRESCALER, 0);
+  T0CON |= _BV(TIMER0_ENABLE);
+  IRQCLR = _BV(INT_TIMER0);
+}
+module_init(isr_profile_init, 5);
+
+
+/** Histogram bin of a value: floor(log2(value)), 0 for 0
+ *
+ * There is no CLZ on the ARM7TDMI.
+ */
+inline static
+uint8_t isr_profile_bin(uint16_t value)
+{
+  uint8_t bin = 0;
+  if (value >= 0x100) { value >>= 8; bin += 8; }
+  if (value >= 0x10)  { value >>= 4; bin += 4; }
+  if (value >= 0x4)   { value >>= 2; bin += 2; }
+  if (value >= 0x2)   { bin += 1; }
+  return bin;
+}
+
+
+/** Account one ISR call */
+static
+void __runRam isr_profile_account(volatile isr_profile_t *p,
+                                  const uint16_t latency,
+                                  const uint16_t duration)
+{
+  if (p->count == 0) {
+    p->latency_min = p->latency_max = latency;
+    p->duration_min = p->duration_max = duration;
+  }
+  if (latency < p->latency_min) {
+    p->latency_min = latency;
+  }
+  if (latency > p->latency_max) {
+    p->latency_max = latency;
+  }
+  if (duration < p->duration_min) {
+    p->duration_min = duration;
+  }
+  if (duration > p->duration_max) {
+    p->duration_max = duration;
+  }
+  p->latency_hist[isr_profile_bin(latency)]++;
+  p->duration_hist[isr_profile_bin(duration)]++;
+  p->count++;
+}
+
+
+/** Call an ISR and account for it (Timer0 counts down) */
+#define ISR_CALL(source, isr)                                   \
+  do {                                                          \
+    const uint16_t enter = T0VAL;                               \
+    isr();                                                      \
+    const uint16_t leave = T0VAL;                               \
+    isr_profile_account(&isr_profile[source],                   \
+                        (uint16_t)(irq_stamp - enter),          \
+                        (uint16_t)(enter - leave));             \
+  } while (0)
+
+#else
+
+#define ISR_CALL(source, isr) isr()
+
+#endif /* ISR_PROFILE */
+
+
 /* IRQEN:  Ones indicate that the interrupt request from
  *         the source is unmasked (use this to enable IRQs)
  *
@@ -102,28 +198,35 @@ void __attribute__ ((interrupt("IRQ"))) __runRam _irq_handler(void);
 
 void _irq_handler(void)
 {
+#ifdef ISR_PROFILE
+  const uint16_t irq_stamp = T0VAL;
+#endif
+
   /* which interrupt is enabled and pending?
    */
   if (bit_is_set(IRQSTA, INT_ADC_CHANNEL)){
-    ISR_ADC();
+    ISR_CALL(ISR_PROFILE_ADC, ISR_ADC);
   }
   if (bit_is_set(IRQSTA, INT_TIMER0)){
-    ISR_TIMER0();
+    ISR_CALL(ISR_PROFILE_TIMER0, ISR_TIMER0);
   }
   if (bit_is_set(IRQSTA, INT_TIMER1)){
-    ISR_TIMER1();
+    ISR_CALL(ISR_PROFILE_TIMER1, ISR_TIMER1);
   }
   if (bit_is_set(IRQSTA, INT_WAKEUP_TIMER2)){
-    ISR_WAKEUP_TIMER2();
+    ISR_CALL(ISR_PROFILE_TIMER2, ISR_WAKEUP_TIMER2);
   }
   if (bit_is_set(IRQSTA, INT_WATCHDOG_TIMER3)){
-    ISR_WATCHDOG_TIMER3();
+    ISR_CALL(ISR_PROFILE_TIMER3, ISR_WATCHDOG_TIMER3);
   }
   if (bit_is_set(IRQSTA, INT_PLL_LOCK)){
-    ISR_PLL_LOCK();
+    ISR_CALL(ISR_PROFILE_PLL_LOCK, ISR_PLL_LOCK);
+  }
+  if (bit_is_set(IRQSTA, INT_UART)){
+    ISR_CALL(ISR_PROFILE_UART, ISR_UART);
   }
   if (bit_is_set(IRQSTA, INT_PLA_IRQ0)){
-    ISR_PLA_INT0();
+    ISR_CALL(ISR_PROFILE_PLA_IRQ0, ISR_PLA_INT0);
   }
 }
 
@@ -68,6 +68,51 @@ void disable_IRQs_usermode(void){
 }
 
 
+#ifdef ISR_PROFILE
+
+#include <stdint.h>
+
+/** Number of log2 histogram bins, enough for the 16 bit Timer0 */
+#define ISR_PROFILE_BINS 16
+
+/** Sources profiled by the IRQ handler coordinator */
+typedef enum {
+  ISR_PROFILE_ADC,
+  ISR_PROFILE_TIMER0,
+  ISR_PROFILE_TIMER1,
+  ISR_PROFILE_TIMER2,
+  ISR_PROFILE_TIMER3,
+  ISR_PROFILE_PLL_LOCK,
+  ISR_PROFILE_UART,
+  ISR_PROFILE_PLA_IRQ0,
+  ISR_PROFILE_SOURCES
+} isr_profile_source_t;
+
+/** Profile of one source in Timer0 ticks (HCLK)
+ *
+ * Latency is from entry of the IRQ handler coordinator to entry of
+ * the ISR, duration from entry to exit of the ISR. Bin n of the
+ * histograms counts values in [2^n, 2^(n+1)), bin 0 also counts 0.
+ */
+typedef struct {
+  uint32_t count;
+  uint16_t latency_min;
+  uint16_t latency_max;
+  uint16_t duration_min;
+  uint16_t duration_max;
+  uint32_t latency_hist[ISR_PROFILE_BINS];
+  uint32_t duration_hist[ISR_PROFILE_BINS];
+} isr_profile_t;
+
+/** Profiles of all sources (ISR write access only) */
+extern volatile isr_profile_t isr_profile[ISR_PROFILE_SOURCES];
+
+/** IRQ number (INT_*) of each source */
+extern const uint8_t isr_profile_irq[ISR_PROFILE_SOURCES];
+
+#endif /* ISR_PROFILE */
+
+
 #endif /* !__ASSEMBLER__ */
 
 
@@ -0,0 +1,63 @@
+/** \file firmware/adc-resolution.c
+ * \brief Histogram resolution selected at runtime
+ *
+ * \author Copyright (C) 2012 samplemaker
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ *
+ * \addtogroup adc_resolution
+ * @{
+ */
+
+#include <stdint.h>
+
+#include "aduc.h"
+#include "init.h"
+#include "data-table.h"
+
+#include "adc-resolution.h"
+
+
+uint8_t adc_shift = 16 + 12 - ADC_RESOLUTION;
+
+
+/** Announce the resolution range in the personality info */
+void __init adc_resolution_personality_info_init(void)
+{
+  personality_info.min_resolution = ADC_MIN_RESOLUTION;
+  personality_info.max_resolution = ADC_RESOLUTION;
+}
+module_init(adc_resolution_personality_info_init, 8);
+
+
+void personality_resolution_setup(const uint8_t resolution)
+{
+  const uint8_t bits =
+    ((resolution >= ADC_MIN_RESOLUTION) && (resolution <= ADC_RESOLUTION)) ?
+    resolution : ADC_RESOLUTION;
+  adc_shift = 16 + 12 - bits;
+  data_table_info.size = (1UL << bits) * (data_table_info.bits_per_value / 8);
+}
+
+
+/** @} */
+
+/*
+ * Local Variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
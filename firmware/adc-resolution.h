@@ -0,0 +1,71 @@
+/** \file firmware/adc-resolution.h
+ * \brief Histogram resolution selected at runtime
+ *
+ * \author Copyright (C) 2012 samplemaker
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ *
+ * \defgroup adc_resolution Histogram resolution selected at runtime
+ * \ingroup firmware_generic
+ *
+ * The measurement command selects how many bits of the ADC result
+ * make up the histogram bin index, from #ADC_MIN_RESOLUTION to
+ * #ADC_RESOLUTION. Coarse bins collect counts faster and make a
+ * smaller value table, fine bins are there for calibration runs. The
+ * personality info announces the range.
+ *
+ * The ADC ISR shifts the ADC result by #adc_shift, and the value
+ * table ends after the last bin of the selected resolution. The
+ * histogram table always has room for #ADC_RESOLUTION bits.
+ *
+ * Personalities without a resolution parameter get the default from
+ * main.c, which ignores the parameter.
+ *
+ * @{
+ */
+
+#ifndef ADC_RESOLUTION_H
+#define ADC_RESOLUTION_H
+
+#include <stdint.h>
+
+#include "perso-adc-int-global.h"
+
+
+/** Shift from ADCDAT to the histogram bin index (write access before
+ *  the measurement only) */
+extern uint8_t adc_shift;
+
+
+/** Select the histogram resolution from the measurement parameters
+ *
+ * \param resolution Resolution in bits. 0, or a resolution out of
+ *                   range, selects #ADC_RESOLUTION.
+ */
+void personality_resolution_setup(const uint8_t resolution);
+
+
+/** @} */
+
+#endif /* !ADC_RESOLUTION_H */
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -32,9 +32,13 @@
 
 #include "beep.h"
 
+/* The ISR profiler runs Timer0 as stop watch, so there is no gating
+ * signal in profile builds and the beeps are silent (see beep.h). */
+#ifndef ISR_PROFILE
 #define TIMER0_CLOCK_DIVISION_FACTOR 256000000ULL
 #define TIMER0_INTERVAL BEEP_LENGTH
 #include "set_timer.h"
+#endif
 
 
 #define PWM_DAT_0 (F_HCLK/(2 * BEEP_FREQUENCY))
@@ -78,6 +82,7 @@ void __init beep_init_and_start(void)
   /* configure P3.1 (PWM0L) as PWM */
   GP3CON |= _FS(GP_SELECT_FUNCTION_Px1, MASK_01);
 
+#ifndef ISR_PROFILE
   /** configure gating signal
    */
 
@@ -88,6 +93,7 @@ void __init beep_init_and_start(void)
   T0LD = TIMER0_LOAD_VALUE;
   /* enable interrupt flag for Timer0 */
   IRQEN |= _BV(INT_TIMER0);
+#endif
 }
 module_init(beep_init_and_start, 7);
 
@@ -97,13 +103,16 @@ void beep_stop_and_reset(void)
 {
   /* dcyc = 0% */
   PWMCH0 = (PWM_DAT_0 >> 1);
+#ifndef ISR_PROFILE
   /* ??? */
   T0CLRI = 0x00;
   /* stop gating signal (timer0) */
   T0CON &= ~_BV(TIMER0_ENABLE);
+#endif
 }
 
 
+#ifndef ISR_PROFILE
 /** Gating signal elapsed
  *
  *  Stop and reset timer
@@ -112,6 +121,7 @@ void __runRam ISR_TIMER0(void)
 {
   beep_stop_and_reset();
 }
+#endif
 
 
 /** Kill a running beep
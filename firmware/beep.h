@@ -42,6 +42,17 @@
 
 void beep_kill_all(void);
 
+#ifdef ISR_PROFILE
+
+/** No gating signal in profile builds, Timer0 is the ISR profiler's
+ *  stop watch. The beep would never stop, so it is left out. */
+inline static
+void _beep(void)
+{
+}
+
+#else
+
 inline static
 void _beep(void)
 {
@@ -52,6 +63,8 @@ void _beep(void)
   T0CON |= _BV(TIMER0_ENABLE);
 }
 
+#endif
+
 #endif /* !BEEP_H */
 
 /** @} */
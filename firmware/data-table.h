@@ -39,6 +39,14 @@
  * \param NAME Personality name as string, e.g. "adc-int-mca"
  * \param PARAM_SIZE_TIMER1_COUNT Size of timer1_count param in bytes (0 or 2)
  * \param PARAM_SIZE_SKIP_SAMPLES Size of skip_samples param in bytes (0 or 2)
+ * \param PARAM_SIZE_TRIGGER Size of trigger param in bytes
+ *                           (0 or sizeof(packet_trigger_param_t))
+ * \param PARAM_SIZE_SAMPLE_PERIOD Size of sample period param in bytes
+ *                                 (0 or 4)
+ * \param PARAM_SIZE_ROI Size of region of interest param in bytes
+ *                       (0 or sizeof(packet_roi_param_t))
+ * \param PARAM_SIZE_RESOLUTION Size of histogram resolution param in
+ *                              bytes (0 or 1)
  * \param UNITS_PER_SECOND Timer units per second, e.g. 1 (for 1sec timer period
  *                         or 10 (for 0.1sec timer period).
  * \param MAX_BYTES_PER_TABLE Maximum size of data table in bytes
@@ -48,6 +56,10 @@
 #define PERSONALITY(NAME,                                           \
                     PARAM_SIZE_TIMER1_COUNT,                        \
                     PARAM_SIZE_SKIP_SAMPLES,                        \
+                    PARAM_SIZE_TRIGGER,                             \
+                    PARAM_SIZE_SAMPLE_PERIOD,                       \
+                    PARAM_SIZE_ROI,                                 \
+                    PARAM_SIZE_RESOLUTION,                          \
                     UNITS_PER_SECOND,                               \
                     MAX_BYTES_PER_TABLE,                            \
                     TABLE_ELEMENT_SIZE)                             \
@@ -56,11 +68,19 @@
     TABLE_ELEMENT_SIZE,                                             \
     UNITS_PER_SECOND,                                               \
     PARAM_SIZE_TIMER1_COUNT,                                        \
-    PARAM_SIZE_SKIP_SAMPLES                                         \
+    PARAM_SIZE_SKIP_SAMPLES,                                        \
+    PARAM_SIZE_TRIGGER,                                             \
+    PARAM_SIZE_SAMPLE_PERIOD,                                       \
+    PARAM_SIZE_ROI,                                                 \
+    PARAM_SIZE_RESOLUTION,                                          \
+    /* sample clock and periods: set at runtime if needed */        \
+    0, 0, 0, 0,                                                     \
+    /* resolution range: set at runtime if needed */                \
+    0, 0                                                            \
   };                                                                \
   const char personality_name[] = NAME;                     \
   const uint8_t personality_name_length = sizeof(NAME)-1;           \
-  const uint8_t personality_param_size = (PARAM_SIZE_TIMER1_COUNT+PARAM_SIZE_SKIP_SAMPLES)
+  const uint8_t personality_param_size = (PARAM_SIZE_TIMER1_COUNT+PARAM_SIZE_SKIP_SAMPLES+PARAM_SIZE_TRIGGER+PARAM_SIZE_SAMPLE_PERIOD+PARAM_SIZE_ROI+PARAM_SIZE_RESOLUTION)
 
 extern const char personality_name[];
 extern const uint8_t personality_name_length;
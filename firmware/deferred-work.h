@@ -0,0 +1,109 @@
+/** \file firmware/deferred-work.h
+ * \brief Deferred work posted by ISRs and run from the main loop
+ *
+ * \author Copyright (C) 2012 samplemaker
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ *
+ * \defgroup deferred_work Deferred work
+ * \ingroup firmware_generic
+ *
+ * ISRs only do what is time critical (counting, resetting a latch)
+ * and post everything else (beeping, LEDs) as a job bit. The main
+ * event loop takes all pending jobs at once and runs them with
+ * interrupts enabled.
+ *
+ * Posting from an ISR is a plain read-modify-write: IRQs do not nest
+ * and FIQ is not used, so no other ISR can interfere. The main loop
+ * takes the jobs with an atomic swap (SWP), so a job posted while the
+ * main loop takes the mask is never lost. A job posted several times
+ * before the main loop gets to it runs once.
+ *
+ * Jobs are delayed while the main loop is busy, e.g. sending a value
+ * table.
+ *
+ * @{
+ */
+
+#ifndef DEFERRED_WORK_H
+#define DEFERRED_WORK_H
+
+#include <stdint.h>
+
+#include "aduc.h"
+
+
+/** Toggle the time base LED (P4.1), run by main.c */
+#define DEFERRED_WORK_LED_TIME_BASE _BV(0)
+
+/** Toggle the event LED (P4.0), run by main.c */
+#define DEFERRED_WORK_LED_EVENT     _BV(1)
+
+/** Beep, run by personalities with a speaker */
+#define DEFERRED_WORK_BEEP          _BV(2)
+
+/** No job, just keeps the main loop from sleeping so that
+ *  personality_measuring_poll() runs */
+#define DEFERRED_WORK_POLL          _BV(3)
+
+
+/** Pending jobs (set by ISRs, taken by the main loop) */
+extern volatile uint32_t deferred_work_pending;
+
+
+/** Post jobs (call from ISR context only) */
+inline static
+void deferred_work_post(const uint32_t jobs)
+{
+  deferred_work_pending |= jobs;
+}
+
+
+/** Take all pending jobs (call from the main loop only)
+ *
+ * Needs to be compiled in ARM mode, Thumb has no SWP.
+ */
+inline static
+uint32_t deferred_work_take(void)
+{
+  uint32_t jobs;
+  __asm__ __volatile__ ("swp %0, %1, [%2]"
+                        : "=&r" (jobs)
+                        : "r" (0), "r" (&deferred_work_pending)
+                        : "memory");
+  return jobs;
+}
+
+
+/** Run the personality specific part of the jobs
+ *
+ * Called from the main loop with interrupts enabled. The default in
+ * main.c does nothing.
+ */
+void personality_deferred_work(const uint32_t jobs);
+
+
+/** @} */
+
+#endif /* !DEFERRED_WORK_H */
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
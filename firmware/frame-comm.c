@@ -35,6 +35,9 @@
 char magic_header[4] = FRAME_MAGIC_STR;
 
 
+uint8_t frame_reply_seq;
+
+
 /** Start a data frame */
 void frame_start(const frame_type_t frame_type,
                  const size_t payload_size)
@@ -49,9 +52,15 @@ void frame_start(const frame_type_t frame_type,
   const uint16_t size = payload_size;
   uart_putb(&size, sizeof(size));
 
-  /* send frame type */
-  const uint8_t type = frame_type;
-  uart_putc((const char)type);
+  /* send frame type, and the sequence ID if this is a reply */
+  const uint8_t seq = frame_reply_seq;
+  if (seq) {
+    uart_putc((const char)(frame_type | FRAME_TYPE_SEQ_FLAG));
+    uart_putc((const char)seq);
+  } else {
+    const uint8_t type = frame_type;
+    uart_putc((const char)type);
+  }
 }
 
 
@@ -26,9 +26,14 @@
 #define FRAME_COMM_H
 
 #include <stddef.h>
+#include <stdint.h>
 
 #include "frame-defs.h"
 
+/** Sequence ID of the command being handled, 0 if none (see
+ *  \ref frame_seq) */
+extern uint8_t frame_reply_seq;
+
 void frame_send(const frame_type_t frame_type,
                 const void *payload, const size_t payload_size);
 
@@ -0,0 +1,87 @@
+/** \file firmware/live-time.c
+ * \brief Dead time and live time accounting for triggered ADC personalities
+ *
+ * \author Copyright (C) 2012 samplemaker
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ *
+ * \addtogroup live_time
+ * @{
+ */
+
+#include <stdint.h>
+
+#include "aduc.h"
+#include "init.h"
+
+#include "live-time.h"
+
+
+volatile uint32_t live_time_dead_ticks;
+
+volatile uint32_t live_time_dead_5ms;
+
+volatile uint32_t live_time_busy_triggers;
+
+volatile uint8_t live_time_busy;
+
+
+/** Configure 16 bit Timer0 as free running stop watch
+ *
+ * Free running mode without prescaler: Timer0 counts down from
+ * 0xFFFF at HCLK and wraps around every 1.57ms, which is long
+ * enough for any ISR we measure.
+ *
+ * The counters need no initialization as the device is reset after
+ * every measurement, see \ref firmware_memories.
+ */
+void __init live_time_init(void)
+{
+  /* clear TIMER0_MODE (free running), no prescaler */
+  T0CON = _FS(TIMER0_PRESCALER, 0);
+  T0CON |= _BV(TIMER0_ENABLE);
+  /* the stop watch is only read, never generates an IRQ */
+  IRQCLR = _BV(INT_TIMER0);
+}
+/** Put function into init section, register function pointer and
+ *  execute function at start up
+ */
+module_init(live_time_init, 5);
+
+
+uint32_t get_dead_time(void)
+{
+  /* ticks*5 stays below 2^32 and the division by a constant is
+   * turned into a multiplication, so no libgcc is required */
+  return (live_time_dead_5ms * 5 +
+          (live_time_dead_ticks * 5) / (uint32_t)LIVE_TIME_TICKS_PER_5MS);
+}
+
+
+uint32_t get_busy_triggers(void)
+{
+  return live_time_busy_triggers;
+}
+
+
+/** @} */
+
+/*
+ * Local Variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,157 @@
+/** \file firmware/live-time.h
+ * \brief Dead time and live time accounting for triggered ADC personalities
+ *
+ * \author Copyright (C) 2012 samplemaker
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ *
+ * \defgroup live_time Dead time and live time accounting
+ * \ingroup firmware_generic
+ *
+ * Timer0 runs free at HCLK and serves as a stop watch. The ADC ISR
+ * samples it on entry and on exit and accumulates the difference
+ * plus a constant for the trigger to ISR latency (ADC conversion,
+ * IRQ dispatch) which the stop watch cannot see.
+ *
+ * A trigger which has produced another ADC result before the ISR
+ * exits arrived while the system was busy. It is counted as a busy
+ * trigger, but it is not lost: The ISR runs again right away and
+ * counts the event into the table like any other. So the busy
+ * triggers are a subset of the events in the table, not additional
+ * events. They tell how often events come back to back, and must not
+ * be added to the counts for dead time correction. Triggers the ADC
+ * drops while converting cannot be seen by the firmware.
+ *
+ * The trigger latency of such an event has passed while the previous
+ * ISR run was measured, so it is not added to the dead time again.
+ *
+ * The live time is the measurement duration minus the dead time and
+ * is calculated by the hostware.
+ *
+ * @{
+ */
+
+#ifndef LIVE_TIME_H
+#define LIVE_TIME_H
+
+#include <stdint.h>
+
+#include "aduc.h"
+
+
+/** Trigger to ISR entry latency [ns]
+ *
+ * Measured as "PLA-HW PIN <-> Entry point ISR_ADC" with the ISR
+ * running from RAM.
+ */
+#ifndef LIVE_TIME_TRIGGER_LATENCY
+  #define LIVE_TIME_TRIGGER_LATENCY 2900ULL
+#endif
+
+/** Trigger to ISR entry latency in Timer0 ticks */
+#define LIVE_TIME_TRIGGER_LATENCY_TICKS                 \
+  ( ((LIVE_TIME_TRIGGER_LATENCY) * (F_HCLK)) /          \
+    1000000000ULL )
+
+/** Timer0 ticks per 5ms
+ *
+ * 5ms is the smallest unit in which the Timer0 tick count is an
+ * integer for all HCLK dividers, so the ISR can carry over without
+ * any rounding error.
+ */
+#define LIVE_TIME_TICKS_PER_5MS ( ((F_HCLK) * 5ULL) / 1000ULL )
+
+#if (((F_HCLK) * 5ULL) % 1000ULL)
+  #error LIVE_TIME_TICKS_PER_5MS: HCLK not a multiple of 200Hz
+#endif
+
+
+/** Dead time fraction below 5ms in Timer0 ticks (ISR write access only) */
+extern volatile uint32_t live_time_dead_ticks;
+
+/** Dead time in units of 5ms (ISR write access only) */
+extern volatile uint32_t live_time_dead_5ms;
+
+/** Number of events which arrived while busy (ISR write access only) */
+extern volatile uint32_t live_time_busy_triggers;
+
+
+/** The ADC result of the event being processed had been pending at
+ *  the exit of the previous ISR run (ISR access only) */
+extern volatile uint8_t live_time_busy;
+
+
+/** Get accumulated dead time in milliseconds
+ *
+ * Called with interrupts enabled for intermediate results, the value
+ * may lag behind by one 5ms carry. This is acceptable for
+ * intermediate results.
+ */
+uint32_t get_dead_time(void);
+
+
+/** Get number of events which arrived while busy (see \ref live_time) */
+uint32_t get_busy_triggers(void);
+
+
+/** Sample the stop watch at ISR entry */
+inline static
+uint16_t live_time_isr_enter(void)
+{
+  return T0VAL;
+}
+
+
+/** Sample the stop watch at ISR exit and accumulate the dead time
+ *
+ * \param enter_stamp Value returned by live_time_isr_enter()
+ * \param busy Non-zero if another trigger arrived while we were busy.
+ *             Its result is still pending and is processed by the
+ *             next run of the ISR.
+ */
+inline static
+void live_time_isr_exit(const uint16_t enter_stamp, const uint8_t busy)
+{
+  /* Timer0 counts down and wraps around at zero */
+  const uint16_t elapsed = (uint16_t)(enter_stamp - T0VAL);
+  uint32_t ticks = live_time_dead_ticks + elapsed;
+  if (!live_time_busy) {
+    /* the latency overlaps with the previous run if we were busy */
+    ticks += (uint32_t)LIVE_TIME_TRIGGER_LATENCY_TICKS;
+  }
+  if (ticks >= (uint32_t)LIVE_TIME_TICKS_PER_5MS) {
+    ticks -= (uint32_t)LIVE_TIME_TICKS_PER_5MS;
+    live_time_dead_5ms++;
+  }
+  live_time_dead_ticks = ticks;
+  live_time_busy = busy;
+  if (busy) {
+    live_time_busy_triggers++;
+  }
+}
+
+
+/** @} */
+
+#endif /* !LIVE_TIME_H */
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
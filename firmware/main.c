@@ -76,6 +76,12 @@
 #include "packet-defs.h"
 #include "timer1-measurement.h"
 #include "timer1-get-duration.h"
+#include "live-time.h"
+#include "timebase.h"
+#include "roi.h"
+#include "adc-resolution.h"
+#include "status.h"
+#include "deferred-work.h"
 #include "main.h"
 #include "data-table.h"
 #include "switch.h"
@@ -103,6 +109,66 @@ volatile uint8_t measurement_finished;
 
 static uint8_t write_table_to_flash = 0;
 
+
+/** Parameter buffer of the commands with a parameter which does not
+ *  depend on the personality (#FRAME_CMD_SUBSCRIBE,
+ *  #FRAME_CMD_RESEND_CHUNKS, #FRAME_CMD_TABLE_RANGE) */
+static uint8_t fixed_param[sizeof(union {
+      packet_subscribe_param_t subscribe;
+      packet_resend_chunks_param_t resend_chunks;
+      packet_table_range_param_t table_range;
+    })];
+
+
+/** Size of the parameter of a command with a parameter which does
+ *  not depend on the personality, 0 for all other commands */
+inline static
+uint8_t fixed_param_size(const uint8_t cmd)
+{
+  switch (cmd) {
+  case FRAME_CMD_SUBSCRIBE:     return sizeof(packet_subscribe_param_t);
+  case FRAME_CMD_RESEND_CHUNKS: return sizeof(packet_resend_chunks_param_t);
+  case FRAME_CMD_TABLE_RANGE:   return sizeof(packet_table_range_param_t);
+  default:                      return 0;
+  }
+}
+
+
+/** Read a little endian uint16_t from #fixed_param (not aligned) */
+inline static
+uint16_t fixed_param_u16(const uint8_t ofs)
+{
+  return (((uint16_t)fixed_param[ofs]) << 0) |
+    (((uint16_t)fixed_param[ofs+1]) << 8);
+}
+
+/** ID of the last chunked value table */
+static uint16_t table_id;
+
+/** Element size the last chunked value table has been sent with */
+static uint8_t table_bits;
+
+/** Size of the last chunked value table as sent */
+static size_t table_size_sent;
+
+/** Chunk size of the last chunked value table */
+static uint16_t table_chunk_size_sent;
+
+/** Push interval in duration units, 0 if not subscribed */
+static uint16_t push_interval;
+
+/** Frame type to push (#FRAME_TYPE_VALUE_TABLE or #FRAME_TYPE_STATUS) */
+static uint8_t push_frame_type;
+
+/** Duration at which the next frame is due */
+static uint32_t push_next;
+
+/** Sequence number of the last pushed frame */
+static uint16_t push_seq;
+
+/** Sequence number of the frame being pushed, 0 if not pushing */
+static uint16_t push_seq_sending;
+
 /** Configure unused pins */
 void __init main_io_init_unused_pins(void)
 {
@@ -121,6 +187,308 @@ module_init(main_io_init_unused_pins, 5);
 personality_param_t pparam_sram;
 
 
+/** Default dead time for personalities not linking live-time.o */
+uint32_t get_dead_time(void) __attribute__((weak));
+uint32_t get_dead_time(void)
+{
+  return 0;
+}
+
+
+/** Default busy trigger count for personalities not linking live-time.o */
+uint32_t get_busy_triggers(void) __attribute__((weak));
+uint32_t get_busy_triggers(void)
+{
+  return 0;
+}
+
+
+/** Default timebase for personalities without one */
+uint64_t get_elapsed_ticks(void) __attribute__((weak));
+uint64_t get_elapsed_ticks(void)
+{
+  return 0;
+}
+
+
+/** Default free running timebase */
+uint64_t get_timebase_ticks(void) __attribute__((weak));
+uint64_t get_timebase_ticks(void)
+{
+  return 0;
+}
+
+
+/** Default timebase at start of measurement */
+uint64_t get_timebase_start(void) __attribute__((weak));
+uint64_t get_timebase_start(void)
+{
+  return 0;
+}
+
+
+/** Default timebase clock: no timebase */
+uint32_t get_timebase_clock(void) __attribute__((weak));
+uint32_t get_timebase_clock(void)
+{
+  return 0;
+}
+
+
+/** Default for personalities without region of interest counters */
+void personality_roi_setup(const void *param) __attribute__((weak));
+void personality_roi_setup(const void *UP(param))
+{
+}
+
+
+/** Default for personalities without a histogram resolution parameter */
+void personality_resolution_setup(const uint8_t resolution) __attribute__((weak));
+void personality_resolution_setup(const uint8_t UP(resolution))
+{
+}
+
+
+/** Default: no region of interest sums */
+uint8_t get_roi_sums(uint32_t *sums) __attribute__((weak));
+uint8_t get_roi_sums(uint32_t *UP(sums))
+{
+  return 0;
+}
+
+
+/** Send the frame header, the value table header, the parameter
+ *  buffer and the overflow table
+ *
+ * \param reason The reason why we are sending the value table
+ *               (#packet_value_table_reason_t).
+ * \param table_size Size of the value table data in bytes.
+ * \param chunk_size Chunk size in bytes, or 0 if the caller is going
+ *                   to send the value table data in this frame before
+ *                   calling frame_end().
+ * \param bits_per_value Value table element size.
+ * \param first_bin First bin of a range value table.
+ * \param bin_width Bins per element of a range value table, 0 for
+ *                  the complete value table.
+ */
+static
+void send_table_header(const packet_value_table_reason_t reason,
+                       const size_t table_size, const uint16_t chunk_size,
+                       const uint8_t bits_per_value,
+                       const uint16_t first_bin, const uint16_t bin_width)
+{
+  const uint32_t duration = get_duration();
+#ifdef OVERFLOW_TABLE
+  /* entries are only ever added, so the first entries do not change */
+  const uint8_t entries = overflow_entries;
+#else
+  const uint8_t entries = 0;
+#endif
+
+  packet_value_table_header_t header = {
+    VALUE_TABLE_HEADER_VERSION,
+    bits_per_value,
+    reason,
+    data_table_info.type,
+    duration,
+    get_elapsed_ticks(),
+    get_timebase_clock(),
+    get_dead_time(),
+    get_busy_triggers(),
+    push_seq_sending,
+    (chunk_size) ? table_id : 0,
+    table_size,
+    chunk_size,
+    first_bin,
+    bin_width,
+    entries,
+    pparam_sram.length
+  };
+  frame_start(FRAME_TYPE_VALUE_TABLE,
+              sizeof(header) + pparam_sram.length +
+              entries * sizeof(packet_overflow_entry_t) +
+              ((chunk_size) ? 0 : table_size));
+  uart_putb((const void *)&header, sizeof(header));
+  uart_putb((const void *)pparam_sram.params, pparam_sram.length);
+#ifdef OVERFLOW_TABLE
+  uart_putb((const void *)overflow_table,
+            entries * sizeof(packet_overflow_entry_t));
+#endif
+}
+
+
+/** Start value table packet to controller via serial port (layer 3).
+ *
+ * \param reason The reason why we are sending the value table
+ *               (#packet_value_table_reason_t).
+ * \param table_size The number of value table bytes the caller is
+ *                   going to send before calling frame_end().
+ *
+ * Sends the frame header, the value table header, the parameter
+ * buffer and the overflow table.
+ */
+void send_table_start(const packet_value_table_reason_t reason,
+                      const size_t table_size)
+{
+  send_table_header(reason, table_size, 0,
+                    data_table_info.bits_per_value, 0, 0);
+}
+
+
+/** Read an element of #data_table (little endian, not aligned) */
+static
+uint32_t data_table_get(const size_t index, const uint8_t bytes)
+{
+  const uint8_t *element = (const uint8_t *)&data_table[index * bytes];
+  uint32_t value = 0;
+  for (uint8_t b = bytes; b > 0; b--) {
+    value = (value << 8) | element[b - 1];
+  }
+  return value;
+}
+
+
+/** Number of elements in a #data_table of size bytes
+ *
+ * Only for tables with 8, 16, 24 or 32 bit elements.
+ */
+static
+size_t data_table_elements(const size_t size)
+{
+  /* no runtime division */
+  switch (data_table_info.bits_per_value) {
+  case  8: return size;
+  case 16: return size / 2;
+  case 24: return size / 3;
+  case 32: return size / 4;
+  default: return 0;
+  }
+}
+
+
+/** Element size the value table is sent with
+ *
+ * Histograms and time series are counted with status_count(), so
+ * #status_max_value tells the narrowest element size which holds all
+ * elements. Most intermediate tables are sent with 8 or 16 bit
+ * elements this way. Other value table types, and tables with an
+ * element which has wrapped around, are sent as they are.
+ */
+static
+uint8_t table_send_bits(void)
+{
+  if (((data_table_info.type != VALUE_TABLE_TYPE_HISTOGRAM) &&
+       (data_table_info.type != VALUE_TABLE_TYPE_TIME_SERIES)) ||
+      (status_flags & STATUS_FLAG_OVERFLOW)) {
+    return data_table_info.bits_per_value;
+  }
+  const uint32_t max = status_max_value;
+  uint8_t bits = 8;
+  while ((bits < data_table_info.bits_per_value) && (max >> bits)) {
+    bits += 8;
+  }
+  return bits;
+}
+
+
+/** Size of the value table data sent with elements of bits */
+static
+size_t table_send_size(const size_t size, const uint8_t bits)
+{
+  if (bits == data_table_info.bits_per_value) {
+    return size;
+  }
+  return data_table_elements(size) * (bits / 8);
+}
+
+
+/** Send bytes of the value table data, with elements of bits
+ *
+ * \param offset Offset into the value table data as sent, in bytes.
+ * \param size Number of bytes to send.
+ * \param bits Element size the value table is sent with (see
+ *             table_send_bits()).
+ *
+ * While measuring, an element may have grown beyond what fits into
+ * bits since table_send_bits() has been called. Such an element is
+ * sent as the largest value which fits, the next value table has
+ * the right value.
+ */
+static
+void send_table_data(const size_t offset, const size_t size,
+                     const uint8_t bits)
+{
+  if (bits == data_table_info.bits_per_value) {
+    uart_putb((const void *)&data_table[offset], size);
+    return;
+  }
+  const uint8_t bytes = data_table_info.bits_per_value / 8;
+  const uint8_t send_bytes = bits / 8;
+  const uint32_t limit = 0xffffffffUL >> (32 - bits);
+  /* no runtime division, and bits is narrower than 32 */
+  size_t index;
+  switch (send_bytes) {
+  case 1:  index = offset;     break;
+  case 2:  index = offset / 2; break;
+  default: index = offset / 3; break;
+  }
+  uint8_t b = offset - index * send_bytes;
+  for (size_t i = 0; i < size; ) {
+    uint32_t value = data_table_get(index++, bytes);
+    if (value > limit) {
+      value = limit;
+    }
+    for (value >>= 8 * b; (b < send_bytes) && (i < size); b++, i++) {
+      uart_putc(value & 0xff);
+      value >>= 8;
+    }
+    b = 0;
+  }
+}
+
+
+/** Chunk size for a chunked value table
+ *
+ * #TABLE_CHUNK_SIZE, doubled until the table has no more than
+ * #TABLE_CHUNKS_MAX chunks, so that every chunk can be asked for
+ * again.
+ */
+static
+uint16_t table_chunk_size(const size_t table_size)
+{
+  uint16_t chunk_size = TABLE_CHUNK_SIZE;
+  while (table_size > TABLE_CHUNKS_MAX * (size_t)chunk_size) {
+    chunk_size <<= 1;
+  }
+  return chunk_size;
+}
+
+
+/** Send one chunk of the last chunked value table, if it has that chunk
+ *
+ * The chunk is taken from #data_table with the geometry the table
+ * has been sent with (#table_size_sent, #table_chunk_size_sent and
+ * elements of #table_bits), even if the table has grown since.
+ */
+static
+void send_table_chunk(const uint8_t chunk)
+{
+  const size_t table_size = table_size_sent;
+  const uint16_t chunk_size = table_chunk_size_sent;
+  const size_t offset = chunk * (size_t)chunk_size;
+  if (offset >= table_size) {
+    return;
+  }
+  const size_t size = ((table_size - offset) < chunk_size) ?
+    (table_size - offset) : chunk_size;
+  const packet_table_chunk_t header = { table_id, offset };
+  frame_start(FRAME_TYPE_TABLE_CHUNK, sizeof(header) + size);
+  uart_putb((const void *)&header, sizeof(header));
+  send_table_data(offset, size, table_bits);
+  frame_end();
+}
+
+
 /** Send value table packet to controller via serial port (layer 3).
  *
  * \param reason The reason why we are sending the value table
@@ -135,27 +503,150 @@ personality_param_t pparam_sram;
  *
  * Note that for 'I' value tables it is possible that we send fluked
  * values due to overflows.
+ *
+ * The table is sent in chunks (see \ref packet_emb_to_host_chunks),
+ * so that a transmission error does not cost the whole table. The
+ * elements are narrowed to what the largest element needs, see
+ * table_send_bits().
+ *
+ * Personalities which stream their data instead of sending the
+ * complete #data_table override this weak default.
  */
+void send_table(const packet_value_table_reason_t reason)
+  __attribute__((weak));
 void send_table(const packet_value_table_reason_t reason)
 {
-  const uint16_t duration = get_duration();
+  table_id++;
+  table_bits = table_send_bits();
+  table_size_sent = table_send_size(data_table_info.size, table_bits);
+  table_chunk_size_sent = table_chunk_size(table_size_sent);
+  send_table_header(reason, table_size_sent, table_chunk_size_sent,
+                    table_bits, 0, 0);
+  frame_end();
+  for (uint8_t chunk = 0; chunk < TABLE_CHUNKS_MAX; chunk++) {
+    send_table_chunk(chunk);
+  }
+}
 
-  packet_value_table_header_t header = {
-    data_table_info.bits_per_value,
-    reason,
-    data_table_info.type,
-    duration,
-    pparam_sram.length
-  };
-  frame_start(FRAME_TYPE_VALUE_TABLE,
-              sizeof(header) + pparam_sram.length + data_table_info.size);
-  uart_putb((const void *)&header, sizeof(header));
-  uart_putb((const void *)pparam_sram.params, pparam_sram.length);
-  uart_putb((const void *)data_table, data_table_info.size);
+
+/** Send the chunks asked for by #FRAME_CMD_RESEND_CHUNKS again
+ *
+ * Only the last chunked value table can be sent again. A request for
+ * any other table ID gets no chunks, just the state reply.
+ */
+inline static
+void resend_chunks(void)
+{
+  const uint16_t id = fixed_param_u16(0);
+  const uint32_t mask =
+    (((uint32_t)fixed_param_u16(2)) << 0) | (((uint32_t)fixed_param_u16(4)) << 16);
+  if ((id != table_id) || (table_chunk_size_sent == 0)) {
+    return;
+  }
+  for (uint8_t chunk = 0; chunk < TABLE_CHUNKS_MAX; chunk++) {
+    if (mask & (1UL << chunk)) {
+      send_table_chunk(chunk);
+    }
+  }
+}
+
+
+/** Send the range of bins asked for by #FRAME_CMD_TABLE_RANGE
+ *
+ * Only histograms and time series consist of bins. For the other
+ * value table types, the range is always empty.
+ *
+ * Single bins are sent with the same element size as the complete
+ * value table (see table_send_bits()). This makes the tail of a
+ * time series (from the last element the host has seen up to the
+ * element being recorded) as cheap as possible.
+ *
+ * Sums of several bins saturate at the largest 32 bit value, as
+ * width full 32 bit bins do not fit into a 32 bit sum.
+ */
+inline static
+void send_table_range(const packet_value_table_reason_t reason)
+{
+  const uint16_t start = fixed_param_u16(0);
+  const uint16_t end = fixed_param_u16(2);
+  const uint16_t width = (fixed_param_u16(4)) ? fixed_param_u16(4) : 1;
+
+  const uint8_t bytes = data_table_info.bits_per_value / 8;
+  size_t bins = 0;
+  if ((data_table_info.type == VALUE_TABLE_TYPE_HISTOGRAM) ||
+      (data_table_info.type == VALUE_TABLE_TYPE_TIME_SERIES)) {
+    /* a time series grows while we are sending */
+    bins = data_table_elements(data_table_info.size);
+  }
+  const size_t last = (end < bins) ? end : bins;
+
+  if ((width == 1) || (start >= last)) {
+    const size_t count = (start < last) ? (last - start) : 0;
+    const uint8_t bits = table_send_bits();
+    const uint8_t send_bytes = bits / 8;
+    send_table_header(reason, count * send_bytes, 0, bits, start, 1);
+    send_table_data(start * send_bytes, count * send_bytes, bits);
+    frame_end();
+    return;
+  }
+
+  size_t elements = 0;
+  for (size_t bin = start; bin < last; bin += width) {
+    elements++;
+  }
+  send_table_header(reason, elements * sizeof(uint32_t), 0, 32, start, width);
+  for (size_t bin = start; bin < last; ) {
+    uint32_t sum = 0;
+    for (uint16_t i = 0; (i < width) && (bin < last); i++, bin++) {
+      const uint32_t value = data_table_get(bin, bytes);
+      sum = (value > (0xffffffffUL - sum)) ? 0xffffffffUL : (sum + value);
+    }
+    uart_putb((const void *)&sum, sizeof(sum));
+  }
   frame_end();
 }
 
 
+/** Jobs posted by ISRs, see deferred-work.h */
+volatile uint32_t deferred_work_pending;
+
+
+/** Default: No personality specific deferred work */
+void personality_deferred_work(const uint32_t jobs) __attribute__((weak));
+void personality_deferred_work(const uint32_t UP(jobs))
+{
+}
+
+
+/** Run the jobs posted by ISRs
+ *
+ * The LEDs are the same for all personalities, everything else is
+ * left to the personality.
+ */
+inline static
+void deferred_work_run(void)
+{
+  const uint32_t jobs = deferred_work_take();
+  if (!jobs) {
+    return;
+  }
+  if (jobs & DEFERRED_WORK_LED_TIME_BASE) {
+    GP4DAT ^= _BV(GP_DATA_OUTPUT_Px1);
+  }
+  if (jobs & DEFERRED_WORK_LED_EVENT) {
+    GP4DAT ^= _BV(GP_DATA_OUTPUT_Px0);
+  }
+  personality_deferred_work(jobs);
+}
+
+
+/** Default: Nothing to do in the main loop while measuring */
+void personality_measuring_poll(void) __attribute__((weak));
+void personality_measuring_poll(void)
+{
+}
+
+
 void send_personality_info(void)
 {
   frame_start(FRAME_TYPE_PERSONALITY_INFO,
@@ -166,6 +657,188 @@ void send_personality_info(void)
 }
 
 
+/** Send time sync packet
+ *
+ * The timebase is read first, so the reply reflects the time the
+ * command has been received at.
+ */
+inline static
+void send_time_sync(void)
+{
+  const packet_time_sync_t sync = {
+    get_timebase_ticks(),
+    get_timebase_start(),
+    get_timebase_clock()
+  };
+  frame_send(FRAME_TYPE_TIME_SYNC, (const void *)&sync, sizeof(sync));
+}
+
+
+/** Send region of interest summary packet
+ *
+ * The time fields are the same as in the value table header, so the
+ * host can calculate the count rates in the windows.
+ */
+inline static
+void send_roi_summary(void)
+{
+  packet_roi_summary_t summary;
+  uint32_t sums[ROI_MAX];
+  summary.duration = get_duration();
+  summary.elapsed_ticks = get_elapsed_ticks();
+  summary.timebase_clock = get_timebase_clock();
+  summary.dead_time = get_dead_time();
+  summary.busy_triggers = get_busy_triggers();
+  summary.rois = get_roi_sums(sums);
+  for (uint8_t r = 0; r < ROI_MAX; r++) {
+    summary.sum[r] = (r < summary.rois) ? sums[r] : 0;
+  }
+  frame_send(FRAME_TYPE_ROI_SUMMARY, (const void *)&summary, sizeof(summary));
+}
+
+
+/** Status counters, see status.h */
+volatile uint32_t status_total_counts;
+volatile uint32_t status_max_value;
+volatile uint16_t status_max_index;
+volatile uint8_t status_flags;
+
+#ifdef OVERFLOW_TABLE
+volatile packet_overflow_entry_t overflow_table[OVERFLOW_TABLE_SIZE];
+volatile uint8_t overflow_entries;
+#endif
+
+
+/** Send status packet
+ *
+ * \param state The state of the main loop FSM
+ */
+inline static
+void send_status(const packet_status_state_t state)
+{
+  packet_status_t status;
+  status.state = state;
+  status.flags = status_flags;
+  status.duration = get_duration();
+  status.elapsed_ticks = get_elapsed_ticks();
+  status.timebase_clock = get_timebase_clock();
+  status.dead_time = get_dead_time();
+  status.busy_triggers = get_busy_triggers();
+  status.total_counts = status_total_counts;
+  /* value and index must match */
+  disable_IRQs_usermode();
+  status.max_value = status_max_value;
+  status.max_index = status_max_index;
+  enable_IRQs_usermode();
+  status.table_size = data_table_info.size;
+  status.push_seq = push_seq_sending;
+  frame_send(FRAME_TYPE_STATUS, (const void *)&status, sizeof(status));
+}
+
+
+/** Set up the subscription from the #FRAME_CMD_SUBSCRIBE parameter */
+inline static
+void subscribe(void)
+{
+  const uint16_t interval = fixed_param_u16(0);
+  const uint8_t frame_type = fixed_param[2];
+  if ((frame_type != FRAME_TYPE_VALUE_TABLE) &&
+      (frame_type != FRAME_TYPE_STATUS)) {
+    send_text("invalid subscription");
+    return;
+  }
+  push_frame_type = frame_type;
+  push_interval = interval;
+  push_next = get_duration() + interval;
+}
+
+
+/** Push the subscribed frame if it is due
+ *
+ * Intervals which have passed while the main loop was busy are
+ * skipped, the host sees no gap in the sequence numbers for them.
+ */
+inline static
+void push_poll(void)
+{
+  if (!push_interval) {
+    return;
+  }
+  const uint32_t duration = get_duration();
+  if (duration < push_next) {
+    return;
+  }
+  push_next = duration + push_interval;
+  push_seq++;
+  if (push_seq == 0) {
+    /* 0 marks frames which have not been pushed */
+    push_seq = 1;
+  }
+  push_seq_sending = push_seq;
+  if (push_frame_type == FRAME_TYPE_VALUE_TABLE) {
+    send_table(PACKET_VALUE_TABLE_INTERMEDIATE);
+  } else {
+    send_status(STATUS_STATE_MEASURING);
+  }
+  push_seq_sending = 0;
+}
+
+
+/** Send ISR profile packet
+ *
+ * Only the sources which have been serviced are sent. Each source is
+ * copied with interrupts disabled, so its numbers are consistent.
+ * Without the ISR profiler, only a header with a clock of 0 is sent.
+ */
+inline static
+void send_isr_profile(void)
+{
+#ifdef ISR_PROFILE
+  COMPILE_TIME_ASSERT(ISR_PROFILE_BINS == PACKET_ISR_PROFILE_BINS);
+  /* decide once which sources to send, the frame size depends on it */
+  uint32_t serviced = 0;
+  uint8_t sources = 0;
+  for (uint8_t i = 0; i < ISR_PROFILE_SOURCES; i++) {
+    if (isr_profile[i].count) {
+      serviced |= _BV(i);
+      sources++;
+    }
+  }
+  const packet_isr_profile_header_t header = {
+    (uint32_t)F_HCLK,
+    sources
+  };
+  frame_start(FRAME_TYPE_ISR_PROFILE,
+              sizeof(header) + sources * sizeof(packet_isr_profile_source_t));
+  uart_putb((const void *)&header, sizeof(header));
+  for (uint8_t i = 0; i < ISR_PROFILE_SOURCES; i++) {
+    if (!(serviced & _BV(i))) {
+      continue;
+    }
+    volatile isr_profile_t *prof = &isr_profile[i];
+    packet_isr_profile_source_t p;
+    p.irq = isr_profile_irq[i];
+    disable_IRQs_usermode();
+    p.count = prof->count;
+    p.latency_min = prof->latency_min;
+    p.latency_max = prof->latency_max;
+    p.duration_min = prof->duration_min;
+    p.duration_max = prof->duration_max;
+    for (uint8_t bin = 0; bin < ISR_PROFILE_BINS; bin++) {
+      p.latency_hist[bin] = prof->latency_hist[bin];
+      p.duration_hist[bin] = prof->duration_hist[bin];
+    }
+    enable_IRQs_usermode();
+    uart_putb((const void *)&p, sizeof(p));
+  }
+  frame_end();
+#else
+  const packet_isr_profile_header_t header = { 0, 0 };
+  frame_send(FRAME_TYPE_ISR_PROFILE, (const void *)&header, sizeof(header));
+#endif
+}
+
+
 /** Send parameters from EEPROM
  *
  * Caution: The caller is responsible for copying the parameters from
@@ -185,10 +858,26 @@ void send_eeprom_params_in_sram(void)
 }
 
 
+/** Copy the value table from flash
+ *
+ * The elements of this table have not been counted by status_count(),
+ * so #status_max_value is taken from the table itself. Otherwise
+ * table_send_bits() would narrow the table to 8 bit elements.
+ */
 size_t table_data_copy_from_flash(void)
 {
   data_table_info.size =  eepflash_copy_block((char *)data_table,
                                               EEPFLASH_DATA_TABLE);
+  const uint8_t bytes = data_table_info.bits_per_value / 8;
+  const size_t elements = data_table_elements(data_table_info.size);
+  uint32_t max = 0;
+  for (size_t i = 0; i < elements; i++) {
+    const uint32_t value = data_table_get(i, bytes);
+    if (value > max) {
+      max = value;
+    }
+  }
+  status_max_value = max;
   return(data_table_info.size);
 }
 
@@ -219,6 +908,16 @@ void general_personality_start_measurement_sram(void)
  * See \ref embedded_fsm for more information on this FSM state
  * transition diagram.
  *
+ * Interrupts are enabled in every state, as the commands are
+ * received by ISR_UART(). Which sources are enabled depends on the
+ * state:
+ *
+ *   - #STP_READY: UART, plus whatever the modules set up at start up
+ *     (e.g. the timebase).
+ *   - #STP_MEASURING: UART and the sources of the personality.
+ *   - #STP_DONE: UART and Timer2 only (#IRQ_SOURCES_AFTER_MEASUREMENT).
+ *     The table is final, the commands only read it.
+ *
  * @{
  */
 
@@ -236,6 +935,72 @@ typedef enum {
 } firmware_state_t;
 
 
+/** Sleep until the next interrupt if there is nothing to do
+ *
+ * Saves the main loop from polling, which stalls ISR entry on the
+ * bus and the flash. The core is paused (POWCON), the peripherals
+ * keep running and any enabled interrupt wakes the core up again:
+ * The timers and the measurement ISRs, and the UART receiving a
+ * byte (see uart_recv_pending()).
+ *
+ * The events are checked with interrupts disabled. An interrupt
+ * wakes up the core regardless of the I flag (the clock setup in
+ * target_init.S relies on this, too), so an ISR posting an event
+ * just before the pause is not missed. It runs when interrupts are
+ * enabled again. In #STP_DONE, the measurement sources have been
+ * masked by measurement_end(), so this cannot change the final table.
+ *
+ * The switch has no interrupt, so we keep polling while it can
+ * still start a measurement.
+ */
+inline static
+void main_idle(const firmware_state_t pstate)
+{
+  if ((pstate == STP_READY) && !switch_is_locked()) {
+    return;
+  }
+  disable_IRQs_usermode();
+  if (!deferred_work_pending && !measurement_finished &&
+      !uart_recv_pending()) {
+    /* access to POWCON needs special sequence */
+    POWKEY1 = 0x01;
+    POWCON = (_FS(POW_PC, MASK_001) | POWCON_BOOT_CFG);
+    POWKEY2 = 0xF4;
+  }
+  enable_IRQs_usermode();
+}
+
+
+/** Interrupt sources left enabled in #STP_DONE
+ *
+ * The UART receives the commands (see ISR_UART()), Timer2 keeps the
+ * timebase and the LED running. All other sources feed the
+ * measurement and are masked when it ends, so the ISRs cannot change
+ * the table after #PACKET_VALUE_TABLE_DONE has been sent.
+ */
+#define IRQ_SOURCES_AFTER_MEASUREMENT \
+  (_BV(INT_UART) | _BV(INT_WAKEUP_TIMER2))
+
+
+/** End the measurement
+ *
+ * Masks the measurement interrupt sources before the personality
+ * finishes the table, with interrupts disabled. Then enables
+ * interrupts again: From now on, only the sources of
+ * #IRQ_SOURCES_AFTER_MEASUREMENT can interrupt, and none of them
+ * touches the table, so the final table can be sent while the UART
+ * keeps receiving commands.
+ */
+inline static
+void measurement_end(void)
+{
+  disable_IRQs_usermode();
+  IRQCLR = ~(IRQ_SOURCES_AFTER_MEASUREMENT);
+  on_measurement_finished();
+  enable_IRQs_usermode();
+}
+
+
 /** Firmware FSM event handler for finished measurement */
 inline static
 firmware_state_t firmware_handle_measurement_finished(const firmware_state_t pstate)
@@ -243,8 +1008,7 @@ firmware_state_t firmware_handle_measurement_finished(const firmware_state_t pst
   switch (pstate) {
   case STP_MEASURING:
     /* end measurement */
-    disable_IRQs_usermode();
-    on_measurement_finished();
+    measurement_end();
     send_table(PACKET_VALUE_TABLE_DONE);
     if (write_table_to_flash){
       eepflash_write((const char *)data_table, data_table_info.size,
@@ -309,6 +1073,36 @@ firmware_state_t firmware_handle_command(const firmware_state_t pstate,
   switch (pstate) {
   case STP_READY:
     switch (c) {
+    case FRAME_CMD_TIME_SYNC:
+      send_time_sync();
+      return STP_READY;
+      break;
+    case FRAME_CMD_ISR_PROFILE:
+      send_isr_profile();
+      return STP_READY;
+      break;
+    case FRAME_CMD_ROI_SUMMARY:
+      send_roi_summary();
+      return STP_READY;
+      break;
+    case FRAME_CMD_STATUS:
+      send_status(STATUS_STATE_READY);
+      return STP_READY;
+      break;
+    case FRAME_CMD_SUBSCRIBE:
+      subscribe();
+      send_state(PSTR_READY);
+      return STP_READY;
+      break;
+    case FRAME_CMD_RESEND_CHUNKS:
+      resend_chunks();
+      send_state(PSTR_READY);
+      return STP_READY;
+      break;
+    case FRAME_CMD_TABLE_RANGE:
+      send_state(PSTR_READY);
+      return STP_READY;
+      break;
     case FRAME_CMD_PERSONALITY_INFO:
       send_personality_info();
       /* fall through */
@@ -363,6 +1157,37 @@ firmware_state_t firmware_handle_command(const firmware_state_t pstate,
     break;
   case STP_MEASURING:
     switch (c) {
+    case FRAME_CMD_TIME_SYNC:
+      send_time_sync();
+      return STP_MEASURING;
+      break;
+    case FRAME_CMD_ISR_PROFILE:
+      send_isr_profile();
+      return STP_MEASURING;
+      break;
+    case FRAME_CMD_ROI_SUMMARY:
+      send_roi_summary();
+      return STP_MEASURING;
+      break;
+    case FRAME_CMD_STATUS:
+      send_status(STATUS_STATE_MEASURING);
+      return STP_MEASURING;
+      break;
+    case FRAME_CMD_SUBSCRIBE:
+      subscribe();
+      send_state(PSTR_MEASURING);
+      return STP_MEASURING;
+      break;
+    case FRAME_CMD_RESEND_CHUNKS:
+      resend_chunks();
+      send_state(PSTR_MEASURING);
+      return STP_MEASURING;
+      break;
+    case FRAME_CMD_TABLE_RANGE:
+      send_table_range(PACKET_VALUE_TABLE_INTERMEDIATE);
+      send_state(PSTR_MEASURING);
+      return STP_MEASURING;
+      break;
     case FRAME_CMD_INTERMEDIATE:
       /** The value table will be updated asynchronously from ISRs
        * like ISR_ADC() or ISR_TIMER1(), i.e. independent from
@@ -405,8 +1230,7 @@ firmware_state_t firmware_handle_command(const firmware_state_t pstate,
       break;
     case FRAME_CMD_ABORT:
       send_state(PSTR_DONE);
-      disable_IRQs_usermode();
-      on_measurement_finished();
+      measurement_end();
       send_table(PACKET_VALUE_TABLE_ABORTED);
       send_state(PSTR_DONE);
       return STP_DONE;
@@ -415,6 +1239,37 @@ firmware_state_t firmware_handle_command(const firmware_state_t pstate,
     break;
   case STP_DONE:
     switch (c) {
+    case FRAME_CMD_TIME_SYNC:
+      send_time_sync();
+      return STP_DONE;
+      break;
+    case FRAME_CMD_ISR_PROFILE:
+      send_isr_profile();
+      return STP_DONE;
+      break;
+    case FRAME_CMD_ROI_SUMMARY:
+      send_roi_summary();
+      return STP_DONE;
+      break;
+    case FRAME_CMD_STATUS:
+      send_status(STATUS_STATE_DONE);
+      return STP_DONE;
+      break;
+    case FRAME_CMD_SUBSCRIBE:
+      subscribe();
+      send_state(PSTR_DONE);
+      return STP_DONE;
+      break;
+    case FRAME_CMD_RESEND_CHUNKS:
+      resend_chunks();
+      send_state(PSTR_DONE);
+      return STP_DONE;
+      break;
+    case FRAME_CMD_TABLE_RANGE:
+      send_table_range(PACKET_VALUE_TABLE_RESEND);
+      send_state(PSTR_DONE);
+      return STP_DONE;
+      break;
     case FRAME_CMD_PERSONALITY_INFO:
       send_personality_info();
       /* fall through */
@@ -466,13 +1321,16 @@ firmware_state_t firmware_handle_command(const firmware_state_t pstate,
  *   edge [fontname=Helvetica, fontsize=10];
  *   magic [ label="STF_MAGIC" ];
  *   command [ label="STF_COMMAND" ];
+ *   seq [ label="STF_SEQ" ];
  *   length [ label="STF_LENGTH" ];
  *   param [ label="STF_PARAM" ];
  *   checksum [ label="STF_CHECKSUM" ];
  *   magic:nw -> magic:nw [ label="mismatch\ni:=0" ];
  *   magic -> magic [ label="match magic[i++] && i<magic_size\n-/-" ];
  *   magic -> command [ label="match magic[i++] && i>=magic_size\n-/-" ];
- *   command -> length;
+ *   command -> length [ label="!(cmd & FRAME_CMD_SEQ_FLAG)\nseq:=0" ];
+ *   command -> seq [ label="cmd & FRAME_CMD_SEQ_FLAG\n-/-" ];
+ *   seq -> length;
  *   length -> param [ label="length>0\ni:=0" ];
  *   length -> checksum [ label="length==0\n-/-" ];
  *   param -> param [ label="i<length\ni++" ];
@@ -492,6 +1350,7 @@ void main_event_loop(void)
   typedef enum {
     STF_MAGIC,
     STF_COMMAND,
+    STF_SEQ,
     STF_LENGTH,
     STF_PARAM,
     STF_CHECKSUM,
@@ -504,6 +1363,8 @@ void main_event_loop(void)
   uint8_t cmd = 0;
   /** Frame parser cached data for current frame */
   uint8_t len = 0;
+  /** Frame parser cached data for current frame */
+  uint8_t seq = 0;
 
   /* Firmware FSM State */
   firmware_state_t pstate = STP_READY;
@@ -518,6 +1379,15 @@ void main_event_loop(void)
       continue;
     }
 
+    /* run the work the ISRs have left to us */
+    deferred_work_run();
+
+    /* give streaming personalities the chance to send data */
+    if (pstate == STP_MEASURING) {
+      personality_measuring_poll();
+      push_poll();
+    }
+
     /* check whether a key event occured */
     if (switch_trigger_measurement()) {
       pstate = firmware_handle_switch_pressed(pstate);
@@ -525,7 +1395,7 @@ void main_event_loop(void)
     }
 
     /* check whether a byte has arrived via UART */
-    if (bit_is_set( COMSTA0, UART_DR )) {
+    if (uart_recv_pending()) {
       const char ch = uart_getc();
       const uint8_t byte = (uint8_t)ch;
 
@@ -547,12 +1417,32 @@ void main_event_loop(void)
         break;
       case STF_COMMAND:
         uart_recv_checksum_update(byte);
-        cmd = byte;
+        cmd = byte & ~FRAME_CMD_SEQ_FLAG;
+        seq = 0;
+        if (byte & FRAME_CMD_SEQ_FLAG) {
+          next_fstate = STF_SEQ;
+        } else {
+          next_fstate = STF_LENGTH;
+        }
+        break;
+      case STF_SEQ:
+        uart_recv_checksum_update(byte);
+        seq = byte;
         next_fstate = STF_LENGTH;
         break;
       case STF_LENGTH:
         uart_recv_checksum_update(byte);
         len = byte;
+        if (fixed_param_size(cmd)) {
+          /* fixed size parameter in a buffer of its own */
+          if (len != fixed_param_size(cmd)) {
+            send_text("param length mismatch");
+            goto error_restart_nomsg;
+          }
+          idx = 0;
+          next_fstate = STF_PARAM;
+          break;
+        }
         if (pstate == STP_READY) {
           /* We can only use the personality_param_sram buffer in the
            * STP_READY state. By not writing to the buffer after
@@ -578,7 +1468,9 @@ void main_event_loop(void)
         break;
       case STF_PARAM:
         uart_recv_checksum_update(byte);
-        if (pstate == STP_READY) {
+        if (fixed_param_size(cmd)) {
+          fixed_param[idx] = byte;
+        } else if (pstate == STP_READY) {
           /* We can only use the personality_param_sram buffer in the
            * STP_READY state. By not writing to the buffer after
            * transitioning from STP_READY, we keep the content of the
@@ -596,8 +1488,11 @@ void main_event_loop(void)
         break;
       case STF_CHECKSUM:
         if (uart_recv_checksum_matches(byte)) {
-          /* checksum successful */
+          /* checksum successful, all frames sent while handling
+           * the command are replies to it */
+          frame_reply_seq = seq;
           pstate = firmware_handle_command(pstate, cmd);
+          frame_reply_seq = 0;
           goto restart;
         } else {
           /** \todo Find a way to report checksum failure without
@@ -623,6 +1518,9 @@ void main_event_loop(void)
       continue;
     } /* character received on UART */
 
+    /* nothing to do until the next interrupt */
+    main_idle(pstate);
+
   } /* while (1) main event loop */
 
 } /* void main_event_loop(void); */
@@ -30,6 +30,7 @@
 #define MAIN_H
 
 
+#include <stddef.h>
 #include <stdint.h>
 
 #include "packet-defs.h"
@@ -60,6 +61,23 @@ void personality_start_measurement_sram(void);
 void personality_start_measurement_eeprom(void);
 
 
+/** Start a value table packet: frame, header and parameter buffer */
+void send_table_start(const packet_value_table_reason_t reason,
+                      const size_t table_size);
+
+
+/** Send a value table packet */
+void send_table(const packet_value_table_reason_t reason);
+
+
+/** Called from the main event loop while measuring.
+ *
+ * This is the place for personalities to stream their data to the
+ * host.
+ */
+void personality_measuring_poll(void);
+
+
 #endif /* MAIN_H */
 
 /** @} */
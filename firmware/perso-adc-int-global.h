@@ -36,6 +36,14 @@
 #define ADC_RESOLUTION (11)
 
 
+/** Smallest ADC resolution selectable at runtime in bit
+ *
+ *  See adc-resolution.h. #ADC_RESOLUTION is the largest one, as the
+ *  histogram table has to fit into RAM.
+ */
+#define ADC_MIN_RESOLUTION (8)
+
+
 /** @} */
 
 
@@ -0,0 +1,398 @@
+/** \file firmware/perso-adc-int-list-mode.c
+ * \brief Personality: List mode with internal ADC and external trigger
+ *
+ * \author Copyright (C) 2012 samplemaker
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ *
+ * \defgroup perso_adc_int_list_mode Personality: List mode with internal ADC and external trigger
+ * \ingroup firmware_personality_groups
+ *
+ * Event-by-event recording. Every ADC conversion triggered by the
+ * PLA is stored as a 32 bit record (timestamp delta, ADC value) in a
+ * ring buffer occupying all otherwise unused memory. The main loop
+ * streams the records to the host in chunks of
+ * #LIST_MODE_CHUNK_RECORDS records while the measurement is running.
+ *
+ * Events arriving while the ring buffer is full are dropped and
+ * counted in the chunk header.
+ *
+ * @{
+ */
+
+
+#include <stddef.h>
+
+#include "aduc.h"
+#include "init.h"
+
+#include "main.h"
+#include "perso-adc-int-global.h"
+#include "frame-comm.h"
+#include "uart-comm.h"
+#include "packet-comm.h"
+#include "data-table.h"
+#include "status.h"
+
+#include "timer1-measurement.h"
+
+#define TIMER1_CLOCK_DIVISION_FACTOR 16000000ULL
+#include "set_timer.h"
+
+
+/** Frequency of the timestamp clock (Timer1, HCLK/16) */
+#define LIST_MODE_TICKS_PER_SECOND \
+  ((F_HCLK) * 1000000ULL / (TIMER1_CLOCK_DIVISION_FACTOR))
+
+/** Number of records to collect before sending a chunk */
+#define LIST_MODE_CHUNK_RECORDS 256
+
+/** Maximum age of the oldest unsent record in timestamp ticks */
+#define LIST_MODE_CHUNK_TIMEOUT ((LIST_MODE_TICKS_PER_SECOND) / 4)
+
+
+/** The ring buffer
+ *
+ * Note that we have the ring buffer location and size determined by
+ * the linker script data_table_empty_ram.lds.
+ */
+extern volatile uint32_t ring[] asm("data_table");
+
+
+/** Pseudo symbol - just use its address */
+extern volatile char data_table_size[];
+
+
+/** Data table info
+ *
+ * The size is zero as we never send the #data_table as a whole.
+ *
+ * \see data_table
+ */
+data_table_info_t data_table_info = {
+  /** Actual size of #data_table in bytes */
+  0,
+  /** Type of value table we send */
+  VALUE_TABLE_TYPE_LIST_MODE,
+  /** Table element size */
+  32
+};
+
+
+/** See * \see data_table */
+PERSONALITY("adc-int-list-mode",
+            2,0,0,0,0,0,
+            1,
+            0,
+            32);
+
+
+/** Ring buffer size in records */
+static uint32_t ring_size;
+
+/** Next record to write (ISR write access only) */
+static volatile uint32_t ring_head;
+
+/** Next record to send (main loop write access only) */
+static volatile uint32_t ring_tail;
+
+/** Timestamp of the last record written */
+static uint32_t last_stamp;
+
+/** Events dropped since start of measurement */
+static volatile uint32_t lost_events;
+
+/** Sequence number of the next chunk */
+static uint16_t chunk_seq;
+
+/** Timestamp at which the last chunk has been sent */
+static uint32_t last_chunk_stamp;
+
+
+/** Workaround
+ *
+ */
+void __init personality_info_init(void)
+{
+  personality_info.sizeof_table = (size_t)(&data_table_size);
+  ring_size = ((size_t)(&data_table_size)) / sizeof(ring[0]);
+}
+module_init(personality_info_init, 8);
+
+
+/** Power up ADC
+ *
+ * Note: The ADC must be powered up for at least
+ * 5 μs before it converts correctly
+ */
+inline static
+void adc_power_up(void)
+{
+  ADCCON = _BV(ADC_POWER_CONTROL);
+}
+
+
+/** Initialize peripherals and wake up hardware */
+static
+void __init hw_init(void)
+{
+  /* wake up adc */
+  adc_power_up();
+}
+/** Put function into init section, register function pointer and
+ *  execute function at start up
+ */
+module_init(hw_init, 5);
+
+
+/** Number of records in the ring buffer not sent yet */
+inline static
+uint32_t ring_pending(const uint32_t head, const uint32_t tail)
+{
+  return (head >= tail) ? (head - tail) : (ring_size - tail + head);
+}
+
+
+/** Write a record to the ring buffer (caller checks for space) */
+inline static
+uint32_t ring_put(uint32_t head, const uint32_t record)
+{
+  ring[head] = record;
+  head++;
+  if (head == ring_size) {
+    head = 0;
+  }
+  return head;
+}
+
+
+/** AD conversion complete interrupt entry point
+ *
+ * T1CAP holds the Timer1 value captured at the moment the ADC IRQ
+ * has been raised, so the timestamp does not depend on the IRQ
+ * latency.
+ *
+ * Time gaps too large for the delta field are bridged with a time
+ * marker record (#LIST_MODE_DELTA_MARKER). Gaps of more than 2^32
+ * ticks (27 minutes) cannot be represented.
+ */
+void __runRam ISR_ADC(void){
+  const uint32_t stamp = T1CAP;
+
+  /* starting from bit 16 the result is stored in ADCDAT.
+     reading the ADCDATA also clears flag in ADCSTA */
+  const uint32_t value = (ADCDAT >> 16) & 0x0fff;
+
+  uint32_t head = ring_head;
+  const uint32_t room = ring_size - 1 - ring_pending(head, ring_tail);
+
+  /* always keep room for a time marker */
+  if (room < 2) {
+    /* last_stamp is kept so the next delta spans the lost event */
+    lost_events++;
+    return;
+  }
+
+  uint32_t delta = stamp - last_stamp;
+  if (delta >= LIST_MODE_DELTA_MARKER) {
+    uint32_t periods = delta >> LIST_MODE_DELTA_BITS;
+    if (periods > 0x0fff) {
+      periods = 0x0fff;
+    }
+    head = ring_put(head, LIST_MODE_RECORD(LIST_MODE_DELTA_MARKER, periods));
+    delta &= LIST_MODE_DELTA_MARKER;
+    if (delta == LIST_MODE_DELTA_MARKER) {
+      /* one tick off, but not a marker */
+      delta--;
+    }
+  }
+  ring_head = ring_put(head, LIST_MODE_RECORD(delta, value));
+  last_stamp = stamp;
+  status_total_counts++;
+}
+
+
+/** Send a chunk of up to #LIST_MODE_CHUNK_RECORDS records
+ *
+ * The ISR only writes to free ring buffer slots, so the records can
+ * be sent directly from the ring buffer with interrupts enabled.
+ */
+static
+void list_mode_send_chunk(const packet_value_table_reason_t reason)
+{
+  const uint32_t tail = ring_tail;
+  const uint32_t pending = ring_pending(ring_head, tail);
+  const uint32_t count =
+    (pending > LIST_MODE_CHUNK_RECORDS) ? LIST_MODE_CHUNK_RECORDS : pending;
+  const uint32_t backlog = pending - count;
+
+  const packet_list_mode_chunk_t chunk = {
+    chunk_seq++,
+    (backlog > 0xffff) ? 0xffff : backlog,
+    lost_events,
+    LIST_MODE_TICKS_PER_SECOND
+  };
+
+  send_table_start(reason, sizeof(chunk) + count * sizeof(ring[0]));
+  uart_putb((const void *)&chunk, sizeof(chunk));
+  const uint32_t contiguous = ring_size - tail;
+  if (count <= contiguous) {
+    uart_putb((const void *)&ring[tail], count * sizeof(ring[0]));
+  } else {
+    uart_putb((const void *)&ring[tail], contiguous * sizeof(ring[0]));
+    uart_putb((const void *)&ring[0], (count - contiguous) * sizeof(ring[0]));
+  }
+  frame_end();
+
+  uint32_t new_tail = tail + count;
+  if (new_tail >= ring_size) {
+    new_tail -= ring_size;
+  }
+  ring_tail = new_tail;
+  last_chunk_stamp = T1VAL;
+}
+
+
+/** Send the value table: the pending records
+ *
+ * When the measurement is over, everything except the last chunk is
+ * sent as intermediate chunks first.
+ */
+void send_table(const packet_value_table_reason_t reason)
+{
+  if (reason != PACKET_VALUE_TABLE_INTERMEDIATE) {
+    while (ring_pending(ring_head, ring_tail) > LIST_MODE_CHUNK_RECORDS) {
+      list_mode_send_chunk(PACKET_VALUE_TABLE_INTERMEDIATE);
+    }
+  }
+  list_mode_send_chunk(reason);
+}
+
+
+/** Stream a chunk when enough records are pending or the oldest
+ *  pending record is getting stale */
+void personality_measuring_poll(void)
+{
+  const uint32_t pending = ring_pending(ring_head, ring_tail);
+  if ((pending >= LIST_MODE_CHUNK_RECORDS) ||
+      ((pending > 0) &&
+       ((T1VAL - last_chunk_stamp) >= (uint32_t)LIST_MODE_CHUNK_TIMEOUT))) {
+    list_mode_send_chunk(PACKET_VALUE_TABLE_INTERMEDIATE);
+  }
+}
+
+
+/** Programmable logic array used for edged triggering the ADC
+ *
+ * Same configuration as in \ref perso_adc_int_mca_ext_trig:
+ * Element0: Logic function for generating the output pulse
+ * Element4: Flip flop shifter for generating a one clock pulse
+ * Element5: Input flip flop to suppress glitches (debouncer)
+ */
+inline static
+void adc_pla_trigger(void)
+{
+  /* PLA element 0 triggers the adc */
+  PLAADC = (_BV(PLA_ADC_CONV_START) |
+            _FS(PLA_ADC_CONV_SRC, MASK_0000) );
+  /* ELEMENT0: B and not A, bypass flip-flop */
+  PLAELM0 = (_FS(PLA_MUX1_CONTROL, MASK_10)      |
+             _BV(PLA_MUX2_CONTROL)               |
+             _FS(PLA_MUX0_CONTROL, MASK_10)      |
+             _FS(PLA_LOOKUP_TABLE, MASK_0010)    |
+             _BV(PLA_MUX4_CONTROL));
+  /* ELEMENT4: B, use flip-flop */
+  PLAELM4 = (_FS(PLA_MUX1_CONTROL, MASK_10)      |
+             _FS(PLA_LOOKUP_TABLE, MASK_1010) );
+  /* ELEMENT5: GPIO input, use flip-flop */
+  PLAELM5 = (_BV(PLA_MUX3_CONTROL)               |
+  #if ADC_TRIGGER_ON_RISING_EDGE
+             _FS(PLA_LOOKUP_TABLE, MASK_1010)
+  #else
+             _FS(PLA_LOOKUP_TABLE, MASK_0101)
+  #endif
+            );
+  /* configure P1.5 as GPIO input for PLA5 */
+  GP1CON |= _FS(GP_SELECT_FUNCTION_Px5, MASK_00);
+  GP1DAT &=~ _BV(GP_DATA_DIRECTION_Px5);
+  /* PLA-BLOCK0 clock source: HCLK */
+  PLACLK = _FS(PLA_BLOCK0_CLK_SRC, MASK_011);
+}
+
+
+/** ADC initialisation and configuration
+ *
+ * PLA triggered, single ended, internal reference, ADC0.
+ */
+inline static
+void adc_init(void)
+{
+  ADCCON = (_FS(ADC_CLOCK_SPEED, MASK_001)     |
+            _FS(ADC_ACQUISITION_TIME, MASK_10) |
+            _BV(ADC_POWER_CONTROL)             |
+            _FS(ADC_CONVERSION_MODE, MASK_00)  |
+            _FS(ADC_TRIGGER_SOURCE, MASK_101)    );
+  /* Channel selection: ADC0 = 00000 */
+  ADCCP = _FS(ADC_PCHANNEL_SELECTION, MASK_00000);
+  /* internal bandgap reference */
+  REFCON = _BV(REF_BANDGAP_ENABLE);
+  /* Engage adc */
+  ADCCON |=  _BV(ADC_ENABLE_CONVERION);
+  /* Enable ADC IRQ */
+  IRQEN |= _BV(INT_ADC_CHANNEL);
+}
+
+
+/** Configure Timer1 as free running timestamp clock
+ *
+ * Count up at HCLK/16 and capture the timer value into T1CAP
+ * whenever the ADC IRQ is raised.
+ */
+inline static
+void timestamp_init(void)
+{
+  T1CON = (_FS(TIMER1_PRESCALER, TIMER1_PRESCALER_VALUE)    |
+           _FS(TIMER1_CLKSOURCE, TIMER1_CORE_CLK)           |
+           _BV(TIMER1_COUNT_DIR)                            |
+           _FS(TIMER1_CAPTURE_EVENT, INT_ADC_CHANNEL)       |
+           _BV(TIMER1_CAPTURE_ENABLE) );
+  T1CON |= _BV(TIMER1_ENABLE);
+  /* no timer ISR */
+  IRQCLR = _BV(INT_TIMER1);
+  last_stamp = T1VAL;
+  last_chunk_stamp = last_stamp;
+}
+
+
+void personality_start_measurement_sram(void)
+{
+  const void *voidp = &pparam_sram.params[0];
+  const uint16_t *timer1_value = voidp;
+  timestamp_init();
+  adc_pla_trigger();
+  adc_init();
+  timer1_init(*timer1_value);
+}
+
+
+/** @} */
+
+/*
+ * Local Variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -24,6 +24,27 @@
  *
  * Internal ADC based timed ADC sampling.
  *
+ * Without a trigger (post_samples of the trigger parameter is 0), the
+ * samples are recorded from the start of the measurement until the
+ * RAM is full.
+ *
+ * With a trigger, the (decimated) samples go into a ring buffer
+ * instead. When the signal crosses the trigger level in the
+ * configured direction, the trigger fires, the ring buffer keeps the
+ * given number of pre-trigger samples and records the post-trigger
+ * samples. Only this window is sent to the host as a
+ * #VALUE_TABLE_TYPE_TRIGGER_WINDOW value table. Then the trigger is
+ * re-armed or the measurement finishes.
+ *
+ * In burst mode (sample period #SAMPLE_PERIOD_BURST), the ADC
+ * converts continuously at its maximum rate. The main loop polls the
+ * results with interrupts disabled and packs them into the table
+ * until it is full; there is no trigger and no decimation then.
+ *
+ * The hysteresis keeps noise around the level from firing the trigger
+ * over and over: After firing, the signal has to go back beyond the
+ * level by the hysteresis before the trigger can fire again.
+ *
  * @{
  */
 
@@ -37,25 +58,17 @@
 #define BITS_PER_VALUE 12
 
 #include "perso-adc-int-global.h"
+#include "frame-comm.h"
+#include "uart-comm.h"
 #include "packet-comm.h"
+#include "sample-packing.h"
 #include "table-element.h"
 #include "data-table.h"
 
 #include "timer1-adc-trigger.h"
 #include "main.h"
+#include "deferred-work.h"
 
-#define TOG_LED_TIME_BASE (GP4DAT ^= _BV(GP_DATA_OUTPUT_Px1))
-
-typedef enum {
-  STATE_A,
-  STATE_B,
-  STATE_C,
-  STATE_D
-} state_compress_t;
-
-
-static state_compress_t state = STATE_A;
-static uint16_t temp;
 
 /** The table
  *
@@ -92,7 +105,7 @@ data_table_info_t data_table_info = {
 
 /** See * \see data_table */
 PERSONALITY("adc-int-timed-sampling",
-            0,2,
+            0,2,sizeof(packet_trigger_param_t),4,0,0,
             10,
             0,
             BITS_PER_VALUE);
@@ -107,21 +120,160 @@ volatile table_element_t *volatile table_end =
 volatile table_element_t *volatile table_cur = table;
 
 
+#if (BITS_PER_VALUE == 12)
+/** Packs the samples into the table */
+static sample_packer_t packer = { 0, 0, table };
+#endif
+
+
 /* forward declaration */
 inline static
 void timer1_halt(void);
 
 
+/** Trigger state */
+typedef enum {
+  /** Waiting for pre-trigger samples and the trigger edge */
+  TRIGGER_ARMED,
+  /** Recording post-trigger samples */
+  TRIGGER_POST,
+  /** Window complete, waiting to be sent */
+  TRIGGER_CAPTURED
+} trigger_state_t;
+
+
+/** Trigger parameters from the measurement command */
+static packet_trigger_param_t trigger;
+
+/** Trigger state (ISR and main loop) */
+static volatile trigger_state_t trigger_state;
+
+/** Signal went beyond the level by the hysteresis, edge may fire */
+static uint8_t trigger_slope_ready;
+
+/** Samples recorded since the trigger has been armed (saturating) */
+static uint16_t trigger_pre_filled;
+
+/** Post-trigger samples still to record */
+static uint16_t trigger_post_left;
+
+/** Ring buffer size in samples */
+static uint32_t ring_size;
+
+/** Next ring buffer slot to write */
+static uint32_t ring_wr;
+
+/** Ring buffer slot of the first sample of the captured window */
+static uint32_t window_start;
+
+/** Stream index of the first sample of the captured window */
+static uint32_t window_first;
+
+/** Sequence number of the next window */
+static uint16_t window_seq;
+
+/** Stream index of the next (decimated) sample */
+static uint32_t sample_index;
+
+
 /** Workaround
  *
  */
 void __init personality_info_init(void)
 {
   personality_info.sizeof_table = (size_t)(&data_table_size);
+  ring_size = ((size_t)(&data_table_size)) / sizeof(table[0]);
+  personality_info.burst_sample_period = adc_burst_calibrate();
 }
 module_init(personality_info_init, 8);
 
 
+/** Set up the trigger from the measurement command parameters */
+void personality_trigger_setup(const packet_trigger_param_t *param)
+{
+  trigger = *param;
+  if (trigger.post_samples > ring_size) {
+    trigger.post_samples = ring_size;
+  }
+  if (trigger.pre_samples > (ring_size - trigger.post_samples)) {
+    trigger.pre_samples = ring_size - trigger.post_samples;
+  }
+  data_table_info.type = (trigger.post_samples) ?
+    VALUE_TABLE_TYPE_TRIGGER_WINDOW : VALUE_TABLE_TYPE_SAMPLES;
+  ring_wr = 0;
+  sample_index = 0;
+  window_seq = 0;
+  trigger_pre_filled = 0;
+  trigger_slope_ready = 0;
+  trigger_state = TRIGGER_ARMED;
+}
+
+
+/** Feed a (decimated) sample to the trigger
+ *
+ * Stores the sample in the ring buffer and evaluates the trigger
+ * condition. Nothing is stored while a captured window waits to be
+ * sent.
+ */
+inline static
+void trigger_sample(const uint16_t value)
+{
+  const uint32_t index = sample_index++;
+  const trigger_state_t tstate = trigger_state;
+
+  if (tstate == TRIGGER_CAPTURED) {
+    return;
+  }
+
+  const uint32_t pos = ring_wr;
+  table[pos] = value;
+  ring_wr = (pos + 1 == ring_size) ? 0 : (pos + 1);
+
+  if (tstate == TRIGGER_POST) {
+    if (--trigger_post_left == 0) {
+      trigger_state = TRIGGER_CAPTURED;
+      deferred_work_post(DEFERRED_WORK_POLL);
+    }
+    return;
+  }
+
+  /* TRIGGER_ARMED */
+  if (trigger_pre_filled <= trigger.pre_samples) {
+    trigger_pre_filled++;
+  }
+  const uint32_t level = trigger.level;
+  uint8_t fire = 0;
+  if (trigger.flags & TRIGGER_FLAG_FALLING) {
+    if (value > level + trigger.hysteresis) {
+      trigger_slope_ready = 1;
+    } else if (trigger_slope_ready && (value <= level)) {
+      fire = 1;
+    }
+  } else {
+    if (((uint32_t)value) + trigger.hysteresis < level) {
+      trigger_slope_ready = 1;
+    } else if (trigger_slope_ready && (value >= level)) {
+      fire = 1;
+    }
+  }
+
+  /* the window needs the pre-trigger samples plus the trigger sample */
+  if (fire && (trigger_pre_filled > trigger.pre_samples)) {
+    trigger_slope_ready = 0;
+    window_first = index - trigger.pre_samples;
+    window_start = (pos >= trigger.pre_samples) ?
+      (pos - trigger.pre_samples) : (pos + ring_size - trigger.pre_samples);
+    trigger_post_left = trigger.post_samples - 1;
+    if (trigger_post_left) {
+      trigger_state = TRIGGER_POST;
+    } else {
+      trigger_state = TRIGGER_CAPTURED;
+      deferred_work_post(DEFERRED_WORK_POLL);
+    }
+  }
+}
+
+
 /** Print some status messages for debugging
  *
  * \bug (copied from geiger-time-series.c)
@@ -147,75 +299,51 @@ module_init(data_table_print_status, 8);
 /** AD conversion complete interrupt entry point
  *
  * Benchmark:
- * Runtime ISR_ADC in 12Bits per value approx 3.5us (depends on state)
+ * Runtime ISR_ADC in 12Bits per value approx 3.5us (old packing
+ * state machine, the shift register packer does not branch on the
+ * state anymore)
  * Rising edge ADC_Busy <-> Entry point of ISR_ADC() = 2.5us
  * Firmware tested down to 8us Timer1 reload (125kHz sampling rate)
  *
  */
 void __runRam ISR_ADC(void){
   /* toggle a time base signal */
-  TOG_LED_TIME_BASE;
+  deferred_work_post(DEFERRED_WORK_LED_TIME_BASE);
 
   /* starting from bit 16 the result is stored in ADCDAT.
      reading the ADCDATA also clears flag in ADCSTA */
   volatile uint32_t result =  ADCDAT;
   const uint16_t value = (result >> (16 + 12 - ADC_RESOLUTION));
 
-  /* downsampling of analog data */
-  if (skip_samples == 0) {
-    if (!measurement_finished) {
-      #if (BITS_PER_VALUE == 12)
-         /* for 12 bit 4 adjacent 12 bit samples (A,B,C,D) are coded as follows:
-          * [a|a|a|b], [b|b|c|c], [c|d|d|d]
-          */
-        switch (state) {
-           case (STATE_A) :
-               temp = (value << 4);
-               state = STATE_B;
-           break;
-           case (STATE_B) :
-               *table_cur = temp | (value >> 8);
-               table_cur++;
-               data_table_info.size += sizeof(*table_cur);
-               temp = (value << 8);
-               state = STATE_C;
-           break;
-           case (STATE_C) :
-               *table_cur = temp | (value >> 4);
-               table_cur++;
-               data_table_info.size += sizeof(*table_cur);
-               temp = (value << 12);
-               state = STATE_D;
-           break;
-           case (STATE_D) :
-               *table_cur = temp | value;
-               table_cur++;
-               data_table_info.size += sizeof(*table_cur);
-               state = STATE_A;
-           break;
-           default:
-
-           break;
-        }
-      #else
-        *table_cur = value;
-        table_cur++;
-        data_table_info.size += sizeof(*table_cur);
-      #endif
-      skip_samples = orig_skip_samples;
-      /* Note: If we either stop in state B or C the last analog sample will be corrupt */
-      if (table_cur >= table_end) {
-        timer1_halt();
-        /* tell main() that measurement is over */
-        measurement_finished = 1;
-      }
+  /* downsampling of analog data is done by Timer1 */
+  if (trigger.post_samples) {
+    trigger_sample(value);
+  } else if (!measurement_finished) {
+    #if (BITS_PER_VALUE == 12)
+      /* see sample-packing.h for the format */
+      sample_packer_put(&packer, value);
+      table_cur = packer.cur;
+    #else
+      *table_cur = value;
+      table_cur++;
+    #endif
+    data_table_info.size = ((char *)table_cur) - ((char *)table);
+    if (table_cur >= table_end) {
+      timer1_halt();
+      /* tell main() that measurement is over */
+      measurement_finished = 1;
     }
-  } else {
-    skip_samples--;
   }
 }
 
 
+/** Decimate by slowing down Timer1 (see timer1-adc-trigger.h) */
+uint8_t personality_decimate_in_timer1(void)
+{
+  return 1;
+}
+
+
 /** Switch off trigger to stop any sampling of the analog signal
  *
  *
@@ -227,6 +355,167 @@ void timer1_halt(void)
 }
 
 
+/** Send ring buffer samples packed like the 12 bit data table
+ *
+ * \param start Ring buffer slot of the first sample
+ * \param count Number of samples
+ */
+static
+void uart_put_ring_packed(uint32_t start, uint16_t count)
+{
+  while (count) {
+    const uint16_t n = (count < 4) ? count : 4;
+    volatile uint16_t packed[SAMPLE_PACK_HALFWORDS(4)];
+    sample_packer_t ring_packer;
+    sample_packer_init(&ring_packer, packed);
+    for (uint16_t i=0; i<n; i++) {
+      sample_packer_put(&ring_packer, table[start]);
+      start = (start + 1 == ring_size) ? 0 : (start + 1);
+    }
+    sample_packer_flush(&ring_packer);
+    uart_putb((const void *)packed,
+              (ring_packer.cur - packed) * sizeof(packed[0]));
+    count -= n;
+  }
+}
+
+
+/** Send the captured window, or an empty window if there is none */
+static
+void trigger_send_window(const packet_value_table_reason_t reason)
+{
+  const uint16_t samples = (trigger_state == TRIGGER_CAPTURED) ?
+    (trigger.pre_samples + trigger.post_samples) : 0;
+  const packet_trigger_window_t window = {
+    window_seq++,
+    samples,
+    trigger.pre_samples,
+    window_first
+  };
+  send_table_start(reason,
+                   sizeof(window) + SAMPLE_PACK_HALFWORDS(samples) * sizeof(uint16_t));
+  uart_putb((const void *)&window, sizeof(window));
+  uart_put_ring_packed(window_start, samples);
+  frame_end();
+}
+
+
+/** Re-arm the trigger for the next window */
+inline static
+void trigger_rearm(void)
+{
+  trigger_pre_filled = 0;
+  trigger_slope_ready = 0;
+  trigger_state = TRIGGER_ARMED;
+}
+
+
+/** Send the value table
+ *
+ * Without trigger, this is the whole data table. With trigger, this
+ * is the captured window.
+ */
+void send_table(const packet_value_table_reason_t reason)
+{
+  if (!trigger.post_samples) {
+    send_table_start(reason, data_table_info.size);
+    uart_putb((const void *)data_table, data_table_info.size);
+    frame_end();
+    return;
+  }
+  const uint8_t captured = (trigger_state == TRIGGER_CAPTURED);
+  trigger_send_window(reason);
+  if (captured && (reason == PACKET_VALUE_TABLE_INTERMEDIATE) &&
+      (trigger.flags & TRIGGER_FLAG_REARM)) {
+    trigger_rearm();
+  }
+}
+
+
+/** ADC status polls after which burst_capture() gives up
+ *
+ * A conversion takes about a microsecond, this is a few milliseconds.
+ */
+#define BURST_ADC_TIMEOUT 0x10000UL
+
+
+/** Fill the table in burst mode
+ *
+ * Runs from RAM with interrupts disabled, so nothing but the ADC
+ * status poll and the packer stands between two conversions. The
+ * ADC keeps converting at its own pace; the loop has to be faster
+ * than burst_sample_period.
+ *
+ * If the ADC stops delivering results, the capture is aborted after
+ * #BURST_ADC_TIMEOUT polls and the samples captured so far are sent.
+ */
+static
+void __runRam burst_capture(void)
+{
+  /* burst mode has no trigger */
+  trigger.post_samples = 0;
+  data_table_info.type = VALUE_TABLE_TYPE_SAMPLES;
+
+#if (BITS_PER_VALUE == 12)
+  sample_packer_t p = packer;
+  volatile table_element_t *const end = table_end;
+  uint8_t timeout = 0;
+
+  disable_IRQs_usermode();
+  ADCCON |= _BV(ADC_ENABLE_CONVERION);
+  while (p.cur < end) {
+    uint32_t polls = BURST_ADC_TIMEOUT;
+    while (!ADCSTA && --polls) {
+    }
+    if (!polls) {
+      timeout = 1;
+      break;
+    }
+    const uint32_t result = ADCDAT;
+    sample_packer_put(&p, result >> (16 + 12 - ADC_RESOLUTION));
+  }
+  ADCCON &= ~_BV(ADC_ENABLE_CONVERION);
+  enable_IRQs_usermode();
+
+  packer = p;
+  table_cur = p.cur;
+  data_table_info.size = ((char *)table_cur) - ((char *)table);
+  if (timeout) {
+    send_text("ADC burst timeout");
+  }
+#endif
+  /* tell main() that measurement is over */
+  measurement_finished = 1;
+}
+
+
+/** Send captured windows while measuring
+ *
+ * The ISR does not touch the ring buffer while a captured window
+ * waits to be sent, so it can be sent with interrupts enabled.
+ */
+void personality_measuring_poll(void)
+{
+  if (adc_burst) {
+    if (!measurement_finished) {
+      burst_capture();
+    }
+    return;
+  }
+  if (!trigger.post_samples || (trigger_state != TRIGGER_CAPTURED)) {
+    return;
+  }
+  if (trigger.flags & TRIGGER_FLAG_REARM) {
+    trigger_send_window(PACKET_VALUE_TABLE_INTERMEDIATE);
+    trigger_rearm();
+  } else {
+    /* main() sends the window with send_table() */
+    timer1_halt();
+    measurement_finished = 1;
+  }
+}
+
+
 /** Show the user that the measurement has been finished
  *
  *
@@ -241,6 +530,21 @@ void timer1_init_quick(void)
 /** Callback */
 void on_measurement_finished(void)
 {
+  timebase_stop();
+  if (trigger.post_samples) {
+    /* stop sampling on abort as well */
+    timer1_halt();
+  }
+#if (BITS_PER_VALUE == 12)
+  else if (table_cur < table_end) {
+    /* Timer1 has been halted or IRQs are disabled: send the last,
+     * partially filled halfword as well. A full table has no room
+     * for it. */
+    sample_packer_flush(&packer);
+    table_cur = packer.cur;
+    data_table_info.size = ((char *)table_cur) - ((char *)table);
+  }
+#endif
   /* alert user */
   timer1_init_quick();
 }
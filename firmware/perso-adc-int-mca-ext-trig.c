@@ -45,6 +45,10 @@
 #include "data-table.h"
 
 #include "timer1-measurement.h"
+#include "live-time.h"
+#include "roi.h"
+#include "adc-resolution.h"
+#include "status.h"
 
 #define DEBUG_ADC_TRIGGER 1
 
@@ -70,7 +74,7 @@ data_table_info_t data_table_info = {
 
 /** See * \see data_table */
 PERSONALITY("adc-int-mca",
-            2,0,
+            2,0,0,0,sizeof(packet_roi_param_t),1,
             1,
             sizeof(table),
             BITS_PER_VALUE);
@@ -146,8 +150,12 @@ adctest_init(void){
  * PLA-HW PIN <-> Rising edge ADC-Busy = 190ns
  * ADC-Busy width = 1.18us
  *
+ * The time spent between trigger and ISR exit is accounted as dead
+ * time, see \ref live_time.
  */
 void __runRam ISR_ADC(void){
+  const uint16_t enter_stamp = live_time_isr_enter();
+
   /* pull pin to discharge peak hold capacitor                    */
   /** \todo worst case calculation: runtime & R7010 */
   // \todo
@@ -155,15 +163,18 @@ void __runRam ISR_ADC(void){
   /* starting from bit 16 the result is stored in ADCDAT.
      reading the ADCDATA also clears flag in ADCSTA */
   volatile uint32_t result =  ADCDAT;
-  /* adjust to correct size */
-  const uint16_t index = (result >> (16 + 12 - ADC_RESOLUTION));
+  /* adjust to the selected resolution */
+  const uint16_t index = (result >> adc_shift);
 
   volatile table_element_t *element = &(table[index]);
-  table_element_inc(element);
+  status_count(index, table_element_inc(element), TABLE_ELEMENT_MAX);
+  roi_count(index);
 
   /* set pin to GND and release peak hold capacitor   */
   // \todo
 
+  /* a new result is ready if a trigger arrived while we were busy */
+  live_time_isr_exit(enter_stamp, ADCSTA);
 }
 
 
@@ -295,6 +306,8 @@ void personality_start_measurement_sram(void)
 {
   const void *voidp = &pparam_sram.params[0];
   const uint16_t *timer1_value = voidp;
+  personality_roi_setup(&pparam_sram.params[2]);
+  personality_resolution_setup(pparam_sram.params[2 + sizeof(packet_roi_param_t)]);
   /** ADC subsystem and trigger setup */
   adc_pla_trigger();
   adc_init();
@@ -40,11 +40,14 @@
 #include "table-element.h"
 #include "data-table.h"
 #include "timer1-adc-trigger.h"
+#include "live-time.h"
+#include "roi.h"
+#include "adc-resolution.h"
+#include "status.h"
 #include "main.h"
+#include "deferred-work.h"
 
 
-#define TOG_LED_TIME_BASE (GP4DAT ^= _BV(GP_DATA_OUTPUT_Px1))
-
 /** Number of elements in the histogram table */
 #define MAX_COUNTER (1<<ADC_RESOLUTION)
 
@@ -76,7 +79,7 @@ data_table_info_t data_table_info = {
 
 /** See * \see data_table */
 PERSONALITY("adc-int-mca-timed",
-            2,2,
+            2,2,0,0,sizeof(packet_roi_param_t),1,
             10,
             sizeof(table),
             BITS_PER_VALUE);
@@ -88,10 +91,15 @@ PERSONALITY("adc-int-mca-timed",
   * Downsampling of base analog samples and update of histogram table.
   * Actually one could implement a low pass filter here before
   * downsampling to fullfill shannons sample theoreme
+  *
+  * Timer1 triggers which hit us while still busy with the previous
+  * sample are counted, see \ref live_time.
   */
 void ISR_ADC(void){
+  const uint16_t enter_stamp = live_time_isr_enter();
+
   /* toggle a time base signal */
-  TOG_LED_TIME_BASE;
+  deferred_work_post(DEFERRED_WORK_LED_TIME_BASE);
 
   /* starting from bit 16 the result is stored in ADCDAT.
      reading the ADCDATA also clears flag in ADCSTA */
@@ -99,9 +107,10 @@ void ISR_ADC(void){
 
   /* downsampling of analog data via skip_samples */
   if (skip_samples == 0) {
-    const uint16_t index = (result >> (16 + 12 - ADC_RESOLUTION));
+    const uint16_t index = (result >> adc_shift);
     volatile table_element_t *element = &(table[index]);
-    table_element_inc(element);
+    status_count(index, table_element_inc(element), TABLE_ELEMENT_MAX);
+    roi_count(index);
     skip_samples = orig_skip_samples;
   } else {
     skip_samples--;
@@ -114,6 +123,7 @@ void ISR_ADC(void){
       timer1_halt();
     }
   }
+  live_time_isr_exit(enter_stamp, ADCSTA);
 }
 
 
@@ -131,6 +141,7 @@ void timer1_halt(void)
 /** Do nothing */
 void on_measurement_finished(void)
 {
+  timebase_stop();
 }
 
 
@@ -0,0 +1,318 @@
+/** \file firmware/perso-adc-int-stream-timed-trig.c
+ * \brief Personality: Streaming data logger with internal ADC and timed trigger
+ *
+ * \author Copyright (C) 2012 samplemaker
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ *
+ * \defgroup perso_adc_int_stream_timed_trig Personality: Streaming data logger with internal ADC and timed trigger
+ * \ingroup firmware_personality_groups
+ *
+ * Timed ADC sampling like \ref perso_adc_int_log_timed_trig, but
+ * without a limit on the number of samples.
+ *
+ * The sample buffer is split into two halves. While the ISR fills
+ * one half, the main loop sends the other one as a
+ * #VALUE_TABLE_TYPE_SAMPLE_BLOCK value table. If the UART cannot keep
+ * up and both halves are waiting to be sent, samples are dropped
+ * until a half is free again. The next block then carries the
+ * #SAMPLE_BLOCK_FLAG_OVERRUN flag and its first_sample index tells
+ * the host how many samples are missing.
+ *
+ * The measurement runs until it is aborted.
+ *
+ * @{
+ */
+
+
+#include <stddef.h>
+
+#include "aduc.h"
+#include "init.h"
+
+/** Sample element size */
+#define BITS_PER_VALUE 12
+
+#include "perso-adc-int-global.h"
+#include "frame-comm.h"
+#include "uart-comm.h"
+#include "packet-comm.h"
+#include "sample-packing.h"
+#include "table-element.h"
+#include "data-table.h"
+
+#include "timer1-adc-trigger.h"
+#include "main.h"
+#include "deferred-work.h"
+
+
+/** The sample buffer
+ *
+ * Note that we have the buffer location and size determined by the
+ * linker script data_table_empty_ram.lds.
+ */
+extern volatile table_element_t table[] asm("data_table");
+
+
+/** Pseudo symbol - just use its address */
+extern volatile char data_table_size[];
+
+
+/** Data table info
+ *
+ * The size is zero as we never send the #data_table as a whole.
+ *
+ * \see data_table
+ */
+data_table_info_t data_table_info = {
+  /** Actual size of #data_table in bytes */
+  0,
+  /** Type of value table we send */
+  VALUE_TABLE_TYPE_SAMPLE_BLOCK,
+  /** Table element size */
+  BITS_PER_VALUE
+};
+
+
+/** See * \see data_table */
+PERSONALITY("adc-int-timed-streaming",
+            0,2,0,4,0,0,
+            10,
+            0,
+            BITS_PER_VALUE);
+
+
+/** Block size in table elements, a multiple of 3 so that every block
+ *  starts with a fresh group of 4 packed samples */
+static uint32_t block_elements;
+
+/** Block size in samples */
+static uint32_t block_capacity;
+
+/** Start of the two buffer halves */
+static volatile table_element_t *block_base[2];
+
+/** Half the ISR writes to */
+static uint8_t write_half;
+
+/** Half the main loop sends next */
+static uint8_t send_half;
+
+/** Packs the samples into the half the ISR writes to */
+static sample_packer_t packer;
+
+/** Half is complete and waiting to be sent (set by ISR, cleared by
+ *  main loop) */
+static volatile uint8_t block_pending[2];
+
+/** Number of samples in each half */
+static volatile uint16_t block_samples[2];
+
+/** Stream index of the first sample in each half */
+static volatile uint32_t block_first[2];
+
+/** Flags for each half (SAMPLE_BLOCK_FLAG_*) */
+static volatile uint8_t block_flags[2];
+
+/** Stream index of the next sample, including dropped samples */
+static volatile uint32_t next_sample;
+
+/** Samples have been dropped since the last block has been started */
+static volatile uint8_t overrun;
+
+/** Sequence number of the next block */
+static uint16_t block_seq;
+
+
+/** Workaround
+ *
+ */
+void __init personality_info_init(void)
+{
+  personality_info.sizeof_table = (size_t)(&data_table_size);
+  const uint32_t elements = ((size_t)(&data_table_size)) / sizeof(table[0]);
+  block_elements = ((elements / 2) / 3) * 3;
+  block_capacity = (block_elements / 3) * 4;
+  block_base[0] = &table[0];
+  block_base[1] = &table[block_elements];
+  sample_packer_init(&packer, block_base[0]);
+}
+module_init(personality_info_init, 8);
+
+
+/** AD conversion complete interrupt entry point
+ *
+ * Packs the samples (see sample-packing.h) and
+ * switches buffer halves when a half is full.
+ */
+void __runRam ISR_ADC(void){
+  /* toggle a time base signal */
+  deferred_work_post(DEFERRED_WORK_LED_TIME_BASE);
+
+  /* starting from bit 16 the result is stored in ADCDAT.
+     reading the ADCDATA also clears flag in ADCSTA */
+  volatile uint32_t result =  ADCDAT;
+  const uint16_t value = (result >> (16 + 12 - ADC_RESOLUTION));
+
+  /* downsampling of analog data is done by Timer1 */
+
+  const uint8_t half = write_half;
+  if (block_pending[half]) {
+    /* both halves are waiting for the UART */
+    overrun = 1;
+    next_sample++;
+    return;
+  }
+
+  uint16_t samples = block_samples[half];
+  if (samples == 0) {
+    block_first[half] = next_sample;
+    block_flags[half] = (overrun) ? SAMPLE_BLOCK_FLAG_OVERRUN : 0;
+    overrun = 0;
+  }
+
+  sample_packer_put(&packer, value);
+
+  samples++;
+  next_sample++;
+  block_samples[half] = samples;
+  if (samples == block_capacity) {
+    /* block_capacity is a multiple of 4, so no bits are pending */
+    block_pending[half] = 1;
+    deferred_work_post(DEFERRED_WORK_POLL);
+    write_half = half ^ 1;
+    sample_packer_init(&packer, block_base[half ^ 1]);
+  }
+}
+
+
+/** Decimate by slowing down Timer1 (see timer1-adc-trigger.h) */
+uint8_t personality_decimate_in_timer1(void)
+{
+  return 1;
+}
+
+
+/** Send one block
+ *
+ * \param samples Number of samples in the block
+ * \param elements Number of table elements to send
+ */
+static
+void stream_send_block(const packet_value_table_reason_t reason,
+                       const uint8_t half, const uint16_t samples,
+                       const uint32_t elements)
+{
+  const packet_sample_block_t block = {
+    block_seq++,
+    samples,
+    block_first[half],
+    block_flags[half]
+  };
+  send_table_start(reason, sizeof(block) + elements * sizeof(table[0]));
+  uart_putb((const void *)&block, sizeof(block));
+  uart_putb((const void *)block_base[half], elements * sizeof(table[0]));
+  frame_end();
+}
+
+
+/** Send a completed half if there is one
+ *
+ * The ISR does not touch a pending half, so it can be sent with
+ * interrupts enabled.
+ */
+static
+uint8_t stream_send_pending(const packet_value_table_reason_t reason)
+{
+  const uint8_t half = send_half;
+  if (!block_pending[half]) {
+    return 0;
+  }
+  stream_send_block(reason, half, block_capacity, block_elements);
+  block_samples[half] = 0;
+  send_half = half ^ 1;
+  /* hand the half back to the ISR */
+  block_pending[half] = 0;
+  return 1;
+}
+
+
+/** Send the value table
+ *
+ * While measuring, this sends the next completed block, or a block
+ * without samples if there is none. When the measurement is over,
+ * all remaining samples are sent including the partially filled
+ * half.
+ */
+void send_table(const packet_value_table_reason_t reason)
+{
+  if (reason == PACKET_VALUE_TABLE_INTERMEDIATE) {
+    if (!stream_send_pending(reason)) {
+      stream_send_block(reason, send_half, 0, 0);
+    }
+    return;
+  }
+
+  /* Timer1 has been halted, the ISR does not run anymore */
+  while (stream_send_pending(PACKET_VALUE_TABLE_INTERMEDIATE)) {
+    /* send all completed halves first */
+  }
+  const uint8_t half = write_half;
+  /* store the partially packed element */
+  sample_packer_flush(&packer);
+  const uint32_t elements = packer.cur - block_base[half];
+  stream_send_block(reason, half, block_samples[half], elements);
+  block_samples[half] = 0;
+  sample_packer_init(&packer, block_base[half]);
+}
+
+
+/** Stream completed blocks while measuring */
+void personality_measuring_poll(void)
+{
+  stream_send_pending(PACKET_VALUE_TABLE_INTERMEDIATE);
+}
+
+
+/** Switch off trigger to stop any sampling of the analog signal
+ *
+ * Also masks the ADC IRQ so that a conversion still in progress
+ * cannot change the buffer while send_table() flushes it.
+ */
+inline static
+void timer1_halt(void)
+{
+  T1CON &= ~_BV(TIMER1_ENABLE);
+  IRQCLR = _BV(INT_ADC_CHANNEL);
+}
+
+
+/** Callback */
+void on_measurement_finished(void)
+{
+  timer1_halt();
+  timebase_stop();
+}
+
+
+/** @} */
+
+/*
+ * Local Variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
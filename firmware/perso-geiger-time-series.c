@@ -44,9 +44,8 @@
 #include "table-element.h"
 #include "data-table.h"
 #include "beep.h"
-
-#define TOG_LED_TIME_BASE (GP4DAT ^= _BV(GP_DATA_OUTPUT_Px1))
-#define TOG_LED_EVENT (GP4DAT ^= _BV(GP_DATA_OUTPUT_Px0))
+#include "deferred-work.h"
+#include "status.h"
 
 #define RST_EOI_ENA (PLADIN |= _BV(1))
 #define RST_EOI_DIS (PLADIN &=~ _BV(1))
@@ -93,7 +92,7 @@ data_table_info_t data_table_info = {
 
 /** See * \see data_table */
 PERSONALITY("geiger-time-series",
-            2,0,
+            2,0,0,0,0,0,
             1,
             0,/* should be  ((size_t)(&data_table_size)). see workaround */
             BITS_PER_VALUE);
@@ -152,23 +151,32 @@ void __init personality_io_init(void)
 module_init(personality_io_init, 5);
 
 
+/** Geiger counter pulse ISR
+ *
+ * Counts the event and resets the trigger latch. Beep and event LED
+ * are left to the main loop, see personality_deferred_work().
+ */
 void __runRam ISR_PLA_INT0(void)
 {
-  _beep();
-  TOG_LED_EVENT;
-
   if (table_cur < table_end) {
-    table_element_inc(table_cur);
+    status_count(table_cur - table, table_element_inc(table_cur),
+                 TABLE_ELEMENT_MAX);
   }
 
-  /* if a certain threshold is reached do s.th. nice */
-  /*if (  table_element_cmp_eq(table_cur, 0xab)) {
-    TOG_LED_TIME_BASE;
-  }*/
-
   /* reset the PLA trigger latch */
   RST_EOI_ENA;
   RST_EOI_DIS;
+
+  deferred_work_post(DEFERRED_WORK_BEEP | DEFERRED_WORK_LED_EVENT);
+}
+
+
+/** Beep for the events counted since the last run */
+void personality_deferred_work(const uint32_t jobs)
+{
+  if (jobs & DEFERRED_WORK_BEEP) {
+    _beep();
+  }
 }
 
 
@@ -178,7 +186,9 @@ volatile uint16_t orig_timer1_count;
 
 void ISR_WAKEUP_TIMER2(void)
 {
-  TOG_LED_TIME_BASE;
+  deferred_work_post(DEFERRED_WORK_LED_TIME_BASE);
+
+  timer2_periods++;
 
   if (!gf_measurement_finished) {
     /** We do not touch the measurement_finished flag ever again after
@@ -331,6 +341,8 @@ void trigger_src_conf(void)
 
 void on_measurement_finished(void)
 {
+  /* Timer2 stays enabled, stop advancing the time series */
+  gf_measurement_finished = 1;
   beep_kill_all();
   timer1_init_quick();
 }
@@ -0,0 +1,88 @@
+/** \file firmware/roi.c
+ * \brief Region of interest counters
+ *
+ * \author Copyright (C) 2012 samplemaker
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ *
+ * \addtogroup roi
+ * @{
+ */
+
+#include <stdint.h>
+
+#include "aduc.h"
+
+#include "roi.h"
+
+
+uint16_t roi_first[ROI_MAX];
+
+uint16_t roi_span[ROI_MAX];
+
+uint8_t roi_windows;
+
+volatile uint32_t roi_sum[ROI_MAX];
+
+
+/** Read a little endian uint16_t from the parameter buffer */
+inline static
+uint16_t roi_get_u16(const uint8_t *p)
+{
+  return (((uint16_t)p[0]) << 0) | (((uint16_t)p[1]) << 8);
+}
+
+
+void personality_roi_setup(const void *param)
+{
+  const uint8_t *p = param;
+  roi_windows = 0;
+  for (uint8_t r = 0; r < ROI_MAX; r++) {
+    /* not aligned, read byte by byte */
+    const uint16_t first = roi_get_u16(&p[r * sizeof(packet_roi_window_t)]);
+    const uint16_t last  = roi_get_u16(&p[r * sizeof(packet_roi_window_t) + 2]);
+    roi_sum[r] = 0;
+    if (first > last) {
+      /* unused: matches bin 0xFFFF only, which the ADC never yields */
+      roi_first[r] = 0xFFFF;
+      roi_span[r] = 0;
+      continue;
+    }
+    roi_first[r] = first;
+    roi_span[r] = last - first;
+    roi_windows = r + 1;
+  }
+}
+
+
+uint8_t get_roi_sums(uint32_t *sums)
+{
+  for (uint8_t r = 0; r < ROI_MAX; r++) {
+    /* 32 bit reads are atomic */
+    sums[r] = roi_sum[r];
+  }
+  return ROI_MAX;
+}
+
+
+/** @} */
+
+/*
+ * Local Variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,100 @@
+/** \file firmware/roi.h
+ * \brief Region of interest counters
+ *
+ * \author Copyright (C) 2012 samplemaker
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ *
+ * \defgroup roi Region of interest counters
+ * \ingroup firmware_generic
+ *
+ * The host uploads up to #ROI_MAX windows of histogram bins with the
+ * measurement command (#packet_roi_param_t). The ADC ISR adds every
+ * event to the sum of each window it falls into, so the host can
+ * watch a few peaks by asking for a #packet_roi_summary_t instead of
+ * reading the whole histogram.
+ *
+ * The windows are kept as first bin and width, so one unsigned
+ * compare per window does the range check. Unused windows at the end
+ * are not looked at.
+ *
+ * Personalities without ROI support get the defaults from main.c,
+ * which ignore the parameters and report no sums.
+ *
+ * @{
+ */
+
+#ifndef ROI_H
+#define ROI_H
+
+#include <stdint.h>
+
+#include "packet-defs.h"
+
+
+/** First bin of each window (write access before the measurement only) */
+extern uint16_t roi_first[ROI_MAX];
+
+/** Last bin minus first bin of each window */
+extern uint16_t roi_span[ROI_MAX];
+
+/** Number of windows the ISR has to look at */
+extern uint8_t roi_windows;
+
+/** Counts in each window (ISR write access only) */
+extern volatile uint32_t roi_sum[ROI_MAX];
+
+
+/** Set up the windows from the measurement parameters
+ *
+ * \param param Parameter buffer position of a #packet_roi_param_t,
+ *              not necessarily aligned
+ */
+void personality_roi_setup(const void *param);
+
+
+/** Copy the window sums
+ *
+ * \param sums Buffer for #ROI_MAX sums
+ * \return Number of valid sums, 0 without ROI support
+ */
+uint8_t get_roi_sums(uint32_t *sums);
+
+
+/** Count a histogram event in the windows (call from ISR only) */
+inline static
+void roi_count(const uint16_t bin)
+{
+  for (uint8_t r = 0; r < roi_windows; r++) {
+    /* bins below first wrap around to large values */
+    if ((uint16_t)(bin - roi_first[r]) <= roi_span[r]) {
+      roi_sum[r]++;
+    }
+  }
+}
+
+
+/** @} */
+
+#endif /* !ROI_H */
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
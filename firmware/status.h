@@ -0,0 +1,148 @@
+/** \file firmware/status.h
+ * \brief Measurement status counters
+ *
+ * \author Copyright (C) 2012 samplemaker
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ *
+ * \defgroup status Measurement status counters
+ * \ingroup firmware_generic
+ *
+ * The ISRs which count events into the table keep a few numbers
+ * about the table up to date as they go: the total number of events,
+ * the largest element and whether an element has wrapped around.
+ * main.c sends them on request (#FRAME_CMD_STATUS) together with the
+ * measurement time, which lets the host poll the progress of a
+ * measurement without reading the whole table.
+ *
+ * An element which wraps around is promoted into the overflow table,
+ * which keeps the counts lost to the wrap around. This lets the host
+ * reconstruct the exact counts, so that the element size does not
+ * limit the measurement duration (see \ref
+ * packet_emb_to_host_overflow). The overflow table is built in unless
+ * the firmware is built with BUILD_OVERFLOW_TABLE=no.
+ *
+ * The counters need no initialization as the device is reset after
+ * every measurement, see \ref firmware_memories.
+ *
+ * @{
+ */
+
+#ifndef STATUS_H
+#define STATUS_H
+
+#include <stdint.h>
+
+#include "packet-defs.h"
+
+
+/** Number of events counted into the table (ISR write access only) */
+extern volatile uint32_t status_total_counts;
+
+/** Largest table element (ISR write access only) */
+extern volatile uint32_t status_max_value;
+
+/** Index of the largest table element (ISR write access only) */
+extern volatile uint16_t status_max_index;
+
+/** STATUS_FLAG_* (ISR write access only) */
+extern volatile uint8_t status_flags;
+
+
+#ifdef OVERFLOW_TABLE
+
+/** Overflow table (ISR write access only) */
+extern volatile packet_overflow_entry_t overflow_table[OVERFLOW_TABLE_SIZE];
+
+/** Number of entries in #overflow_table (ISR write access only) */
+extern volatile uint8_t overflow_entries;
+
+#endif
+
+
+/** Account for a table element which has wrapped around (call from
+ *  ISR only)
+ *
+ * \param index Index of the table element
+ * \param element_max TABLE_ELEMENT_MAX of the table
+ */
+inline static
+void status_wrapped(const uint16_t index, const uint32_t element_max)
+{
+#ifdef OVERFLOW_TABLE
+  /* 32 bit elements have no room for a carry */
+  const uint32_t wrap = element_max + 1;
+  if (wrap) {
+    uint8_t i;
+    for (i = 0; i < overflow_entries; i++) {
+      if (overflow_table[i].index == index) {
+        break;
+      }
+    }
+    if (i == overflow_entries) {
+      if (i < OVERFLOW_TABLE_SIZE) {
+        overflow_table[i].index = index;
+        overflow_table[i].carry = 0;
+        overflow_entries = i + 1;
+      }
+    }
+    /* carry is a multiple of wrap, it would wrap around to 0 */
+    if ((i < overflow_entries) && (overflow_table[i].carry + wrap)) {
+      overflow_table[i].carry += wrap;
+      status_flags |= STATUS_FLAG_PROMOTED;
+      return;
+    }
+  }
+#else
+  (void)index;
+  (void)element_max;
+#endif
+  status_flags |= STATUS_FLAG_OVERFLOW;
+}
+
+
+/** Account for an event counted into a table element (call from ISR only)
+ *
+ * \param index Index of the table element
+ * \param value Value returned by table_element_inc()
+ * \param element_max TABLE_ELEMENT_MAX of the table
+ */
+inline static
+void status_count(const uint16_t index, const uint32_t value,
+                  const uint32_t element_max)
+{
+  status_total_counts++;
+  if ((value > element_max) || (value == 0)) {
+    /* wrapped around */
+    status_wrapped(index, element_max);
+  } else if (value > status_max_value) {
+    status_max_value = value;
+    status_max_index = index;
+  }
+}
+
+
+/** @} */
+
+#endif /* !STATUS_H */
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -101,6 +101,13 @@ void switch_lock(void){
 }
 
 
+
+/** Whether the switch has been locked by switch_lock() */
+uint8_t switch_is_locked(void){
+  return (the_switch_lock == SWITCH_LOCKED_OFF);
+}
+
+
 /** @} */
 
 
@@ -31,6 +31,7 @@
 
 uint8_t switch_trigger_measurement(void);
 void switch_lock(void);
+uint8_t switch_is_locked(void);
 
 #endif /* !SWITCH_H */
 
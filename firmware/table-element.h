@@ -59,6 +59,18 @@ typedef
   table_element_t;
 
 
+/** Largest count a table element can hold */
+#if (BITS_PER_VALUE == 8)
+# define TABLE_ELEMENT_MAX 0xffUL
+#elif (BITS_PER_VALUE == 12) || (BITS_PER_VALUE == 16)
+# define TABLE_ELEMENT_MAX 0xffffUL
+#elif (BITS_PER_VALUE == 24)
+# define TABLE_ELEMENT_MAX 0xffffffUL
+#else
+# define TABLE_ELEMENT_MAX 0xffffffffUL
+#endif
+
+
 #if (BITS_PER_VALUE == 24)
 
 /** Increment 24bit unsigned integer */
@@ -102,10 +114,15 @@ void table_element_copy(volatile freemcan_uint24_t *dest,
 }
 
 
+/** Increment 24bit unsigned integer
+ *
+ * \return The incremented value before truncation to 24 bits, i.e.
+ *         TABLE_ELEMENT_MAX + 1 if the element has wrapped around.
+ */
 inline static
-void table_element_inc(volatile freemcan_uint24_t *element)
+uint32_t table_element_inc(volatile freemcan_uint24_t *element)
 {
-  register uint32_t r0_, r1_;
+  register uint32_t r0_, r1_, value_;
   asm volatile("\n\t"
                /* load three bytes with respect to endianess (MSB2LSB) */
                "mov   %[r0], #0                     \n\t"
@@ -117,6 +134,7 @@ void table_element_inc(volatile freemcan_uint24_t *element)
                "orr   %[r0], %[r1]                  \n\t"
                /* increase by one */
                "add   %[r0], %[r0], #1              \n\t"
+               "mov   %[val], %[r0]                 \n\t"
                /* store three bytes with respect to endianess (LSB2MSB) */
                "strb  %[r0], [%[elem]]              \n\t"
                "mov   %[r0], %[r0] ,LSR #8          \n\t"
@@ -126,13 +144,15 @@ void table_element_inc(volatile freemcan_uint24_t *element)
                : /* output operands */
                  /* let compiler decide which registers to clobber */
                  [r1] "=&r" (r1_),
-                 [r0] "=&r" (r0_)
+                 [r0] "=&r" (r0_),
+                 [val] "=&r" (value_)
                  /* input and output operand (treated inside output list) */
                : /* input operands */
                  [elem] "r" (element)
                  /* store all cached values before and reload them after */
                : "memory"
   );
+  return value_;
 }
 
 
@@ -204,11 +224,17 @@ void table_element_copy(volatile table_element_t *dest,
   *dest = *source;
 }
 
-/** Increment 8bit, 16bit, or 32bit unsigned integer */
+/** Increment 8bit, 16bit, or 32bit unsigned integer
+ *
+ * \return The incremented value before truncation to the element
+ *         width. A 32bit element which has wrapped around returns 0.
+ */
 inline static
-void table_element_inc(volatile table_element_t *element)
+uint32_t table_element_inc(volatile table_element_t *element)
 {
-  (*element)++;
+  const uint32_t value = ((uint32_t)(*element)) + 1;
+  *element = value;
+  return value;
 }
 
 /** Compare table element to a value for equality.
@@ -0,0 +1,75 @@
+/** \file firmware/timebase.h
+ * \brief Measurement timebase
+ *
+ * \author Copyright (C) 2012 samplemaker
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ *
+ * \defgroup timebase Measurement timebase
+ * \ingroup firmware_generic
+ *
+ * The time elapsed since the start of the measurement in ticks of a
+ * timebase clock, sent in every value table header together with
+ * the clock frequency. This gives the hostware the measurement time
+ * with sub-second resolution, independent of the units_per_second
+ * granularity of the duration.
+ *
+ * The free running timebase is also sent on request
+ * (#FRAME_CMD_TIME_SYNC), which lets the hostware map device time to
+ * host time, see clock-sync.h.
+ *
+ * Personalities without a timebase get the defaults from main.c,
+ * which report a timebase clock of 0 (undefined).
+ *
+ * @{
+ */
+
+#ifndef TIMEBASE_H
+#define TIMEBASE_H
+
+#include <stdint.h>
+
+
+/** Get timebase ticks elapsed since the start of the measurement
+ *
+ * Stops advancing when the measurement has finished.
+ */
+uint64_t get_elapsed_ticks(void);
+
+
+/** Get the free running timebase ticks */
+uint64_t get_timebase_ticks(void);
+
+
+/** Get the timebase ticks at the start of the measurement */
+uint64_t get_timebase_start(void);
+
+
+/** Get frequency of the timebase clock in Hz, 0 if there is none */
+uint32_t get_timebase_clock(void);
+
+
+/** @} */
+
+#endif /* !TIMEBASE_H */
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -24,6 +24,25 @@
  *
  * Timer hardware directly triggering ADC
  *
+ * The sample period is TIMER1_INTERVAL by default. Personalities
+ * with a sample period parameter let the host choose it at runtime,
+ * in ticks of the core clock (personality_info.sample_clock). The
+ * prescaler and reload value are calculated from it when the
+ * measurement starts.
+ *
+ * A sample period of #SAMPLE_PERIOD_BURST selects burst mode if the
+ * personality supports it: Timer1 and the ADC interrupt stay off,
+ * the ADC converts continuously and the personality polls the
+ * results (see adc_burst).
+ *
+ * Timer2 runs free from the 32.768kHz crystal and is extended to 64
+ * bits by its overflow interrupt. It is the \ref timebase of the
+ * measurement and also yields the duration, so the duration is exact
+ * in all modes, including burst mode where no Timer1 periods are
+ * counted. The crystal is the PLL reference as well, so the timebase
+ * does not drift against the core clock the sample period is given
+ * in.
+ *
  * @{
  */
 
@@ -35,6 +54,10 @@
 #include "data-table.h"
 #include "perso-adc-int-global.h"
 #include "timer1-adc-trigger.h"
+#include "timer1-get-duration.h"
+#include "timebase.h"
+#include "roi.h"
+#include "adc-resolution.h"
 #include "packet-comm.h"
 
 #define TIMER1_INTERVAL 3000ULL
@@ -70,6 +93,73 @@ volatile uint16_t orig_skip_samples;
 volatile uint16_t skip_samples;
 
 
+/** Burst mode has been selected for the running measurement */
+uint8_t adc_burst;
+
+
+/** Default sample period [core clock ticks] */
+#define TIMER1_DEFAULT_PERIOD \
+  ((uint32_t)((TIMER1_INTERVAL * F_HCLK) / 1000000ULL))
+
+/** Shortest sample period the ADC ISRs have been tested with (8us)
+ *  [core clock ticks] */
+#define TIMER1_MIN_PERIOD \
+  ((uint32_t)((8ULL * F_HCLK) / 1000000ULL))
+
+
+/** Timer1 prescaler field value for the running measurement */
+static uint32_t timer1_prescaler;
+
+/** Timer1 reload value, i.e. the ADC conversion period in prescaled
+ *  ticks */
+static uint32_t timer1_load_value;
+
+
+/** Announce the sample period range in the personality info
+ *
+ * Only makes sense for personalities with a sample period parameter.
+ */
+void __init timer1_personality_info_init(void)
+{
+  if (personality_info.param_data_size_sample_period) {
+    personality_info.sample_clock = (uint32_t)F_HCLK;
+    personality_info.min_sample_period = TIMER1_MIN_PERIOD;
+    personality_info.max_sample_period = 0xFFFFFFFFUL;
+  }
+}
+module_init(timer1_personality_info_init, 8);
+
+
+/** Calculate prescaler and reload value from the sample period
+ *
+ * Integer math only. The product of period and decimation has up to
+ * 48 bits, so the smallest prescaler is chosen which brings the
+ * reload value into 32 bits.
+ *
+ * \param period Sample period [core clock ticks]
+ * \param decimation Number of periods per conversion
+ */
+static
+void timer1_set_period(const uint32_t period, const uint32_t decimation)
+{
+  const uint64_t ticks = ((uint64_t)period) * decimation;
+  if (ticks <= 0xFFFFFFFFULL) {
+    timer1_prescaler = 0;
+    timer1_load_value = ticks;
+  } else if ((ticks >> 4) <= 0xFFFFFFFFULL) {
+    timer1_prescaler = 4;   /* divide by 16 */
+    timer1_load_value = ticks >> 4;
+  } else if ((ticks >> 8) <= 0xFFFFFFFFULL) {
+    timer1_prescaler = 8;   /* divide by 256 */
+    timer1_load_value = ticks >> 8;
+  } else {
+    timer1_prescaler = 15;  /* divide by 32768 */
+    const uint64_t load = ticks >> 15;
+    timer1_load_value = (load <= 0xFFFFFFFFULL) ? load : 0xFFFFFFFFUL;
+  }
+}
+
+
 /** Power up ADC
  *
  * Note: The ADC must be powered up for at least
@@ -107,12 +197,12 @@ void timer1_init(void)
   /* Clear TIMER1_COUNT_DIR (force downcount), TIMER1_CAPTURE_ENABLE (no capture)
    * Select appropriate clock source and run timer in periodic mode 
    * (automatic reload from T1LD)  */
-  T1CON = (_FS(TIMER1_PRESCALER, TIMER1_PRESCALER_VALUE) |
+  T1CON = (_FS(TIMER1_PRESCALER, timer1_prescaler)      |
            _FS(TIMER1_CLKSOURCE, TIMER1_CLK)             |
            _BV(TIMER1_MODE) );
 
   /* Timer compare match value */
-  T1LD = TIMER1_LOAD_VALUE_DOWNCNT;
+  T1LD = timer1_load_value;
   T1CON |= _BV(TIMER1_ENABLE);
   /* for the firmwares affected the data is handled inside the ADC ISR
    * (no timer ISR) */
@@ -120,11 +210,177 @@ void timer1_init(void)
 }
 
 
-/** \todo Should give out a reasonable value
-    2011/09/25 Samplemaker: Could use 32 bit timer2 on ADUC for timebase */
-uint16_t get_duration(void)
+/** Configure the ADC for burst mode
+ *
+ * Like adc_init(), but with software continuous conversion, the
+ * shortest acquisition time and without ADC interrupt. Conversions
+ * start when ADC_ENABLE_CONVERION is set.
+ */
+static
+void adc_init_burst(void)
 {
-  return 0;
+  IRQCLR = _BV(INT_ADC_CHANNEL);
+  ADCCON = (_FS(ADC_CLOCK_SPEED, MASK_001)     |
+            _FS(ADC_ACQUISITION_TIME, MASK_00) |
+            _BV(ADC_POWER_CONTROL)             |
+            _FS(ADC_CONVERSION_MODE, MASK_00)  |
+            _FS(ADC_TRIGGER_SOURCE, MASK_100)    );
+  ADCCP = _FS(ADC_PCHANNEL_SELECTION, MASK_00000);
+  REFCON = _BV(REF_BANDGAP_ENABLE);
+}
+
+
+/** Number of burst conversions timed by adc_burst_calibrate() (log2) */
+#define BURST_CALIBRATION_SHIFT 8
+
+
+/* documented in timer1-adc-trigger.h */
+uint32_t __init adc_burst_calibrate(void)
+{
+  adc_init_burst();
+
+  /* Timer1 free running from the core clock, counting down */
+  T1CON = 0;
+  T1LD = 0xFFFFFFFFUL;
+  T1CON = (_FS(TIMER1_PRESCALER, 0)                  |
+           _FS(TIMER1_CLKSOURCE, TIMER1_CORE_CLK)    |
+           _BV(TIMER1_ENABLE));
+
+  ADCCON |= _BV(ADC_ENABLE_CONVERION);
+  /* start timing at a conversion boundary */
+  while (!ADCSTA) {
+  }
+  (void) ADCDAT;
+  const uint32_t start = T1VAL;
+  for (uint32_t i=0; i<(1UL<<BURST_CALIBRATION_SHIFT); i++) {
+    while (!ADCSTA) {
+    }
+    (void) ADCDAT;
+  }
+  const uint32_t stop = T1VAL;
+
+  ADCCON &= ~_BV(ADC_ENABLE_CONVERION);
+  T1CON = 0;
+  adc_power_up();
+
+  return (start - stop) >> BURST_CALIBRATION_SHIFT;
+}
+
+
+/** The duration is calculated with a shift instead of a division */
+#if (F_XTAL != 32768)
+  #error Timebase: F_XTAL must be 32768 Hz
+#endif
+
+/** log2 of the timebase clock */
+#define TIMEBASE_SHIFT 15
+
+
+/** Timer2 overflows, i.e. the upper 32 bits of the timebase (ISR
+ *  write access only) */
+static volatile uint32_t timebase_high;
+
+/** Timebase at the start of the measurement */
+static uint64_t timebase_start;
+
+/** Timebase at the end of the measurement */
+static uint64_t timebase_stop_ticks;
+
+/** The measurement has ended, timebase_stop_ticks is valid */
+static uint8_t timebase_stopped;
+
+
+/** Start Timer2 as free running 32 bit up counter from the crystal */
+void __init timebase_init(void)
+{
+  T2CON = 0;
+  T2LD = 0;
+  T2CON = (_FS(TIMER2_PRESCALER, 0)                 |
+           _FS(TIMER2_CLKSOURCE, TIMER2_EXT_XTAL)   |
+           _BV(TIMER2_COUNT_DIR)                    |
+           _BV(TIMER2_ENABLE) );
+  /* Enable interrupt flag for Timer2 overflow */
+  IRQEN |= _BV(INT_WAKEUP_TIMER2);
+}
+module_init(timebase_init, 5);
+
+
+/** Timer2 overflow interrupt: extend the timebase to 64 bit */
+void ISR_WAKEUP_TIMER2(void)
+{
+  timebase_high++;
+  /* clear timer2 interrupt flag at eoi */
+  T2CLRI = 0x00;
+}
+
+
+/** Read the 64 bit timebase
+ *
+ * Rereads if the overflow ISR has run in between. If Timer2 has
+ * overflowed and the ISR is still pending (e.g. interrupts are
+ * disabled after the measurement), the overflow is accounted for
+ * here.
+ */
+static
+uint64_t timebase_now(void)
+{
+  uint32_t high, low, pending;
+  do {
+    high = timebase_high;
+    low = T2VAL;
+    pending = bit_is_set(IRQSTA, INT_WAKEUP_TIMER2);
+  } while (high != timebase_high);
+  if (pending && !(low & 0x80000000UL)) {
+    high++;
+  }
+  return (((uint64_t)high) << 32) | low;
+}
+
+
+/* documented in timer1-adc-trigger.h */
+void timebase_stop(void)
+{
+  if (!timebase_stopped) {
+    timebase_stop_ticks = timebase_now();
+    timebase_stopped = 1;
+  }
+}
+
+
+/* documented in timebase.h */
+uint64_t get_elapsed_ticks(void)
+{
+  const uint64_t now = (timebase_stopped) ? timebase_stop_ticks : timebase_now();
+  return now - timebase_start;
+}
+
+
+/* documented in timebase.h */
+uint64_t get_timebase_ticks(void)
+{
+  return timebase_now();
+}
+
+
+/* documented in timebase.h */
+uint64_t get_timebase_start(void)
+{
+  return timebase_start;
+}
+
+
+/* documented in timebase.h */
+uint32_t get_timebase_clock(void)
+{
+  return (uint32_t)F_XTAL;
+}
+
+
+/** Get measurement duration in 1/units_per_second units */
+uint32_t get_duration(void)
+{
+  return (get_elapsed_ticks() * personality_info.units_per_second)
+    >> TIMEBASE_SHIFT;
 }
 
 
@@ -177,6 +433,25 @@ void adc_init(void)
 }
 
 
+/** Default: Personalities without a software trigger ignore the
+ *  trigger parameters */
+void personality_trigger_setup(const packet_trigger_param_t *param)
+  __attribute__((weak));
+void personality_trigger_setup(const packet_trigger_param_t *UP(param))
+{
+}
+
+
+/** Default: Personalities counting every conversion (e.g. for the
+ *  measurement duration) skip samples in software */
+uint8_t personality_decimate_in_timer1(void)
+  __attribute__((weak));
+uint8_t personality_decimate_in_timer1(void)
+{
+  return 0;
+}
+
+
 /** \bug Handle two uint16_t values from parameters: measurement
  *       duration and skip_samples.
  */
@@ -192,7 +467,7 @@ void personality_start_measurement_sram(void)
 
     /** Safeguard: We cannot handle 0 or 1 count measurements.
      *
-     * Enable this if you do something with get_duration() above.
+     * Enable this if the timer count ever ends the measurement.
      *
     if (orig_timer1_count <= 1) {
       send_text_P(PSTR("Unsupported timer value <= 1"));
@@ -208,6 +483,59 @@ void personality_start_measurement_sram(void)
     const uint16_t *skip_samples_p = skip_samples_vp;
     orig_skip_samples = *skip_samples_p;
     skip_samples = *skip_samples_p;
+    ofs += 2;
+  }
+
+  if (personality_info.param_data_size_trigger == sizeof(packet_trigger_param_t)) {
+    const void *trigger_vp = &pparam_sram.params[ofs];
+    personality_trigger_setup(trigger_vp);
+    ofs += sizeof(packet_trigger_param_t);
+  }
+
+  uint32_t period = TIMER1_DEFAULT_PERIOD;
+  adc_burst = 0;
+  if (personality_info.param_data_size_sample_period == 4) {
+    /* not aligned, read byte by byte */
+    const uint8_t *p = &pparam_sram.params[ofs];
+    const uint32_t param = (((uint32_t)p[0]) <<  0) | (((uint32_t)p[1]) <<  8) |
+                           (((uint32_t)p[2]) << 16) | (((uint32_t)p[3]) << 24);
+    if ((param == SAMPLE_PERIOD_BURST) && personality_info.burst_sample_period) {
+      adc_burst = 1;
+    } else if (param != 0) {
+      /* 0 selects the default period */
+      period = (param < TIMER1_MIN_PERIOD) ? TIMER1_MIN_PERIOD : param;
+    }
+    ofs += 4;
+  }
+
+  if (personality_info.param_data_size_roi == sizeof(packet_roi_param_t)) {
+    personality_roi_setup(&pparam_sram.params[ofs]);
+    ofs += sizeof(packet_roi_param_t);
+  }
+
+  if (personality_info.param_data_size_resolution ==
+      sizeof(packet_resolution_param_t)) {
+    personality_resolution_setup(pparam_sram.params[ofs]);
+    ofs += sizeof(packet_resolution_param_t);
+  }
+
+  uint32_t decimation = 1;
+  if (personality_decimate_in_timer1()) {
+    /* Let Timer1 only trigger the conversions we keep instead of
+     * interrupting for every conversion just to throw it away. */
+    decimation = ((uint32_t)orig_skip_samples) + 1;
+    orig_skip_samples = 0;
+    skip_samples = 0;
+  }
+  timer1_set_period(period, decimation);
+
+  timebase_start = timebase_now();
+  timebase_stopped = 0;
+
+  if (adc_burst) {
+    /* the personality runs the conversions from its poll function */
+    adc_init_burst();
+    return;
   }
 
   adc_init();
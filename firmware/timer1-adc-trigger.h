@@ -29,11 +29,58 @@
 
 #include <stdint.h>
 
+#include "packet-defs.h"
+
 extern volatile uint16_t timer1_count;
 extern volatile uint16_t orig_timer1_count;
 extern volatile uint16_t skip_samples;
 extern volatile uint16_t orig_skip_samples;
 
+
+/** Burst mode has been selected for the running measurement
+ *
+ * The ADC is set up for software continuous conversion without
+ * interrupt, but conversions have not been started yet. Neither
+ * Timer1 nor skip_samples are used.
+ */
+extern uint8_t adc_burst;
+
+
+/** Measure the burst mode sample period
+ *
+ * Times a number of conversions in burst mode configuration with
+ * Timer1 and powers the ADC back up for normal use. Must be called
+ * at boot time (module_init), Timer1 is reconfigured afterwards.
+ *
+ * \return Sample period in burst mode [core clock ticks]
+ */
+uint32_t adc_burst_calibrate(void);
+
+
+/** Set up the software trigger from the measurement command
+ *
+ * Called before the ADC and Timer1 are started if the personality
+ * announces a trigger parameter.
+ */
+void personality_trigger_setup(const packet_trigger_param_t *param);
+
+
+/** Whether skip_samples is done by Timer1
+ *
+ * If the personality returns non-zero, Timer1 runs skip_samples+1
+ * times slower instead of the ISR dropping samples, and skip_samples
+ * is always 0 in the ISR.
+ */
+uint8_t personality_decimate_in_timer1(void);
+
+/** Freeze the timebase at the end of the measurement
+ *
+ * To be called from on_measurement_finished(), so that the final
+ * and resent value tables report the measurement time instead of
+ * the time since the start.
+ */
+void timebase_stop(void);
+
 #endif /* !TIMER1_ADC_TRIGGER_H */
 
 
@@ -29,15 +29,19 @@
 
 #include "timer1-measurement.h"
 #include "main.h"
+#include "deferred-work.h"
 #include "aduc.h"
 
-#define TOG_LED_TIME_BASE (GP4DAT ^= _BV(GP_DATA_OUTPUT_Px1))
 
 volatile uint16_t timer1_count;
 
 volatile uint16_t orig_timer1_count;
 
 
+/** The measurement has ended, Timer2 only keeps the timebase running */
+static uint8_t countdown_stopped;
+
+
 /** 32 Bit timer ISR
  *
  * When timer has elapsed, the global #timer1_flag (8bit, therefore
@@ -50,9 +54,11 @@ volatile uint16_t orig_timer1_count;
  */
 void ISR_WAKEUP_TIMER2(void)
 {
-  TOG_LED_TIME_BASE;
+  deferred_work_post(DEFERRED_WORK_LED_TIME_BASE);
+
+  timer2_periods++;
 
-  if (!measurement_finished) {
+  if (!measurement_finished && !countdown_stopped) {
     /** We do not touch #measurement_finished ever again after setting
      * it. */
     timer1_count--;
@@ -66,8 +72,14 @@ void ISR_WAKEUP_TIMER2(void)
 }
 
 
+/** Stop the countdown
+ *
+ * Timer2 stays enabled after the measurement, see main.c. Without
+ * this, #timer1_count would wrap and finish the measurement again.
+ */
 void on_measurement_finished(void)
 {
+  countdown_stopped = 1;
   timer1_init_quick();
 }
 
@@ -36,7 +36,7 @@
  * of registers. Therefore loading timer_count with LDRH Rd, [Rb, #6bit_offset]
  * is an atomic instruction and not interrupted by ISR_WAKEUP_TIMER2.
  */
-uint16_t get_duration(void)
+uint32_t get_duration(void)
 {
   return (orig_timer1_count - timer1_count);
 }
@@ -32,7 +32,7 @@
 
 
 /** \todo document this */
-uint16_t get_duration(void);
+uint32_t get_duration(void);
 
 
 #endif /* TIMER1_GET_DURATION_H */
@@ -24,6 +24,11 @@
  *
  * Timer init to simply periodically trigger timer ISR.
  *
+ * The Timer2 periods counted by the ISR together with the Timer2
+ * counter value also serve as the \ref timebase of the measurement.
+ * The timebase starts with the measurement and stops when the
+ * measurement has finished, as the ISR does not run anymore then.
+ *
  * @{
  */
 
@@ -36,6 +41,25 @@
 #include "packet-comm.h"
 
 #include "set_timer.h"
+#include "timebase.h"
+
+
+/** Timebase clock: Timer2 ticks per second */
+#define TIMEBASE_CLOCK \
+  ((uint32_t)(((TIMER2_LOAD_VALUE_DOWNCNT) * 1000000ULL) / (TIMER2_INTERVAL)))
+
+
+/* documented in timer1-measurement.h */
+volatile uint32_t timer2_periods;
+
+/** Timer2 has been started by timer1_init() */
+static uint8_t timebase_running;
+
+/** The measurement has ended, timebase_stop_ticks is valid */
+static uint8_t timebase_stopped;
+
+/** Timebase at the end of the measurement */
+static uint64_t timebase_stop_ticks;
 
 
 /** Set up our IO pins */
@@ -79,14 +103,75 @@ void timer1_init(const uint16_t timer1_value)
 
   /* Timer compare match value */
   T2LD = TIMER2_LOAD_VALUE_DOWNCNT;
+  timer2_periods = 0;
   T2CON |= _BV(TIMER2_ENABLE);
+  timebase_running = 1;
   /* Enable interrupt flag for Timer2 */
   IRQEN |= _BV(INT_WAKEUP_TIMER2);
 }
 
 
+/** Read the timebase from the period count and Timer2
+ *
+ * Rereads if the ISR has run in between. A reload the ISR has not
+ * handled yet (interrupts disabled) is accounted for here.
+ */
+static
+uint64_t timebase_now(void)
+{
+  uint32_t periods, value, pending;
+  do {
+    periods = timer2_periods;
+    value = T2VAL;
+    pending = bit_is_set(IRQSTA, INT_WAKEUP_TIMER2);
+  } while (periods != timer2_periods);
+  if (pending && (value > (uint32_t)(TIMER2_LOAD_VALUE_DOWNCNT / 2))) {
+    periods++;
+  }
+  /* Timer2 counts down from T2LD */
+  return ((uint64_t)periods) * (uint32_t)TIMER2_LOAD_VALUE_DOWNCNT +
+    ((uint32_t)TIMER2_LOAD_VALUE_DOWNCNT - value);
+}
+
+
+/* documented in timebase.h */
+uint64_t get_timebase_ticks(void)
+{
+  if (timebase_stopped) {
+    return timebase_stop_ticks;
+  }
+  return (timebase_running) ? timebase_now() : 0;
+}
+
+
+/* documented in timebase.h */
+uint64_t get_timebase_start(void)
+{
+  return 0;
+}
+
+
+/* documented in timebase.h */
+uint64_t get_elapsed_ticks(void)
+{
+  return get_timebase_ticks();
+}
+
+
+/* documented in timebase.h */
+uint32_t get_timebase_clock(void)
+{
+  return (timebase_running) ? TIMEBASE_CLOCK : 0;
+}
+
+
+/** Called at the end of the measurement: Freezes the timebase */
 void timer1_init_quick(void)
 {
+  if (timebase_running && !timebase_stopped) {
+    timebase_stop_ticks = timebase_now();
+    timebase_stopped = 1;
+  }
  /* on ADuC7026 it is not possible to toggle an LED without having the IRQ flag enabled */
 }
 
@@ -51,11 +51,22 @@ extern volatile uint16_t timer1_count;
 extern volatile uint16_t orig_timer1_count;
 
 
+/** Number of Timer2 periods since the start of the measurement
+ *
+ * To be incremented by the personality's ISR_WAKEUP_TIMER2() for
+ * the timebase (ISR write access only).
+ */
+extern volatile uint32_t timer2_periods;
+
+
 /** Initialize the 16bit timer */
 void timer1_init(const uint16_t timer1_value);
 
 
-/** Make timer run more quickly */
+/** Make timer run more quickly
+ *
+ * Called at the end of the measurement. Also stops the timebase.
+ */
 void timer1_init_quick(void);
 
 
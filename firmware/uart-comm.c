@@ -25,6 +25,11 @@
  * Implements the byte stream part of the communication protocol
  * (Layer 1).
  *
+ * The UART has no receive FIFO. Received bytes are put into a ring
+ * buffer by ISR_UART(), so that command frames the host sends while
+ * the main loop is busy sending a value table are not lost. The main
+ * loop is the only reader.
+ *
  * @{
  */
 
@@ -44,6 +49,22 @@ static checksum_accu_t cs_accu_send;
 static checksum_accu_t cs_accu_recv;
 
 
+/** Receive buffer size in bytes, a power of 2
+ *
+ * Holds a few command frames with sequence IDs.
+ */
+#define UART_RECV_BUFFER_SIZE 64
+
+/** Receive buffer */
+static volatile uint8_t recv_buffer[UART_RECV_BUFFER_SIZE];
+
+/** Next byte to write into #recv_buffer (written by ISR only) */
+static volatile uint8_t recv_head;
+
+/** Next byte to read from #recv_buffer (written by main loop only) */
+static volatile uint8_t recv_tail;
+
+
 /** UART initialisation to 8 databits no parity
  *
  */
@@ -79,6 +100,9 @@ void __init uart_init(void)
   /* 2.) reset access to COMRX/COMTX receive and transmit
    *     registers by default (memory share with COMDIVn) */
   COMCON0 &= ~_BV(UART_DLAB);
+  /* 3.) interrupt on received data */
+  COMIEN0 = _BV(UART_ERBFI);
+  IRQEN |= _BV(INT_UART);
 
   cs_accu_send = checksum_reset();
   cs_accu_recv = checksum_reset();
@@ -128,16 +152,44 @@ void uart_putb(const void *buf, size_t len)
 }
 
 
-/** Read a character from the UART */
+/** Read a character from the receive buffer */
 char uart_getc()
 {
-    /* Poll til bit is set and char is in input buffer */
-    loop_until_bit_is_set( COMSTA0, UART_DR );
+  /* wait until ISR_UART() has put a byte into the buffer */
+  const uint8_t tail = recv_tail;
+  while (recv_head == tail) {
+  }
+  const char ch = recv_buffer[tail];
+  recv_tail = (tail + 1) & (UART_RECV_BUFFER_SIZE - 1);
+  return ch;
+}
 
-    /* Get the character and clear the bit */
-    const char ch = COMRX;
 
-    return ch;
+char uart_recv_pending(void)
+{
+  return (recv_head != recv_tail);
+}
+
+
+/** UART interrupt: Put the received byte into the receive buffer
+ *
+ * Reading COMRX clears the interrupt. If the buffer is full, the
+ * byte is dropped. The frame it belongs to then fails the checksum
+ * and the host sends the command again.
+ *
+ * The UART stays enabled in all FSM states (see \ref firmware_fsm).
+ * It only fires while the host sends a command, and the ISR is kept
+ * short so that it hardly delays the measurement ISRs.
+ */
+void ISR_UART(void)
+{
+  const uint8_t byte = COMRX;
+  const uint8_t head = recv_head;
+  const uint8_t next = (head + 1) & (UART_RECV_BUFFER_SIZE - 1);
+  if (next != recv_tail) {
+    recv_buffer[head] = byte;
+    recv_head = next;
+  }
 }
 
 
@@ -41,6 +41,9 @@ void uart_recv_checksum_reset(void);
 void uart_recv_checksum_update(const char ch);
 char uart_recv_checksum_matches(const uint8_t data);
 
+/** Whether there are received bytes to read with uart_getc() */
+char uart_recv_pending(void);
+
 /** @} */
 
 #endif /* !UART_COMM_H */
@@ -0,0 +1,166 @@
+/** \file hostware/clock-sync.c
+ * \brief Map device timebase to host time
+ *
+ * \author Copyright (C) 2012 samplemaker
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ *
+ * \defgroup freemcan_clock_sync Device Clock Correlation
+ * \ingroup hostware_generic
+ *
+ * The hostware asks the device for its timebase
+ * (#FRAME_CMD_TIME_SYNC) every now and then and fits the host time
+ * against the device time. This corrects timestamps derived from the
+ * device time for the offset between the clocks as well as for the
+ * drift of the device oscillator.
+ *
+ * The device reads its timebase when the request has arrived, so the
+ * host time of a point is taken as the middle of the round trip. The
+ * error of this is at most half the round trip. Round trips which
+ * took much longer than the shortest one seen (e.g. because the host
+ * was busy) are dropped.
+ *
+ * @{
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include "clock-sync.h"
+
+
+/** Drop points with a round trip longer than the shortest one plus
+ *  this [s] */
+#define CLOCK_SYNC_MAX_EXTRA_DELAY 0.010
+
+
+void clock_sync_reset(clock_sync_t *self)
+{
+  memset(self, 0, sizeof(*self));
+  self->slope = 1.0;
+}
+
+
+/** Update the fit from the regression sums */
+static
+void clock_sync_fit(clock_sync_t *self)
+{
+  const double n = self->points;
+  const double denom = n * self->sxx - self->sx * self->sx;
+  if ((self->points < 2) || (denom <= 0.0)) {
+    /* offset only */
+    self->slope = 1.0;
+  } else {
+    self->slope = (n * self->sxy - self->sx * self->sy) / denom;
+  }
+  self->offset = (self->sy - self->slope * self->sx) / n;
+}
+
+
+bool clock_sync_add(clock_sync_t *self,
+                    const uint64_t ticks, const uint64_t start_ticks,
+                    const uint32_t timebase_clock,
+                    const double host_send, const double host_recv)
+{
+  if (!timebase_clock) {
+    return false;
+  }
+  if ((timebase_clock != self->timebase_clock) || (ticks < self->last_ticks)) {
+    /* different personality or device has been reset */
+    clock_sync_reset(self);
+    self->timebase_clock = timebase_clock;
+  } else if (self->points && (ticks == self->last_ticks)) {
+    /* timebase stopped after the measurement */
+    return false;
+  }
+  self->start_ticks = start_ticks;
+
+  const double round_trip = host_recv - host_send;
+  if (!self->points || (round_trip < self->min_round_trip)) {
+    self->min_round_trip = round_trip;
+  }
+  if (round_trip > self->min_round_trip + CLOCK_SYNC_MAX_EXTRA_DELAY) {
+    self->dropped++;
+    return false;
+  }
+
+  const double host_time = host_send + round_trip / 2;
+  if (!self->points) {
+    self->first_ticks = ticks;
+    self->first_host_time = host_time;
+  }
+  self->last_ticks = ticks;
+
+  const double x = ((double)(ticks - self->first_ticks)) / timebase_clock;
+  const double y = host_time - self->first_host_time;
+  self->points++;
+  self->sx += x;
+  self->sy += y;
+  self->sxx += x * x;
+  self->sxy += x * y;
+  clock_sync_fit(self);
+  return true;
+}
+
+
+bool clock_sync_valid(const clock_sync_t *self)
+{
+  return (self->points > 0);
+}
+
+
+double clock_sync_host_time(const clock_sync_t *self, const uint64_t ticks)
+{
+  /* ticks may be before the first point */
+  const double x =
+    (((double)ticks) - ((double)self->first_ticks)) / self->timebase_clock;
+  return self->first_host_time + self->offset + self->slope * x;
+}
+
+
+double clock_sync_measurement_time(const clock_sync_t *self,
+                                   const double elapsed)
+{
+  const double x =
+    (((double)self->start_ticks) - ((double)self->first_ticks)) /
+    self->timebase_clock + elapsed;
+  return self->first_host_time + self->offset + self->slope * x;
+}
+
+
+double clock_sync_skew_ppm(const clock_sync_t *self)
+{
+  return (self->slope - 1.0) * 1e6;
+}
+
+
+double clock_sync_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/** @} */
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,133 @@
+/** \file hostware/clock-sync.h
+ * \brief Map device timebase to host time (interface)
+ *
+ * \author Copyright (C) 2012 samplemaker
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ *
+ * \addtogroup freemcan_clock_sync
+ * @{
+ */
+
+#ifndef FREEMCAN_CLOCK_SYNC_H
+#define FREEMCAN_CLOCK_SYNC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/** Clock correlation state
+ *
+ * Every time sync exchange yields one point (device time, host
+ * time). The host time of a point is the middle of the round trip.
+ * host time = offset + slope * device time is fitted by linear
+ * regression over all points, relative to the first point to keep
+ * the sums precise.
+ */
+typedef struct {
+  /** Frequency of the device timebase clock in Hz, 0 if unknown */
+  uint32_t timebase_clock;
+  /** Device timebase at the start of the measurement */
+  uint64_t start_ticks;
+  /** Device timebase of the last point */
+  uint64_t last_ticks;
+  /** Device timebase of the first point */
+  uint64_t first_ticks;
+  /** Host time of the first point [s since the epoch] */
+  double first_host_time;
+  /** Shortest round trip seen [s] */
+  double min_round_trip;
+  /** Number of points in the fit */
+  size_t points;
+  /** Number of points dropped for a slow round trip */
+  size_t dropped;
+  /** Regression sums over device time x and host time y, relative to
+   *  the first point [s] */
+  double sx, sy, sxx, sxy;
+  /** Fit result: host time offset to the first point [s] */
+  double offset;
+  /** Fit result: host seconds per device second */
+  double slope;
+} clock_sync_t;
+
+
+/** Forget all points */
+void clock_sync_reset(clock_sync_t *self)
+  __attribute__((nonnull(1)));
+
+
+/** Add the result of a time sync exchange
+ *
+ * The fit starts over if the timebase clock changes or the device
+ * timebase goes backwards (device reset). Replies without a timebase
+ * or with a stopped timebase are ignored, as are replies with a
+ * round trip much longer than the shortest one seen.
+ *
+ * \param ticks Device timebase ticks from the reply
+ * \param start_ticks Device timebase at the start of the measurement
+ * \param timebase_clock Device timebase clock frequency in Hz
+ * \param host_send Host time the request has been sent at
+ * \param host_recv Host time the reply has been received at
+ * \return Whether the point has been used
+ */
+bool clock_sync_add(clock_sync_t *self,
+                    const uint64_t ticks, const uint64_t start_ticks,
+                    const uint32_t timebase_clock,
+                    const double host_send, const double host_recv)
+  __attribute__((nonnull(1)));
+
+
+/** Whether there is a mapping from device time to host time */
+bool clock_sync_valid(const clock_sync_t *self)
+  __attribute__((nonnull(1)));
+
+
+/** Host time [s since the epoch] of a device timebase value */
+double clock_sync_host_time(const clock_sync_t *self, const uint64_t ticks)
+  __attribute__((nonnull(1)));
+
+
+/** Host time [s since the epoch] of a point in time in the
+ *  measurement, given in device seconds since the start */
+double clock_sync_measurement_time(const clock_sync_t *self,
+                                   const double elapsed)
+  __attribute__((nonnull(1)));
+
+
+/** Device clock deviation from the host clock [ppm]
+ *
+ * Positive if the device clock runs slow.
+ */
+double clock_sync_skew_ppm(const clock_sync_t *self)
+  __attribute__((nonnull(1)));
+
+
+/** Current host time [s since the epoch] */
+double clock_sync_now(void);
+
+
+/** @} */
+
+#endif /* !FREEMCAN_CLOCK_SYNC_H */
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,224 @@
+/** \file hostware/command-tracker.c
+ * \brief Commands in flight, matched to replies by sequence ID
+ *
+ * \author Copyright (C) 2012 samplemaker
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ *
+ * \defgroup freemcan_command_tracker Command Pipelining
+ * \ingroup hostware_generic
+ *
+ * Sends commands with a sequence ID (see \ref frame_seq) and keeps
+ * track of them until the frame completing the reply has arrived, so
+ * several commands can be in flight at the same time.
+ *
+ * Every command has a timeout. Queries which do not change the device
+ * state are sent again with the same sequence ID when their timeout
+ * has passed, all others are given up on right away. A late reply to
+ * the first attempt then completes the command, and the reply to the
+ * second attempt is ignored.
+ *
+ * @{
+ */
+
+#include <string.h>
+
+#include "command-tracker.h"
+#include "freemcan-log.h"
+
+
+/** Time to wait for the reply to a command [s] */
+#define COMMAND_TIMEOUT 2.0
+
+
+/** Time to wait for the reply to a command sending a value table [s] */
+#define COMMAND_TABLE_TIMEOUT 10.0
+
+
+/** The frame type completing the reply to a command */
+static
+frame_type_t command_reply_type(const frame_cmd_t cmd)
+{
+  switch (cmd) {
+  case FRAME_CMD_TIME_SYNC:    return FRAME_TYPE_TIME_SYNC;
+  case FRAME_CMD_ISR_PROFILE:  return FRAME_TYPE_ISR_PROFILE;
+  case FRAME_CMD_ROI_SUMMARY:  return FRAME_TYPE_ROI_SUMMARY;
+  case FRAME_CMD_STATUS:       return FRAME_TYPE_STATUS;
+  default:                     return FRAME_TYPE_STATE;
+  }
+}
+
+
+/** Time to wait for the reply to a command [s] */
+static
+double command_timeout(const frame_cmd_t cmd)
+{
+  switch (cmd) {
+  case FRAME_CMD_INTERMEDIATE:
+  case FRAME_CMD_ABORT:
+  case FRAME_CMD_TABLE_FROM_FLASH:
+  case FRAME_CMD_TABLE_RANGE:
+    return COMMAND_TABLE_TIMEOUT;
+  default:
+    return COMMAND_TIMEOUT;
+  }
+}
+
+
+/** Whether a command may be sent again
+ *
+ * Polled commands are not, the next poll is as good. Neither is the
+ * time sync request, whose reply is matched to the send time.
+ */
+static
+bool command_retry_ok(const frame_cmd_t cmd)
+{
+  switch (cmd) {
+  case FRAME_CMD_PERSONALITY_INFO:
+  case FRAME_CMD_PARAMS_FROM_EEPROM:
+  case FRAME_CMD_STATE:
+  case FRAME_CMD_ISR_PROFILE:
+  case FRAME_CMD_SUBSCRIBE:
+  case FRAME_CMD_RESEND_CHUNKS:
+  case FRAME_CMD_TABLE_RANGE:
+    return true;
+  default:
+    return false;
+  }
+}
+
+
+void command_tracker_init(command_tracker_t *self,
+                          command_tracker_send_t send, void *data,
+                          const unsigned int max_retries)
+{
+  memset(self, 0, sizeof(*self));
+  self->send = send;
+  self->data = data;
+  self->max_retries = max_retries;
+}
+
+
+/** Find the slot of a command in flight, or a free slot (seq 0) */
+static
+command_tracker_slot_t *command_tracker_find(command_tracker_t *self,
+                                             const uint8_t seq)
+{
+  for (size_t i = 0; i < COMMAND_TRACKER_SLOTS; i++) {
+    if (self->slots[i].seq == seq) {
+      return &self->slots[i];
+    }
+  }
+  return NULL;
+}
+
+
+uint8_t command_tracker_send(command_tracker_t *self, const double now,
+                             const frame_cmd_t cmd,
+                             const void *params, const size_t params_size)
+{
+  self->sent++;
+  command_tracker_slot_t *slot = command_tracker_find(self, 0);
+  if (!slot || (params_size > sizeof(slot->params))) {
+    self->untracked++;
+    self->send(cmd, 0, params, params_size, self->data);
+    return 0;
+  }
+
+  /* next sequence ID not in flight, 0 is skipped */
+  uint8_t seq = self->last_seq;
+  do {
+    seq = (seq == 0xff) ? 1 : (seq + 1);
+  } while (command_tracker_find(self, seq));
+  self->last_seq = seq;
+
+  slot->seq = seq;
+  slot->cmd = cmd;
+  slot->reply_type = command_reply_type(cmd);
+  slot->sent = now;
+  slot->timeout = command_timeout(cmd);
+  slot->retries = 0;
+  slot->params_size = params_size;
+  if (params_size) {
+    memcpy(slot->params, params, params_size);
+  }
+  self->send(cmd, seq, params, params_size, self->data);
+  return seq;
+}
+
+
+bool command_tracker_reply(command_tracker_t *self, const double now,
+                           const uint8_t seq, const frame_type_t type)
+{
+  command_tracker_slot_t *slot = command_tracker_find(self, seq);
+  if (!seq || !slot || (type != slot->reply_type)) {
+    return false;
+  }
+  self->answered++;
+  self->unanswered = 0;
+  self->round_trip = now - slot->sent;
+  slot->seq = 0;
+  return true;
+}
+
+
+void command_tracker_poll(command_tracker_t *self, const double now)
+{
+  for (size_t i = 0; i < COMMAND_TRACKER_SLOTS; i++) {
+    command_tracker_slot_t *slot = &self->slots[i];
+    if (!slot->seq || (now - slot->sent < slot->timeout)) {
+      continue;
+    }
+    if (command_retry_ok(slot->cmd) && (slot->retries < self->max_retries)) {
+      slot->retries++;
+      slot->sent = now;
+      self->retried++;
+      fmlog("|No reply to '%c' command (seq %u), sending again",
+            slot->cmd, slot->seq);
+      self->send(slot->cmd, slot->seq, slot->params, slot->params_size,
+                 self->data);
+    } else {
+      fmlog("|No reply to '%c' command (seq %u), giving up",
+            slot->cmd, slot->seq);
+      self->failed++;
+      self->unanswered++;
+      slot->seq = 0;
+    }
+  }
+}
+
+
+size_t command_tracker_outstanding(const command_tracker_t *self)
+{
+  size_t count = 0;
+  for (size_t i = 0; i < COMMAND_TRACKER_SLOTS; i++) {
+    if (self->slots[i].seq) {
+      count++;
+    }
+  }
+  return count;
+}
+
+
+/** @} */
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
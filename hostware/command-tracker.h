@@ -0,0 +1,158 @@
+/** \file hostware/command-tracker.h
+ * \brief Commands in flight, matched to replies by sequence ID (interface)
+ *
+ * \author Copyright (C) 2012 samplemaker
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ *
+ * \addtogroup freemcan_command_tracker
+ * @{
+ */
+
+#ifndef FREEMCAN_COMMAND_TRACKER_H
+#define FREEMCAN_COMMAND_TRACKER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "frame-defs.h"
+#include "packet-defs.h"
+
+
+/** Maximum number of commands in flight */
+#define COMMAND_TRACKER_SLOTS 16
+
+
+/** Send a command frame with a sequence ID
+ *
+ * seq is 0 if the command is sent without a sequence ID, because too
+ * many commands are in flight already.
+ */
+typedef void (*command_tracker_send_t)(const frame_cmd_t cmd,
+                                       const uint8_t seq,
+                                       const void *params,
+                                       const size_t params_size,
+                                       void *data);
+
+
+/** A command in flight */
+typedef struct {
+  /** Sequence ID, 0 if the slot is free */
+  uint8_t seq;
+  /** The command */
+  frame_cmd_t cmd;
+  /** The frame type which completes the reply */
+  frame_type_t reply_type;
+  /** Host time the command has last been sent at [s] */
+  double sent;
+  /** Time to wait for the reply [s] */
+  double timeout;
+  /** Number of times the command has been sent again */
+  unsigned int retries;
+  /** Parameter size in bytes */
+  size_t params_size;
+  /** Parameters, for sending the command again */
+  uint8_t params[MAX_PARAM_LENGTH];
+} command_tracker_slot_t;
+
+
+/** Commands in flight and the accounting */
+typedef struct {
+  /** Sends the command frames */
+  command_tracker_send_t send;
+  /** Data for #send */
+  void *data;
+  /** Number of times a command is sent again before giving up */
+  unsigned int max_retries;
+  /** Last sequence ID used */
+  uint8_t last_seq;
+  /** Commands in flight */
+  command_tracker_slot_t slots[COMMAND_TRACKER_SLOTS];
+  /** Number of commands sent (not counting the retries) */
+  unsigned long sent;
+  /** Number of commands answered */
+  unsigned long answered;
+  /** Number of times a command has been sent again */
+  unsigned long retried;
+  /** Number of commands given up on */
+  unsigned long failed;
+  /** Number of commands sent without a sequence ID */
+  unsigned long untracked;
+  /** Number of commands given up on since the last answer */
+  unsigned int unanswered;
+  /** Round trip of the last answered command [s] */
+  double round_trip;
+} command_tracker_t;
+
+
+/** Initialize the command tracker
+ *
+ * \param send Function sending the command frames
+ * \param data Data for send
+ * \param max_retries Number of times a command is sent again
+ */
+void command_tracker_init(command_tracker_t *self,
+                          command_tracker_send_t send, void *data,
+                          const unsigned int max_retries)
+  __attribute__((nonnull(1,2)));
+
+
+/** Send a command and keep track of it until the reply arrives
+ *
+ * \param now Current host time [s]
+ * \param params Parameters (may be NULL if params_size is 0)
+ * \return The sequence ID, 0 if the command is not tracked
+ */
+uint8_t command_tracker_send(command_tracker_t *self, const double now,
+                             const frame_cmd_t cmd,
+                             const void *params, const size_t params_size)
+  __attribute__((nonnull(1)));
+
+
+/** A frame with a sequence ID has arrived
+ *
+ * Replies with an unknown sequence ID (e.g. to a command which has
+ * been sent again) are ignored.
+ *
+ * \return Whether the frame completes the reply to a command
+ */
+bool command_tracker_reply(command_tracker_t *self, const double now,
+                           const uint8_t seq, const frame_type_t type)
+  __attribute__((nonnull(1)));
+
+
+/** Send commands again whose reply is overdue, or give up on them */
+void command_tracker_poll(command_tracker_t *self, const double now)
+  __attribute__((nonnull(1)));
+
+
+/** Number of commands in flight */
+size_t command_tracker_outstanding(const command_tracker_t *self)
+  __attribute__((nonnull(1)));
+
+
+/** @} */
+
+#endif /* !FREEMCAN_COMMAND_TRACKER_H */
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -60,6 +60,10 @@ static inline uint32_t htole32(const uint32_t value)
 {
   return value;
 }
+static inline uint64_t letoh64(const uint64_t value)
+{
+  return value;
+}
 #endif
 
 #ifdef ENDIANNESS_IS_BE
@@ -68,6 +68,8 @@ typedef enum {
   STATE_SIZE,
   /** waiting for frame type byte (1 byte only, no offset required) */
   STATE_FRAME_TYPE,
+  /** waiting for sequence ID byte (1 byte only, no offset required) */
+  STATE_SEQ,
   /** waiting for payload bytes (together with offset) */
   STATE_PAYLOAD,
   /** waiting for checksum byte (1 byte only, no offset required) */
@@ -92,6 +94,9 @@ struct _frame_parser_t {
   /** The frame type for frame in progress */
   uint8_t frame_type;
 
+  /** The sequence ID for frame in progress, 0 if none */
+  uint8_t frame_seq;
+
   /** The frame checksum for frame in progress */
   uint8_t frame_checksum;
 
@@ -154,6 +159,22 @@ void frame_parser_unref(frame_parser_t *self)
 bool enable_layer2_dump = false;
 
 
+/** Allocate the frame and start receiving the payload */
+static
+void start_payload(frame_parser_t *self)
+{
+  self->offset = 0;
+  /* Total size composed from:
+   *  - size fixed parts of frame_t data structure
+   *  - dynamic payload size
+   *  - terminating convenience nul byte
+   */
+  self->frame_wip = frame_new(self->frame_size+1);
+  assert(self->frame_wip);
+  self->state = STATE_PAYLOAD;
+}
+
+
 /** Step the parser FSM */
 static
 void step_fsm(frame_parser_t *self, const char ch)
@@ -204,16 +225,18 @@ void step_fsm(frame_parser_t *self, const char ch)
     break;
   case STATE_FRAME_TYPE:
     checksum_update(self->checksum_input, u);
-    self->frame_type = u;
-    self->offset = 0;
-    /* Total size composed from:
-     *  - size fixed parts of frame_t data structure
-     *  - dynamic payload size
-     *  - terminating convenience nul byte
-     */
-    self->frame_wip = frame_new(self->frame_size+1);
-    assert(self->frame_wip);
-    self->state = STATE_PAYLOAD;
+    self->frame_type = u & ~FRAME_TYPE_SEQ_FLAG;
+    self->frame_seq = 0;
+    if (u & FRAME_TYPE_SEQ_FLAG) {
+      self->state = STATE_SEQ;
+      return;
+    }
+    start_payload(self);
+    return;
+  case STATE_SEQ:
+    checksum_update(self->checksum_input, u);
+    self->frame_seq = u;
+    start_payload(self);
     return;
   case STATE_PAYLOAD:
     checksum_update(self->checksum_input, u);
@@ -234,16 +257,18 @@ void step_fsm(frame_parser_t *self, const char ch)
         /* nul-terminate the payload buffer for convenience */
         self->frame_wip->payload[self->offset] = '\0';
         self->frame_wip->type = self->frame_type;
+        self->frame_wip->seq = self->frame_seq;
         self->frame_wip->size = self->frame_size;
         if (enable_layer2_dump) {
           const frame_type_t type = self->frame_wip->type;
           const uint16_t size     = self->frame_wip->size;
+          const uint8_t seq       = self->frame_wip->seq;
           if ((32<=type) && (type<127)) {
-            fmlog("<Received type '%c'=0x%02x=%d frame with payload of size 0x%04x=%d",
-                  type, type, type, size, size);
+            fmlog("<Received type '%c'=0x%02x=%d frame (seq %u) with payload of size 0x%04x=%d",
+                  type, type, type, seq, size, size);
           } else {
-            fmlog("<Received type 0x%02x=%d frame with payload of size 0x%04x=%d",
-                  type, type, size, size);
+            fmlog("<Received type 0x%02x=%d frame (seq %u) with payload of size 0x%04x=%d",
+                  type, type, seq, size, size);
           }
           fmlog_data("<<", self->frame_wip->payload, size);
         }
@@ -256,6 +281,10 @@ void step_fsm(frame_parser_t *self, const char ch)
       return;
     } else {
       self->checksum_errors++;
+      fmlog_error("<Dropping type 0x%02x frame of size %d with checksum error "
+                  "(%u checksum errors so far)",
+                  self->frame_type, self->frame_size, self->checksum_errors);
+      frame_unref(self->frame_wip);
       self->offset = 0;
       self->state = STATE_MAGIC;
       return;
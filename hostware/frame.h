@@ -42,6 +42,8 @@ typedef struct {
   int refs;
   /** Frame type */
   frame_type_t type;
+  /** Sequence ID of the command this frame replies to, 0 if none */
+  uint8_t seq;
   /** Payload size in bytes */
   uint16_t size;
   /** Payload */
@@ -274,6 +274,43 @@ void device_send_command_with_params(device_t *self, const frame_cmd_t cmd,
 }
 
 
+void device_send_command_seq(device_t *self, const frame_cmd_t cmd,
+                             const uint8_t seq,
+                             const void *params, const size_t param_size)
+{
+  const int fd = self->fd;
+  if (fd > 0) {
+    fmlog(">Sending '%c' command to device (seq %u)", cmd, seq);
+    if (param_size) {
+      fmlog_data(">>", params, param_size);
+    }
+  } else {
+    fmlog("|Not sending '%c' command to closed device (seq %u)", cmd, seq);
+    return;
+  }
+
+  checksum_t *cs = checksum_new();
+  uint8_t cmd8 = cmd | FRAME_CMD_SEQ_FLAG;
+  uint8_t seq8 = seq;
+  uint8_t len8 = param_size;
+  struct iovec out[6] = {
+    { FRAME_MAGIC_STR, 4 },
+    { &cmd8, 1 },
+    { &seq8, 1 },
+    { &len8, 1 },
+    { (void *)params, param_size }
+  };
+  for (int i=0; i<5; i++) {
+    checksum_update_iovec(cs, &out[i]);
+  }
+  uint8_t checksum = checksum_get(cs);
+  checksum_unref(cs);
+  out[5].iov_base = (void *)&checksum;
+  out[5].iov_len = sizeof(checksum);
+  my_writev(fd, out, 6);
+}
+
+
 /* documented in freemcan-device.h */
 void device_do_io(device_t *self)
 {
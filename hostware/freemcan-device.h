@@ -91,6 +91,24 @@ void device_send_command_with_params(device_t *self, const frame_cmd_t cmd,
   __attribute__(( nonnull(1,3) ));
 
 
+/** Write a command with a sequence ID to the device.
+ *
+ * All frames the device sends in reply carry the same sequence ID
+ * (see \ref frame_seq).
+ *
+ * \param self The device object
+ * \param cmd The #frame_cmd_t to send.
+ * \param seq The sequence ID (1 to 255).
+ * \param params Pointer to the memory area containing the parameters
+ *               (may be NULL if there are none).
+ * \param param_size Size of the memory area containing the parameters.
+ */
+void device_send_command_seq(device_t *self, const frame_cmd_t cmd,
+                             const uint8_t seq,
+                             const void *params, const size_t param_size)
+  __attribute__(( nonnull(1) ));
+
+
 /** Do the actual IO
  *
  * Can be called from either the select(2) or poll(2) based main loop
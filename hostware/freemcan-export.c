@@ -29,13 +29,36 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <math.h>
+#include <string.h>
 #include <time.h>
 
+#include "compiler.h"
+#include "endian-conversion.h"
 #include "freemcan-export.h"
 #include "freemcan-log.h"
+#include "list-mode.h"
+#include "sample-stream.h"
+
+
+/** Clock correlation for exported timestamps, may be NULL */
+static const clock_sync_t *export_clock_sync = NULL;
 
 
 /* documented in freemcan-export.h */
+void export_set_clock_sync(const clock_sync_t *clock_sync)
+{
+  export_clock_sync = clock_sync;
+}
+
+
+/** Whether timestamps can be mapped with export_clock_sync */
+static
+bool export_clock_sync_valid(void)
+{
+  return export_clock_sync && clock_sync_valid(export_clock_sync);
+}
+
+
 char *export_value_table_get_filename(const packet_value_table_t *value_table_packet,
                                       const char *extension)
 {
@@ -57,6 +80,9 @@ char *export_value_table_get_filename(const packet_value_table_t *value_table_pa
   case VALUE_TABLE_TYPE_HISTOGRAM:   prefix = "hist"; break;
   case VALUE_TABLE_TYPE_TIME_SERIES: prefix = "time"; break;
   case VALUE_TABLE_TYPE_SAMPLES:     prefix = "samp"; break;
+  case VALUE_TABLE_TYPE_LIST_MODE:   prefix = "list"; break;
+  case VALUE_TABLE_TYPE_SAMPLE_BLOCK: prefix = "strm"; break;
+  case VALUE_TABLE_TYPE_TRIGGER_WINDOW: prefix = "trig"; break;
   }
 
   char date[128];
@@ -67,6 +93,49 @@ char *export_value_table_get_filename(const packet_value_table_t *value_table_pa
 }
 
 
+/** Start time of the measurement a value table belongs to
+ *
+ * This is the token sent with the measure command, or the receive
+ * time for value tables without a token.
+ */
+static
+time_t export_start_time(const packet_value_table_t *value_table_packet)
+{
+  time_t start_time = value_table_packet->receive_time;
+  if (value_table_packet->token_size == sizeof(start_time)) {
+    memcpy(&start_time, value_table_packet->token, sizeof(start_time));
+  }
+  return start_time;
+}
+
+
+/** Open the capture file of the measurement a value table belongs to
+ *
+ * A capture file collects the value tables of one measurement, so it
+ * is named after the start time of the measurement (see
+ * export_start_time()) and opened for appending. The file is empty
+ * if it has just been created.
+ *
+ * \param fname Buffer for the file name
+ */
+static
+FILE *export_capture_file_open(const packet_value_table_t *value_table_packet,
+                               const char *prefix, const char *extension,
+                               char *fname, const size_t fname_size)
+{
+  const time_t start_time = export_start_time(value_table_packet);
+  const struct tm *tm_ = localtime(&start_time);
+  assert(tm_);
+  char date[128];
+  strftime(date, sizeof(date), "%Y-%m-%d.%H:%M:%S", tm_);
+  snprintf(fname, fname_size, "%s.%s.%s", prefix, date, extension);
+
+  FILE *file = fopen(fname, "ab");
+  assert(file);
+  return file;
+}
+
+
 const char *time_rfc_3339(const time_t time)
 {
   const struct tm *tm_ = localtime(&time);
@@ -113,6 +182,12 @@ void export_common_vtable(FILE *datfile,
       type_str = "time series"; break;
     case VALUE_TABLE_TYPE_SAMPLES:
       type_str = "samples"; break;
+    case VALUE_TABLE_TYPE_LIST_MODE:
+      type_str = "list mode"; break;
+    case VALUE_TABLE_TYPE_SAMPLE_BLOCK:
+      type_str = "sample block"; break;
+    case VALUE_TABLE_TYPE_TRIGGER_WINDOW:
+      type_str = "trigger window"; break;
     }
     fprintf(datfile, "# value table type:         '%c' (%s)\n",
             value_table_packet->type, type_str);
@@ -142,6 +217,23 @@ void export_common_vtable(FILE *datfile,
 
     fprintf(datfile, "# orig_element_size:        %zd bit\n",
             value_table_packet->orig_bits_per_value);
+
+    if (value_table_packet->timebase_clock) {
+      fprintf(datfile, "# timebase clock:           %u Hz\n",
+              value_table_packet->timebase_clock);
+      fprintf(datfile, "# elapsed time:             %.6f sec\n",
+              packet_value_table_elapsed_time(value_table_packet));
+    }
+
+    if (export_clock_sync_valid()) {
+      const double sync_start =
+        clock_sync_measurement_time(export_clock_sync, 0.0);
+      fprintf(datfile, "# start_time (device clock):%.3f (%s)\n",
+              sync_start, time_rfc_3339((time_t)sync_start));
+      fprintf(datfile, "# device clock skew:        %.3f ppm (%zu sync points)\n",
+              clock_sync_skew_ppm(export_clock_sync),
+              export_clock_sync->points);
+    }
   }
 }
 
@@ -160,13 +252,34 @@ void export_histogram_vtable(FILE *datfile, const packet_value_table_t *value_ta
       }
     fprintf(datfile, "# element_count:            %zd\n",
             element_count);
-    fprintf(datfile, "# time elapsed since start: %d\n",
+    fprintf(datfile, "# time elapsed since start: %u\n",
             value_table_packet->duration);
     fprintf(datfile, "# total_duration:           %d\n",
             value_table_packet->total_duration);
-    fprintf(datfile, "channel\tcount\n");
-    for (size_t i=0; i<element_count; i++) {
-      fprintf(datfile, "%zd\t%u\n", i, value_table_packet->elements[i]);
+
+    /* live time in seconds, exact if the device has a timebase */
+    const double live_time =
+      packet_value_table_elapsed_time(value_table_packet) -
+      value_table_packet->dead_time / 1000.0;
+    fprintf(datfile, "# dead time:                %.3f sec\n",
+            value_table_packet->dead_time / 1000.0);
+    fprintf(datfile, "# live time:                %.3f sec\n",
+            live_time);
+    fprintf(datfile, "# triggers while busy:      %u\n",
+            value_table_packet->busy_triggers);
+
+    if (live_time > 0.0) {
+      /* dead time corrected count rate */
+      fprintf(datfile, "channel\tcount\trate\n");
+      for (size_t i=0; i<element_count; i++) {
+        const uint32_t v = value_table_packet->elements[i];
+        fprintf(datfile, "%zd\t%u\t%g\n", i, v, v/live_time);
+      }
+    } else {
+      fprintf(datfile, "channel\tcount\n");
+      for (size_t i=0; i<element_count; i++) {
+        fprintf(datfile, "%zd\t%u\n", i, value_table_packet->elements[i]);
+      }
     }
   }
 }
@@ -334,8 +447,16 @@ void export_time_series_vtable(FILE *datfile,
     fprintf(datfile, "%s\t%s\t%s\t%s\n", "idx", "counts", "time_t", "strftime");
     const time_t start_time = (value_table_packet->token)?
       *((const time_t *)value_table_packet->token) : 0 ;
+    /* total_duration in device seconds */
+    const double device_tdur = (personality_info->units_per_second) ?
+      ((double)tdur) / personality_info->units_per_second : tdur;
+    const bool synced = export_clock_sync_valid();
     for (size_t i=0; i<element_count; i++) {
-      const time_t ts = start_time + i * tdur;
+      /* correct for device clock offset and drift if possible */
+      const time_t ts = (synced) ?
+        (time_t)(clock_sync_measurement_time(export_clock_sync,
+                                             i * device_tdur) + 0.5) :
+        (time_t)(start_time + i * tdur);
       const char *st = time_rfc_3339(ts);
       fprintf(datfile, "%zu\t%u\t%ld\t%s\n", i, value_table_packet->elements[i], ts, st);
     }
@@ -343,8 +464,40 @@ void export_time_series_vtable(FILE *datfile,
 }
 
 
+/** Time between two samples of a value table in seconds
+ *
+ * Calculated from the sample period parameter if there is one, taking
+ * burst mode and skip_samples into account. Otherwise estimated from
+ * the device timebase, which works for tables filled at a constant
+ * rate since the start of the measurement. 0 if unknown.
+ */
+static
+double export_sample_interval(const personality_info_t *personality_info,
+                              const packet_value_table_t *value_table_packet)
+{
+  if (value_table_packet->sample_period &&
+      personality_info && personality_info->sample_clock) {
+    if ((value_table_packet->sample_period == SAMPLE_PERIOD_BURST) &&
+        personality_info->burst_sample_period) {
+      return ((double)personality_info->burst_sample_period) /
+        personality_info->sample_clock;
+    }
+    const unsigned int skip = (value_table_packet->skip_samples == (unsigned int)-1) ?
+      0 : value_table_packet->skip_samples;
+    return ((double)value_table_packet->sample_period) * (skip + 1) /
+      personality_info->sample_clock;
+  }
+  if (value_table_packet->timebase_clock && value_table_packet->element_count) {
+    return packet_value_table_elapsed_time(value_table_packet) /
+      value_table_packet->element_count;
+  }
+  return 0.0;
+}
+
+
 static
 void export_samples_vtable(FILE *datfile,
+                           const personality_info_t *personality_info,
                            const packet_value_table_t *value_table_packet)
 {
   uint32_t max_value = 0;
@@ -362,9 +515,219 @@ void export_samples_vtable(FILE *datfile,
   if (datfile) {
     fprintf(datfile, "# minimum value:            %u\n", min_value);
     fprintf(datfile, "# maximum value:            %u\n", max_value);
-    for (size_t i=0; i<element_count; i++) {
-      /** \todo Write timestamps */
-      fprintf(datfile, "%zu\t%u\n", i, value_table_packet->elements[i]);
+    const double interval =
+      export_sample_interval(personality_info, value_table_packet);
+    if (interval > 0.0) {
+      /* time of each sample relative to the first one */
+      fprintf(datfile, "# sample interval:          %g sec\n", interval);
+      fprintf(datfile, "idx\tvalue\ttime\n");
+      for (size_t i=0; i<element_count; i++) {
+        fprintf(datfile, "%zu\t%u\t%.9f\n",
+                i, value_table_packet->elements[i], i * interval);
+      }
+    } else {
+      for (size_t i=0; i<element_count; i++) {
+        fprintf(datfile, "%zu\t%u\n", i, value_table_packet->elements[i]);
+      }
+    }
+  }
+}
+
+
+/** Decoder for the list mode measurement in progress */
+static list_mode_decoder_t list_mode_decoder;
+
+
+/** Histogram of all list mode events of the measurement in progress */
+static uint32_t list_mode_histogram[1<<LIST_MODE_VALUE_BITS];
+
+
+static
+void list_mode_histogram_inc(const uint64_t UP(ticks), const uint32_t value,
+                             void *UP(data))
+{
+  list_mode_histogram[value]++;
+}
+
+
+/** Append list mode records to the capture file of the measurement
+ *
+ * The capture file is named after the start time of the measurement
+ * so all chunks of one measurement end up in the same file, which can
+ * be replayed later.
+ */
+static
+void export_list_mode_capture(const packet_value_table_t *value_table_packet)
+{
+  char fname[256];
+  FILE *capfile = export_capture_file_open(value_table_packet, "list", "lmd",
+                                           fname, sizeof(fname));
+  if (ftell(capfile) == 0) {
+    const uint32_t tps = htole32(value_table_packet->ticks_per_second);
+    fwrite(LIST_MODE_FILE_MAGIC, 4, 1, capfile);
+    fwrite(&tps, sizeof(tps), 1, capfile);
+    fmlog("Writing list mode records to file %s", fname);
+  }
+  for (size_t i=0; i<value_table_packet->element_count; i++) {
+    const uint32_t record = htole32(value_table_packet->elements[i]);
+    fwrite(&record, sizeof(record), 1, capfile);
+  }
+  fclose(capfile);
+}
+
+
+static
+void export_list_mode_vtable(FILE *datfile,
+                             const packet_value_table_t *value_table_packet)
+{
+  if (packet_value_table_measurement_changed(&list_mode_decoder.measurement,
+                                             value_table_packet)) {
+    memset(list_mode_histogram, 0, sizeof(list_mode_histogram));
+  }
+  list_mode_decode_chunk(&list_mode_decoder, value_table_packet,
+                         list_mode_histogram_inc, NULL);
+  export_list_mode_capture(value_table_packet);
+
+  if (datfile) {
+    const list_mode_decoder_t *d = &list_mode_decoder;
+    fprintf(datfile, "# time elapsed since start: %d\n",
+            value_table_packet->duration);
+    fprintf(datfile, "# total_duration:           %d\n",
+            value_table_packet->total_duration);
+    fprintf(datfile, "# timestamp clock:          %u Hz\n",
+            d->ticks_per_second);
+    fprintf(datfile, "# time of last event:       %.6f sec\n",
+            (d->ticks_per_second)?((double)d->ticks/d->ticks_per_second):0.0);
+    fprintf(datfile, "# events:                   %llu\n",
+            (unsigned long long)d->events);
+    fprintf(datfile, "# events lost on device:    %u\n",
+            d->lost_events);
+    fprintf(datfile, "# chunks missed:            %u\n",
+            d->missed_chunks);
+    fprintf(datfile, "channel\tcount\n");
+    for (size_t i=0; i<(1<<LIST_MODE_VALUE_BITS); i++) {
+      fprintf(datfile, "%zd\t%u\n", i, list_mode_histogram[i]);
+    }
+  }
+}
+
+
+/** Reassembly state of the sample stream in progress */
+static sample_stream_t sample_stream;
+
+
+/** Append a sample block to the stream file of the measurement
+ *
+ * Like the list mode capture file, the stream file is named after the
+ * start time of the measurement and collects all blocks of one
+ * measurement. Missing samples are marked with a comment line, the
+ * index column counts them nevertheless.
+ */
+static
+void export_sample_block_vtable(FILE *datfile,
+                                const packet_value_table_t *value_table_packet)
+{
+  uint64_t missing;
+  const uint64_t first =
+    sample_stream_add_block(&sample_stream, value_table_packet, &missing);
+
+  char fname[256];
+  FILE *strmfile = export_capture_file_open(value_table_packet, "stream", "dat",
+                                            fname, sizeof(fname));
+  if (ftell(strmfile) == 0) {
+    const time_t start_time = export_start_time(value_table_packet);
+    fprintf(strmfile, "# sample stream started:    %lu (%s)\n",
+            start_time, time_rfc_3339(start_time));
+    fprintf(strmfile, "# skip_samples:             %d\n",
+            value_table_packet->skip_samples);
+    fprintf(strmfile, "%s\t%s\n", "idx", "value");
+    fmlog("Writing sample stream to file %s", fname);
+  }
+  if (missing) {
+    fprintf(strmfile, "# %llu samples missing%s\n",
+            (unsigned long long)missing,
+            (value_table_packet->flags & SAMPLE_BLOCK_FLAG_OVERRUN) ?
+            " (device overrun)" : "");
+  }
+  for (size_t i=0; i<value_table_packet->element_count; i++) {
+    fprintf(strmfile, "%llu\t%u\n", (unsigned long long)(first + i),
+            value_table_packet->elements[i]);
+  }
+  fclose(strmfile);
+
+  if (datfile) {
+    const sample_stream_t *s = &sample_stream;
+    fprintf(datfile, "# stream file:              %s\n", fname);
+    fprintf(datfile, "# samples received:         %llu\n",
+            (unsigned long long)s->samples);
+    fprintf(datfile, "# samples missing:          %llu\n",
+            (unsigned long long)s->missing_samples);
+    fprintf(datfile, "# device overruns:          %u\n",
+            s->overruns);
+    fprintf(datfile, "# blocks missed:            %u\n",
+            s->missed_blocks);
+  }
+}
+
+
+/** Number of trigger windows received with the current window file */
+static unsigned int trigger_windows;
+
+
+/** Append a trigger window to the window file of the measurement
+ *
+ * All windows of one measurement go to the same file, one gnuplot
+ * data block (separated by two empty lines) per window. The sample
+ * offset column is relative to the trigger sample, so windows can be
+ * overlayed with "plot ... index N".
+ */
+static
+void export_trigger_window_vtable(FILE *datfile,
+                                  const packet_value_table_t *value_table_packet)
+{
+  if (value_table_packet->element_count == 0) {
+    /* no trigger since the last window */
+    return;
+  }
+
+  char fname[256];
+  FILE *trigfile = export_capture_file_open(value_table_packet, "trig", "dat",
+                                            fname, sizeof(fname));
+  if (ftell(trigfile) == 0) {
+    const time_t start_time = export_start_time(value_table_packet);
+    trigger_windows = 0;
+    fprintf(trigfile, "# trigger windows started:  %lu (%s)\n",
+            start_time, time_rfc_3339(start_time));
+    fprintf(trigfile, "# skip_samples:             %d\n",
+            value_table_packet->skip_samples);
+    fmlog("Writing trigger windows to file %s", fname);
+  } else {
+    fprintf(trigfile, "\n\n");
+  }
+  fprintf(trigfile, "# window %u, seq %u, trigger at sample %llu\n",
+          trigger_windows, value_table_packet->seq,
+          (unsigned long long)(value_table_packet->first_sample +
+                               value_table_packet->pre_samples));
+  fprintf(trigfile, "%s\t%s\t%s\n", "ofs", "value", "idx");
+  for (size_t i=0; i<value_table_packet->element_count; i++) {
+    fprintf(trigfile, "%ld\t%u\t%llu\n",
+            (long)i - (long)value_table_packet->pre_samples,
+            value_table_packet->elements[i],
+            (unsigned long long)(value_table_packet->first_sample + i));
+  }
+  fclose(trigfile);
+  trigger_windows++;
+
+  if (datfile) {
+    fprintf(datfile, "# window file:              %s\n", fname);
+    fprintf(datfile, "# windows received:         %u\n", trigger_windows);
+    fprintf(datfile, "# pre-trigger samples:      %u\n",
+            value_table_packet->pre_samples);
+    fprintf(datfile, "%s\t%s\n", "ofs", "value");
+    for (size_t i=0; i<value_table_packet->element_count; i++) {
+      fprintf(datfile, "%ld\t%u\n",
+              (long)i - (long)value_table_packet->pre_samples,
+              value_table_packet->elements[i]);
     }
   }
 }
@@ -373,6 +736,46 @@ void export_samples_vtable(FILE *datfile,
 bool write_next_intermediate_packet = false;
 
 
+static
+void export_value_table_to(FILE *datfile,
+                           const personality_info_t *personality_info,
+                           const packet_value_table_t *value_table_packet)
+{
+  export_common_vtable(datfile, value_table_packet);
+  if (datfile && value_table_packet->sample_period &&
+      personality_info && personality_info->sample_clock) {
+    const bool burst =
+      (value_table_packet->sample_period == SAMPLE_PERIOD_BURST) &&
+      personality_info->burst_sample_period;
+    const uint32_t period = (burst) ?
+      personality_info->burst_sample_period : value_table_packet->sample_period;
+    fprintf(datfile, "# sample period:            %u clock ticks (%g s)%s\n",
+            period, ((double)period) / personality_info->sample_clock,
+            (burst) ? " burst mode" : "");
+  }
+  switch (value_table_packet->type) {
+  case VALUE_TABLE_TYPE_HISTOGRAM: /* histogram data */
+    export_histogram_vtable(datfile, value_table_packet);
+    break;
+  case VALUE_TABLE_TYPE_TIME_SERIES: /* series of counter data */
+    export_time_series_vtable(datfile, personality_info, value_table_packet);
+    break;
+  case VALUE_TABLE_TYPE_SAMPLES: /* data table of samples */
+    export_samples_vtable(datfile, personality_info, value_table_packet);
+    break;
+  case VALUE_TABLE_TYPE_LIST_MODE: /* chunk of list mode records */
+    export_list_mode_vtable(datfile, value_table_packet);
+    break;
+  case VALUE_TABLE_TYPE_SAMPLE_BLOCK: /* block of a sample stream */
+    export_sample_block_vtable(datfile, value_table_packet);
+    break;
+  case VALUE_TABLE_TYPE_TRIGGER_WINDOW: /* window around a trigger */
+    export_trigger_window_vtable(datfile, value_table_packet);
+    break;
+  }
+}
+
+
 /* documented in freemcan-export.h */
 void export_value_table(const personality_info_t *personality_info,
                         const packet_value_table_t *value_table_packet)
@@ -387,18 +790,7 @@ void export_value_table(const personality_info_t *personality_info,
     fmlog("Writing value table to file %s", fname);
   }
 
-  export_common_vtable(datfile, value_table_packet);
-  switch (value_table_packet->type) {
-  case VALUE_TABLE_TYPE_HISTOGRAM: /* histogram data */
-    export_histogram_vtable(datfile, value_table_packet);
-    break;
-  case VALUE_TABLE_TYPE_TIME_SERIES: /* series of counter data */
-    export_time_series_vtable(datfile, personality_info, value_table_packet);
-    break;
-  case VALUE_TABLE_TYPE_SAMPLES: /* data table of samples */
-    export_samples_vtable(datfile, value_table_packet);
-    break;
-  }
+  export_value_table_to(datfile, personality_info, value_table_packet);
 
   if (datfile) {
     fclose(datfile);
@@ -406,6 +798,19 @@ void export_value_table(const personality_info_t *personality_info,
 }
 
 
+/* documented in freemcan-export.h */
+void export_value_table_file(const personality_info_t *personality_info,
+                             const packet_value_table_t *value_table_packet,
+                             const char *fname)
+{
+  FILE *datfile = fopen(fname, "w");
+  assert(datfile);
+  fmlog("Writing value table to file %s", fname);
+  export_value_table_to(datfile, personality_info, value_table_packet);
+  fclose(datfile);
+}
+
+
 /** @} */
 
 
@@ -28,6 +28,7 @@
 
 #include <stdbool.h>
 
+#include "clock-sync.h"
 #include "freemcan-packet.h"
 
 
@@ -63,6 +64,28 @@ void export_value_table(const personality_info_t *personality_info,
                         const packet_value_table_t *value_table_packet);
 
 
+/** \brief Write the given value table to the given file
+ * \ingroup freemcan_export
+ *
+ * Like export_value_table(), but for tools which create many value
+ * tables at once and need to choose the file names themselves.
+ * personality_info may be NULL for histograms.
+ */
+void export_value_table_file(const personality_info_t *personality_info,
+                             const packet_value_table_t *value_table_packet,
+                             const char *fname);
+
+
+/** \brief Use the given clock correlation for exported timestamps
+ * \ingroup freemcan_export
+ *
+ * Timestamps derived from the device time are mapped to host time
+ * with clock_sync as long as it is valid. NULL (the default) keeps
+ * the host receive and start times.
+ */
+void export_set_clock_sync(const clock_sync_t *clock_sync);
+
+
 /** Compute default file name for exporting given value packet packet data to.
  *
  * \return The return value points to a global static buffer.
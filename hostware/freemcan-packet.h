@@ -27,6 +27,7 @@
 
 #include <time.h>
 
+#include "frame-defs.h"
 #include "packet-defs.h"
 
 #include "packet-value-table.h"
@@ -60,6 +61,65 @@ typedef void (*packet_handler_params_from_eeprom_t)(const void *params,
 typedef void (*packet_handler_personality_info_t)(personality_info_t *pi,
                                                   void *data);
 
+
+/** Callback function type called when time sync packet arrives
+ *
+ * The values are in host endianness.
+ */
+typedef void (*packet_handler_time_sync_t)(const uint64_t ticks,
+                                           const uint64_t start_ticks,
+                                           const uint32_t timebase_clock,
+                                           void *data);
+
+
+/** Callback function type called when ISR profile packet arrives
+ *
+ * The values are in host endianness. timer_clock is 0 if the firmware
+ * has been built without the ISR profiler.
+ */
+typedef void (*packet_handler_isr_profile_t)(const uint32_t timer_clock,
+                                             const size_t source_count,
+                                             const packet_isr_profile_source_t *sources,
+                                             void *data);
+
+
+/** Callback function type called when ROI summary packet arrives
+ *
+ * The values are in host endianness. summary->rois is 0 if the
+ * personality has no region of interest counters.
+ */
+typedef void (*packet_handler_roi_summary_t)(const packet_roi_summary_t *summary,
+                                             void *data);
+
+
+/** Callback function type called when status packet arrives
+ *
+ * The values are in host endianness.
+ */
+typedef void (*packet_handler_status_t)(const packet_status_t *status,
+                                        void *data);
+
+
+/** Callback function type called when a frame with a sequence ID
+ *  arrives, before the handler for its packet type
+ *
+ * \param seq Sequence ID of the command the frame replies to
+ * \param type Frame type (without #FRAME_TYPE_SEQ_FLAG)
+ */
+typedef void (*packet_handler_reply_t)(const uint8_t seq,
+                                       const frame_type_t type,
+                                       void *data);
+
+
+/** Callback function type called to ask for missing chunks of a
+ *  chunked value table
+ *
+ * \param param #FRAME_CMD_RESEND_CHUNKS parameter (device byte order)
+ * \return Sequence ID the command has been sent with, 0 if none
+ */
+typedef uint8_t (*packet_handler_resend_chunks_t)(const packet_resend_chunks_param_t *param,
+                                                  void *data);
+
 /** @} */
 
 #endif /* !FREEMCAN_PACKET_H */
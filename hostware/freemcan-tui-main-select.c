@@ -35,6 +35,8 @@
 
 #include "compiler.h"
 
+#include "clock-sync.h"
+
 #include "freemcan-device.h"
 #include "freemcan-log.h"
 #include "freemcan-signals.h"
@@ -120,64 +122,34 @@ void device_select_do_io(fd_set *in_fdset)
 }
 
 
-extern int waiting_for;
-
-
-void tui_device_send_simple_command(const frame_cmd_t cmd)
+/** Send a command frame for #tui_commands */
+static
+void tui_device_send_seq(const frame_cmd_t cmd, const uint8_t seq,
+                         const void *params, const size_t params_size,
+                         void *UP(data))
 {
-  device_send_command(device, cmd);
-  waiting_for++;
+  if (seq) {
+    device_send_command_seq(device, cmd, seq, params, params_size);
+  } else if (params_size) {
+    device_send_command_with_params(device, cmd, (void *)params, params_size);
+  } else {
+    device_send_command(device, cmd);
+  }
 }
 
 
-/** Parameter layout with a single uint16_t param and time_t token */
-typedef struct {
-  /* to be read by firmware, needs endianness conversion */
-  uint16_t _a;
-
-  /* sent back as-is, not interpreted by firmware in any way */
-  time_t start_time;
-} PACKED measure_params_16_t;
-
-
-/** Parameter layout with two uint16_t params and time_t token */
-typedef struct {
-  /* to be read by firmware, needs endianness conversion */
-  uint16_t _a;
-  uint16_t _b;
-
-  /* sent back as-is, not interpreted by firmware in any way */
-  time_t start_time;
-} PACKED measure_params_16_16_t;
-
-
-void tui_device_send_command_16(const frame_cmd_t cmd,
-                                const time_t ts,
-                                const uint16_t a)
+void tui_device_send_simple_command(const frame_cmd_t cmd)
 {
-  measure_params_16_t params = {
-    htole16(a),
-    ts
-  };
-  device_send_command_with_params(device, cmd,
-                                  &params, sizeof(params));
-  waiting_for++;
+  command_tracker_send(&tui_commands, clock_sync_now(), cmd, NULL, 0);
 }
 
 
-void tui_device_send_command_16_16(const frame_cmd_t cmd,
-                                   const time_t ts,
-                                   const uint16_t a,
-                                   const uint16_t b)
+void tui_device_send_command_params(const frame_cmd_t cmd,
+                                    void *params,
+                                    const size_t params_size)
 {
-  measure_params_16_16_t params = {
-    htole16(a),
-    htole16(b),
-    ts
-  };
-  device_send_command_with_params(device, cmd,
-                                  &params, sizeof(params));
-  waiting_for++;
+  command_tracker_send(&tui_commands, clock_sync_now(),
+                       cmd, params, params_size);
 }
 
 
@@ -205,6 +177,8 @@ int main(int argc, char *argv[])
   device = device_new(fp);
   device_open(device, device_name);
   assert(device_get_fd(device) >= 0);
+  command_tracker_init(&tui_commands, tui_device_send_seq, NULL,
+                       COMMAND_MAX_RETRIES);
 
   /** startup messages */
   tui_startup_messages();
@@ -214,7 +188,7 @@ int main(int argc, char *argv[])
 
   /** main loop */
   while (1) {
-    struct timeval tv = { .tv_sec = periodic_update_interval, .tv_usec = 0 };
+    struct timeval tv = { .tv_sec = STATUS_POLL_INTERVAL, .tv_usec = 0 };
     fd_set in_fdset;
     FD_ZERO(&in_fdset);
 
@@ -224,7 +198,8 @@ int main(int argc, char *argv[])
     assert(max_fd >= 0);
 
     const int n = select(max_fd+1, &in_fdset, NULL, NULL,
-                         (periodic_update_flag)?(&tv):NULL);
+                         (periodic_update_flag || roi_monitor_flag ||
+                          command_tracker_outstanding(&tui_commands))?(&tv):NULL);
     if (n<0) { /* error */
       if (errno != EINTR) {
         fmlog_error("select(2)");
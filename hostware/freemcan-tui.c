@@ -58,6 +58,9 @@
 #include "frame-parser.h"
 #include "packet-parser.h"
 
+#include "clock-sync.h"
+#include "readout-scheduler.h"
+#include "command-tracker.h"
 #include "freemcan-device.h"
 #include "freemcan-packet.h"
 #include "freemcan-export.h"
@@ -77,6 +80,22 @@ static void packet_handler_personality_info(personality_info_t *pi,
 static void packet_handler_params_from_eeprom(const void *params,
                                               const size_t size,
                                               void *UP(data));
+static void packet_handler_time_sync(const uint64_t ticks,
+                                     const uint64_t start_ticks,
+                                     const uint32_t timebase_clock,
+                                     void *UP(data));
+static void packet_handler_isr_profile(const uint32_t timer_clock,
+                                       const size_t source_count,
+                                       const packet_isr_profile_source_t *sources,
+                                       void *UP(data));
+static void packet_handler_roi_summary(const packet_roi_summary_t *summary,
+                                       void *UP(data));
+static void packet_handler_status(const packet_status_t *status,
+                                  void *UP(data));
+static void packet_handler_reply(const uint8_t seq, const frame_type_t type,
+                                 void *UP(data));
+static uint8_t packet_handler_resend_chunks(const packet_resend_chunks_param_t *param,
+                                            void *UP(data));
 
 
 personality_info_t *personality_info = NULL;
@@ -84,7 +103,15 @@ personality_info_t *personality_info = NULL;
 
 
 bool is_measuring = false;
-int waiting_for = 0;
+
+
+/** Consider the device disconnected after giving up on this many
+ *  commands in a row */
+#define UNANSWERED_LIMIT 3
+
+
+/* documented in freemcan-tui.h */
+command_tracker_t tui_commands;
 
 
 /** Quit flag for the main loop. */
@@ -99,45 +126,116 @@ bool enable_user_input_dump = false;
 bool periodic_update_flag = false;
 
 
-/** Interval in seconds */
-unsigned long periodic_update_interval = 20;
+/** Fraction of the link throughput periodic updates may use */
+#define READOUT_BUDGET 0.5
+
+
+/** Target relative statistical error of the new counts in a periodic
+ *  update */
+#define READOUT_PRECISION 0.05
+
+
+/** Longest interval between periodic updates [s] */
+#define READOUT_MAX_INTERVAL 600.0
+
+
+/** The serial link (one device only in the TUI) */
+readout_link_t tui_readout_link;
+
+
+/** Schedules the periodic updates */
+readout_scheduler_t tui_readout;
+
+
+/** Status counters at the last periodic update, a full table is only
+ *  requested if they have changed */
+uint32_t periodic_update_total_counts = 0;
+uint16_t periodic_update_table_size = 0;
+
+
+/** Whether to log the next status reply (polled replies are not logged) */
+bool status_requested = false;
+
+
+/** Frame type the device pushes (#FRAME_CMD_SUBSCRIBE), 0 if none */
+uint8_t push_frame_type = 0;
+
+
+/** Push sequence number expected next, 0 if unknown */
+uint16_t push_seq_expected = 0;
+
+
+/** Number of pushed frames which have not arrived */
+unsigned long push_frames_lost = 0;
+
+
+/** Whether to request ROI summaries every #STATUS_POLL_INTERVAL */
+bool roi_monitor_flag = false;
+
+
+/** Bin with the most counts in the last status reply */
+uint16_t status_max_index = 0;
+
+
+/** Whether the last complete value table consisted of bins
+ *
+ * Only histograms and time series have bins which a range can be
+ * requested of (see tui_send_table_range()). Assumed until the first
+ * value table has been received.
+ */
+bool table_has_bins = true;
+
+
+/** Time series received so far, NULL if none
+ *
+ * Periodic updates only fetch its tail (#FRAME_CMD_TABLE_RANGE from
+ * the last element, which was still being recorded) and append it.
+ */
+packet_value_table_t *time_series = NULL;
+
+
+/** Device clock to host clock correlation */
+clock_sync_t tui_clock_sync;
+
+
+/** Host time the outstanding time sync request has been sent at, 0
+ *  if there is none */
+double time_sync_sent = 0.0;
+
+
+/** Give up waiting for a time sync reply after this many seconds */
+#define TIME_SYNC_TIMEOUT 5.0
 
 
 /** Size of last received packet */
 size_t last_received_size = 0;
 
 
-/** Last sent duration, used for calculating periodic update interval */
+/** Last sent duration */
 uint16_t last_sent_duration = 0;
 
 
-/** \bug Needs to work with personalities which only need skip_samples, but no duration! */
-static void recalculate_periodic_interval(void)
+void update_last_received_size(const uint16_t size)
 {
-  const unsigned long last_periodic_update_interval = periodic_update_interval;
-  if (last_sent_duration && personality_info) {
-    const float clock_period = 1.0f/((float)personality_info->units_per_second);
-    const float tmp = 1.5*sqrt(last_sent_duration*clock_period);
-    periodic_update_interval = tmp + ((last_received_size * 10UL) / 115200UL);
-    if (periodic_update_interval < 5) {
-      periodic_update_interval = 5;
-    }
-  } else {
-    periodic_update_interval = 20;
-  }
-  if (last_periodic_update_interval != periodic_update_interval) {
-    fmlog("Periodic update interval updated from %lu to %lu",
-          last_periodic_update_interval, periodic_update_interval);
-  }
+  last_received_size = size;
 }
 
 
-void update_last_received_size(const uint16_t size)
+/** Log the periodic update interval and what it is based on */
+static
+void fmlog_readout(void)
 {
-  if (size >= last_received_size) {
-    last_received_size = size;
+  const readout_scheduler_t *r = &tui_readout;
+  char rate[32];
+  if (r->count_rate >= 0.0) {
+    snprintf(rate, sizeof(rate), "%.1f/s", r->count_rate);
+  } else {
+    snprintf(rate, sizeof(rate), "unknown");
   }
-  recalculate_periodic_interval();
+  fmlog("periodic update interval %.1f s (count rate %s, "
+        "latency %.3f s, link %.0f bytes/s)",
+        readout_scheduler_interval(r), rate, r->latency,
+        tui_readout_link.throughput);
 }
 
 
@@ -193,6 +291,303 @@ void fmlog_skip_samples(void)
 }
 
 
+/** Sample period in seconds (in personalities with a sample period
+ *  parameter), 0 for the firmware default */
+static double sample_period = 0.0;
+
+
+/** Burst mode selected instead of sample_period */
+static bool sample_burst = false;
+
+
+/** Histogram resolution in bits (in personalities with a resolution
+ *  parameter), 0 for the firmware default */
+static unsigned int resolution = 0;
+
+
+/** Log current histogram resolution */
+static
+void fmlog_resolution(void)
+{
+  if (resolution) {
+    fmlog("resolution = %u bits (%u bins)", resolution, 1U << resolution);
+  } else {
+    fmlog("resolution = default");
+  }
+}
+
+
+/** Step the histogram resolution within the range the personality
+ *  announces, 0 (the default) being above the largest one */
+static
+void step_resolution(const bool finer)
+{
+  const personality_info_t *pi = personality_info;
+  if (!pi || !pi->param_data_size_resolution) {
+    fmlog("Personality has no resolution parameter");
+    return;
+  }
+  if (finer) {
+    if (resolution && (resolution < pi->max_resolution)) {
+      resolution++;
+    } else {
+      resolution = 0;
+    }
+  } else if (!resolution) {
+    resolution = pi->max_resolution;
+  } else if (resolution > pi->min_resolution) {
+    resolution--;
+  }
+}
+
+
+/** Log current sample period */
+static
+void fmlog_sample_period(void)
+{
+  if (sample_burst) {
+    fmlog("sample period = burst mode");
+  } else if (sample_period > 0.0) {
+    fmlog("sample period = %g s (%g Hz)", sample_period, 1.0/sample_period);
+  } else {
+    fmlog("sample period = firmware default");
+  }
+}
+
+
+/** Step sample period through a 1-2-5 sequence
+ *
+ * \param up Go to longer periods if true, shorter ones otherwise
+ */
+static
+void step_sample_period(const bool up)
+{
+  static const double steps[] = { 1.0, 2.0, 5.0 };
+  if (sample_period <= 0.0) {
+    /* the firmware default is 3ms */
+    sample_period = (up) ? 5e-3 : 2e-3;
+    return;
+  }
+  const double decade = pow(10.0, floor(log10(sample_period) + 1e-9));
+  size_t i = 0;
+  while ((i < 2) && (steps[i] * decade < sample_period * (1.0 - 1e-9))) {
+    i++;
+  }
+  if (up) {
+    sample_period = (i == 2) ? (10.0 * decade) : (steps[i+1] * decade);
+  } else {
+    sample_period = (i == 0) ? (0.5 * decade) : (steps[i-1] * decade);
+  }
+  if (sample_period < 1e-6) {
+    sample_period = 1e-6;
+  }
+}
+
+
+/** Sample period parameter [clock ticks] for the current personality */
+static
+uint32_t sample_period_ticks(const personality_info_t *pi)
+{
+  if (sample_burst && pi->burst_sample_period) {
+    return SAMPLE_PERIOD_BURST;
+  }
+  if ((sample_period <= 0.0) || (pi->sample_clock == 0)) {
+    return 0;
+  }
+  double ticks = floor(sample_period * pi->sample_clock + 0.5);
+  if (ticks < pi->min_sample_period) {
+    ticks = pi->min_sample_period;
+  } else if (ticks > pi->max_sample_period) {
+    ticks = pi->max_sample_period;
+  }
+  return ticks;
+}
+
+
+/** Trigger settings (in personalities with a level trigger)
+ *
+ * Fields are in host endianness. post_samples == 0 switches the
+ * trigger off.
+ */
+packet_trigger_param_t trigger_param = {
+  2048, 16, 64, 192, TRIGGER_FLAG_REARM
+};
+
+
+/** post_samples to restore when switching the trigger back on */
+static uint16_t trigger_post_samples = 192;
+
+
+/** Regions of interest (in personalities with ROI counters)
+ *
+ * Fields are in host endianness. Set from the FREEMCAN_ROIS
+ * environment variable, e.g. FREEMCAN_ROIS=600-640,1320-1360.
+ */
+packet_roi_param_t roi_param = {
+  { { 1, 0 }, { 1, 0 }, { 1, 0 }, { 1, 0 } }
+};
+
+
+/** Log current regions of interest */
+static
+void fmlog_rois(void)
+{
+  char buf[ROI_MAX * 16];
+  size_t ofs = 0;
+  buf[0] = '\0';
+  for (size_t r = 0; r < ROI_MAX; r++) {
+    if (roi_param.window[r].first <= roi_param.window[r].last) {
+      ofs += snprintf(&buf[ofs], sizeof(buf) - ofs, " %u:%u-%u", (unsigned)r,
+                      roi_param.window[r].first, roi_param.window[r].last);
+    }
+  }
+  fmlog("regions of interest:%s", (ofs) ? buf : " none");
+}
+
+
+/** Parse regions of interest "first-last,first-last,..." */
+static
+void parse_rois(const char *str)
+{
+  const char *p = str;
+  for (size_t r = 0; (r < ROI_MAX) && *p; r++) {
+    unsigned int first, last;
+    int n;
+    if ((sscanf(p, "%u-%u%n", &first, &last, &n) != 2) ||
+        (first > last) || (last > 0xffff)) {
+      fmlog("Ignoring invalid regions of interest \"%s\"", p);
+      return;
+    }
+    roi_param.window[r].first = first;
+    roi_param.window[r].last = last;
+    p += n;
+    if (*p == ',') {
+      p++;
+    }
+  }
+}
+
+
+/** Half the number of bins around the maximum zoomed in on by
+ *  default */
+#define ZOOM_HALF_WIDTH 32
+
+
+/** Request a range of bins of the value table
+ *
+ * The range is taken from the FREEMCAN_ZOOM environment variable,
+ * e.g. FREEMCAN_ZOOM=600-640 or FREEMCAN_ZOOM=0-4095/16 for every 16
+ * bins summed up. Without it, the bins around the maximum of the
+ * last status reply are requested.
+ */
+static
+void tui_send_table_range(void)
+{
+  unsigned int first, last, width = 1;
+  const char *zoom = getenv("FREEMCAN_ZOOM");
+  if (zoom) {
+    const int n = sscanf(zoom, "%u-%u/%u", &first, &last, &width);
+    if ((n < 2) || (first > last) || (last >= 0xffff) ||
+        (width == 0) || (width > 0xffff)) {
+      fmlog("Ignoring invalid zoom range \"%s\"", zoom);
+      return;
+    }
+  } else {
+    first = (status_max_index > ZOOM_HALF_WIDTH) ?
+      (status_max_index - ZOOM_HALF_WIDTH) : 0;
+    last = status_max_index + ZOOM_HALF_WIDTH - 1;
+  }
+  if (!table_has_bins) {
+    fmlog("The value table has no bins to zoom in on");
+    return;
+  }
+  if (personality_info) {
+    const size_t bins =
+      8*personality_info->sizeof_table / personality_info->bits_per_value;
+    if (first >= bins) {
+      fmlog("Ignoring zoom range %u-%u beyond the last bin %zu",
+            first, last, bins - 1);
+      return;
+    }
+    if (last >= bins) {
+      last = bins - 1;
+    }
+  }
+  fmlog("Requesting bins %u-%u, %u bins per element", first, last, width);
+  const packet_table_range_param_t param = {
+    htole16(first),
+    htole16(last + 1),
+    htole16(width)
+  };
+  tui_device_send_command_params(FRAME_CMD_TABLE_RANGE,
+                                 (void *)&param, sizeof(param));
+}
+
+
+/** Forget the time series received so far */
+static
+void time_series_drop(void)
+{
+  if (time_series) {
+    packet_value_table_unref(time_series);
+    time_series = NULL;
+  }
+}
+
+
+/** Check whether a tail belongs to the time series received so far
+ *
+ * After a new measurement has been started (e.g. with the switch),
+ * the tail belongs to another time series, and may well be empty
+ * because the new time series is shorter than the old one.
+ */
+static
+bool time_series_same_measurement(const packet_value_table_t *tail)
+{
+  packet_value_table_measurement_t measurement;
+  memset(&measurement, 0, sizeof(measurement));
+  packet_value_table_measurement_update(&measurement, time_series);
+  return !packet_value_table_measurement_changed(&measurement, tail);
+}
+
+
+/** Request a periodic update of the value table
+ *
+ * If there is a time series already, only its tail is requested.
+ */
+static
+void tui_request_readout(void)
+{
+  if (!time_series || !time_series->element_count) {
+    tui_device_send_simple_command(FRAME_CMD_INTERMEDIATE);
+    return;
+  }
+  const packet_table_range_param_t param = {
+    htole16(time_series->element_count - 1),
+    htole16(0xffff),
+    htole16(1)
+  };
+  tui_device_send_command_params(FRAME_CMD_TABLE_RANGE,
+                                 (void *)&param, sizeof(param));
+}
+
+
+/** Log current trigger settings */
+static
+void fmlog_trigger(void)
+{
+  if (trigger_param.post_samples) {
+    fmlog("trigger: level=%u hysteresis=%u pre=%u post=%u %s%s",
+          trigger_param.level, trigger_param.hysteresis,
+          trigger_param.pre_samples, trigger_param.post_samples,
+          (trigger_param.flags & TRIGGER_FLAG_FALLING)?"falling":"rising",
+          (trigger_param.flags & TRIGGER_FLAG_REARM)?" rearm":"");
+  } else {
+    fmlog("trigger: off");
+  }
+}
+
+
 /** @} */
 
 
@@ -342,9 +737,24 @@ void tui_fmlog_help(void)
           duration_list[duration_index]);
   }
   fmlog("    ./,         increase/decrease number of samples to skip (%u)", skip_samples);
+  fmlog("    d/D         decrease/increase sample perio(d) (%g s, 0 = default)",
+        sample_period);
+  fmlog("    b           toggle (b)urst mode sampling at the maximum ADC rate (%s)",
+        (sample_burst)?"on":"off");
+  fmlog("    v/V         decrease/increase histogram resolution (%u bits, 0 = default)",
+        resolution);
+  fmlog("    t           toggle level (t)rigger (%s)",
+        (trigger_param.post_samples)?"on":"off");
+  fmlog("    l/L         decrease/increase trigger (l)evel (%u)", trigger_param.level);
+  fmlog("    g           toggle trigger slope (%s)",
+        (trigger_param.flags & TRIGGER_FLAG_FALLING)?"falling":"rising");
+  fmlog("    n           toggle re-arming the trigger after each window (%s)",
+        (trigger_param.flags & TRIGGER_FLAG_REARM)?"on":"off");
   fmlog("    <space>     print current hostware parameters that would be sent");
   fmlog("                with 'e' or 'm'");
   fmlog("    p           toggle (p)eriodical requests of intermediate results");
+  fmlog("    O           toggle periodical requests of R(O)I summaries (%s)",
+        (roi_monitor_flag)?"on":"off");
   fmlog("  Send commands/requests:");
   fmlog("    a           send command \"(a)bort\"");
   fmlog("    e           write measurement parameters to (e)eprom");
@@ -354,6 +764,14 @@ void tui_fmlog_help(void)
   fmlog("    m           send command \"start (m)easurement\" with adequate parameters");
   fmlog("    r           send command \"(r)eset\"");
   fmlog("    w           send command \"intermediate result\" and (w)rite data to file");
+  fmlog("    y           request device timebase for clock s(y)nc (also periodically)");
+  fmlog("    P           request ISR (P)rofile (firmware built with BUILD_ISR_PROFILE=yes)");
+  fmlog("    u           request stat(u)s (also polled with 'p')");
+  fmlog("    S           cycle (S)ubscription to pushed status/value tables (%s)",
+        (push_frame_type == FRAME_TYPE_STATUS) ? "status" :
+        (push_frame_type == FRAME_TYPE_VALUE_TABLE) ? "value tables" : "off");
+  fmlog("    o           request R(O)I summary (regions of interest from FREEMCAN_ROIS)");
+  fmlog("    z           request a range of bins (FREEMCAN_ZOOM=first-last[/width], default around the maximum)");
   fmlog("    C           (c)opy data table from flash to ram");
   fmlog("    c           set flag to (c)opy data table into flash after measurement");
 }
@@ -381,10 +799,27 @@ void tui_init()
                                         packet_handler_text,
                                         packet_handler_personality_info,
                                         packet_handler_params_from_eeprom,
+                                        packet_handler_time_sync,
+                                        packet_handler_isr_profile,
+                                        packet_handler_roi_summary,
+                                        packet_handler_status,
+                                        packet_handler_reply,
+                                        packet_handler_resend_chunks,
                                         NULL);
+  clock_sync_reset(&tui_clock_sync);
+  export_set_clock_sync(&tui_clock_sync);
+  readout_link_init(&tui_readout_link, READOUT_BUDGET);
+  readout_scheduler_init(&tui_readout, &tui_readout_link, READOUT_PRECISION,
+                         STATUS_POLL_INTERVAL, READOUT_MAX_INTERVAL);
 
   fmlog("freemcan TUI " GIT_VERSION);
   fmlog("Text user interface (TUI) set up");
+
+  const char *rois = getenv("FREEMCAN_ROIS");
+  if (rois) {
+    parse_rois(rois);
+  }
+  fmlog_rois();
 }
 
 
@@ -394,6 +829,8 @@ void tui_fini()
   static volatile bool tui_fini_run = false;
   if (!tui_fini_run) {
     packet_parser_unref(tui_packet_parser);
+    readout_scheduler_fini(&tui_readout);
+    time_series_drop();
     tty_reset();
     fmlog_reset_handler();
     if (stdlog) {
@@ -413,15 +850,93 @@ void tui_fini()
  */
 
 
+/** Request the device timebase for the clock correlation
+ *
+ * Only one request is outstanding at a time, so that the reply can
+ * be matched with the send time.
+ */
+static
+void tui_send_time_sync(void)
+{
+  const double now = clock_sync_now();
+  if ((time_sync_sent == 0.0) || (now - time_sync_sent > TIME_SYNC_TIMEOUT)) {
+    time_sync_sent = now;
+    tui_device_send_simple_command(FRAME_CMD_TIME_SYNC);
+  }
+}
+
+
 void tui_do_timeout(void)
 {
-  if (waiting_for > 2) {
+  command_tracker_poll(&tui_commands, clock_sync_now());
+  if (tui_commands.unanswered >= UNANSWERED_LIMIT) {
     /* Not connected, apparently. Implies not measuring, either. */
     is_measuring = false;
   }
   if (is_measuring) {
-    tui_device_send_simple_command(FRAME_CMD_INTERMEDIATE);
+    tui_send_time_sync();
+    if (roi_monitor_flag) {
+      tui_device_send_simple_command(FRAME_CMD_ROI_SUMMARY);
+    }
+    if (periodic_update_flag) {
+      /* the status reply decides whether to fetch the table */
+      tui_device_send_simple_command(FRAME_CMD_STATUS);
+    }
+  }
+}
+
+
+/** Subscribe to pushed frames, or end the subscription
+ *
+ * Status frames are pushed every #STATUS_POLL_INTERVAL, value tables
+ * at the current periodic update interval. The device does not
+ * follow later changes of the interval.
+ */
+static
+void tui_send_subscribe(const uint8_t frame_type)
+{
+  if (!personality_info) {
+    fmlog("Missing personality_info");
+    return;
+  }
+  const double seconds = (frame_type == FRAME_TYPE_STATUS) ?
+    STATUS_POLL_INTERVAL : readout_scheduler_interval(&tui_readout);
+  unsigned long interval = ceil(seconds * personality_info->units_per_second);
+  if (interval > 0xffff) {
+    interval = 0xffff;
   }
+  const packet_subscribe_param_t param = {
+    htole16((frame_type) ? interval : 0),
+    (frame_type) ? frame_type : FRAME_TYPE_STATUS
+  };
+  push_frame_type = frame_type;
+  push_seq_expected = 0;
+  tui_device_send_command_params(FRAME_CMD_SUBSCRIBE,
+                                 (void *)&param, sizeof(param));
+}
+
+
+/** Check the sequence number of a pushed frame for gaps
+ *
+ * \return Whether the frame has been pushed (not requested)
+ */
+static
+bool tui_check_push_seq(const uint16_t seq)
+{
+  if (!seq) {
+    return false;
+  }
+  if (push_seq_expected && (seq != push_seq_expected)) {
+    /* 0 is skipped when the sequence number wraps around */
+    uint16_t lost = seq - push_seq_expected;
+    if (seq < push_seq_expected) {
+      lost--;
+    }
+    push_frames_lost += lost;
+    fmlog("<Lost %u pushed frame(s), %lu in total", lost, push_frames_lost);
+  }
+  push_seq_expected = (seq == 0xffff) ? 1 : (seq + 1);
+  return true;
 }
 
 
@@ -436,24 +951,86 @@ void tui_send_parametrized_command(const bool do_measure)
    */
   const time_t ts =
     do_measure?time(NULL):0;
-  if (personality_info) {
-    if ((personality_info->param_data_size_timer_count == 2) &&
-        (personality_info->param_data_size_skip_samples == 2)) {
-      tui_device_send_command_16_16(cmd, ts, last_sent_duration, skip_samples);
-    } else if ((personality_info->param_data_size_timer_count == 0) &&
-               (personality_info->param_data_size_skip_samples == 2)) {
-      tui_device_send_command_16(cmd, ts, skip_samples);
-    } else if ((personality_info->param_data_size_timer_count == 2) &&
-               (personality_info->param_data_size_skip_samples == 0)) {
-      tui_device_send_command_16(cmd, ts, last_sent_duration);
-    } else {
-      fmlog("Invalid personality_info: timer_count:%zu skip_samples:%zu",
-            personality_info->param_data_size_timer_count,
-            personality_info->param_data_size_skip_samples);
-    }
-  } else {
+  if (!personality_info) {
     fmlog("Missing personality_info");
+    return;
+  }
+  const personality_info_t *pi = personality_info;
+  if (((pi->param_data_size_timer_count != 0) &&
+       (pi->param_data_size_timer_count != 2)) ||
+      ((pi->param_data_size_skip_samples != 0) &&
+       (pi->param_data_size_skip_samples != 2)) ||
+      ((pi->param_data_size_trigger != 0) &&
+       (pi->param_data_size_trigger != sizeof(packet_trigger_param_t))) ||
+      ((pi->param_data_size_sample_period != 0) &&
+       (pi->param_data_size_sample_period != 4)) ||
+      ((pi->param_data_size_roi != 0) &&
+       (pi->param_data_size_roi != sizeof(packet_roi_param_t))) ||
+      ((pi->param_data_size_resolution != 0) &&
+       (pi->param_data_size_resolution != sizeof(packet_resolution_param_t))) ||
+      (pi->param_data_size_timer_count +
+       pi->param_data_size_skip_samples +
+       pi->param_data_size_trigger +
+       pi->param_data_size_sample_period == 0)) {
+    fmlog("Invalid personality_info: timer_count:%zu skip_samples:%zu "
+          "trigger:%zu sample_period:%zu roi:%zu resolution:%zu",
+          pi->param_data_size_timer_count,
+          pi->param_data_size_skip_samples,
+          pi->param_data_size_trigger,
+          pi->param_data_size_sample_period,
+          pi->param_data_size_roi,
+          pi->param_data_size_resolution);
+    return;
+  }
+
+  /* The parameters in the order the firmware reads them, followed by
+   * the time_t token which the firmware sends back as-is. */
+  uint8_t params[2 + 2 + sizeof(packet_trigger_param_t) + 4 +
+                 sizeof(packet_roi_param_t) + sizeof(packet_resolution_param_t) +
+                 sizeof(time_t)];
+  size_t ofs = 0;
+  if (pi->param_data_size_timer_count) {
+    const uint16_t v = htole16(last_sent_duration);
+    memcpy(&params[ofs], &v, sizeof(v));
+    ofs += sizeof(v);
+  }
+  if (pi->param_data_size_skip_samples) {
+    const uint16_t v = htole16(skip_samples);
+    memcpy(&params[ofs], &v, sizeof(v));
+    ofs += sizeof(v);
+  }
+  if (pi->param_data_size_trigger) {
+    const packet_trigger_param_t v = {
+      htole16(trigger_param.level),
+      htole16(trigger_param.hysteresis),
+      htole16(trigger_param.pre_samples),
+      htole16(trigger_param.post_samples),
+      trigger_param.flags
+    };
+    memcpy(&params[ofs], &v, sizeof(v));
+    ofs += sizeof(v);
+  }
+  if (pi->param_data_size_sample_period) {
+    const uint32_t v = htole32(sample_period_ticks(pi));
+    memcpy(&params[ofs], &v, sizeof(v));
+    ofs += sizeof(v);
+  }
+  if (pi->param_data_size_roi) {
+    packet_roi_param_t v;
+    for (size_t r = 0; r < ROI_MAX; r++) {
+      v.window[r].first = htole16(roi_param.window[r].first);
+      v.window[r].last = htole16(roi_param.window[r].last);
+    }
+    memcpy(&params[ofs], &v, sizeof(v));
+    ofs += sizeof(v);
+  }
+  if (pi->param_data_size_resolution) {
+    params[ofs] = resolution;
+    ofs += sizeof(packet_resolution_param_t);
   }
+  memcpy(&params[ofs], &ts, sizeof(ts));
+  ofs += sizeof(ts);
+  tui_device_send_command_params(cmd, params, ofs);
 }
 
 
@@ -494,10 +1071,10 @@ void tui_do_io(void)
       case 'p':
         periodic_update_flag = !periodic_update_flag;
         if (periodic_update_flag) {
-          recalculate_periodic_interval();
-          fmlog("Periodic updates now enabled (every %lu seconds)",
-                periodic_update_interval);
-          tui_device_send_simple_command(FRAME_CMD_INTERMEDIATE);
+          fmlog("Periodic updates now enabled");
+          fmlog_readout();
+          readout_scheduler_request(&tui_readout, clock_sync_now());
+          tui_request_readout();
         } else {
           fmlog("Periodic updates now disabled");
         }
@@ -541,17 +1118,65 @@ void tui_do_io(void)
           fmlog_durations();
         }
         break;
+      case 'b':
+        sample_burst = !sample_burst;
+        fmlog_sample_period();
+        break;
+      case 'd':
+        step_sample_period(false);
+        fmlog_sample_period();
+        break;
+      case 'D':
+        step_sample_period(true);
+        fmlog_sample_period();
+        break;
+      case 'v':
+        step_resolution(false);
+        fmlog_resolution();
+        break;
+      case 'V':
+        step_resolution(true);
+        fmlog_resolution();
+        break;
+      case 't':
+        if (trigger_param.post_samples) {
+          trigger_post_samples = trigger_param.post_samples;
+          trigger_param.post_samples = 0;
+        } else {
+          trigger_param.post_samples = trigger_post_samples;
+        }
+        fmlog_trigger();
+        break;
+      case 'l':
+        if (trigger_param.level >= 64) {
+          trigger_param.level -= 64;
+        }
+        fmlog_trigger();
+        break;
+      case 'L':
+        if (trigger_param.level < 4096 - 64) {
+          trigger_param.level += 64;
+        }
+        fmlog_trigger();
+        break;
+      case 'g':
+        trigger_param.flags ^= TRIGGER_FLAG_FALLING;
+        fmlog_trigger();
+        break;
+      case 'n':
+        trigger_param.flags ^= TRIGGER_FLAG_REARM;
+        fmlog_trigger();
+        break;
       case 'f':
         tui_device_send_simple_command(FRAME_CMD_PERSONALITY_INFO);
         break;
       case 'm':
+        time_series_drop();
         last_sent_duration = duration_list[duration_index];
-        recalculate_periodic_interval();
         tui_send_parametrized_command(true);
         break;
       case 'e':
         last_sent_duration = duration_list[duration_index];
-        recalculate_periodic_interval();
         tui_send_parametrized_command(false);
         break;
       case 'E':
@@ -562,7 +1187,17 @@ void tui_do_io(void)
         fmlog("Hostware status:");
         fmlog("  duration=%u clock cycles", duration_list[duration_index]);
         fmlog("  skip_samples=%u", skip_samples);
-        fmlog("  periodic_update_interval=%lu", periodic_update_interval);
+        fmlog_sample_period();
+        fmlog_resolution();
+        fmlog_trigger();
+        fmlog_rois();
+        fmlog_readout();
+        fmlog("  commands: %lu sent, %lu answered, %lu retried, %lu failed, "
+              "%lu untracked, %zu in flight, last round trip %.3f s",
+              tui_commands.sent, tui_commands.answered, tui_commands.retried,
+              tui_commands.failed, tui_commands.untracked,
+              command_tracker_outstanding(&tui_commands),
+              tui_commands.round_trip);
         break;
       case FRAME_CMD_ABORT:
       case FRAME_CMD_RESET:
@@ -582,6 +1217,43 @@ void tui_do_io(void)
         write_next_intermediate_packet = true;
         tui_device_send_simple_command(FRAME_CMD_INTERMEDIATE);
         break;
+      case FRAME_CMD_TIME_SYNC:
+        tui_send_time_sync();
+        break;
+      case 'P':
+        tui_device_send_simple_command(FRAME_CMD_ISR_PROFILE);
+        break;
+      case FRAME_CMD_ROI_SUMMARY:
+        tui_device_send_simple_command(FRAME_CMD_ROI_SUMMARY);
+        break;
+      case FRAME_CMD_STATUS:
+        status_requested = true;
+        tui_device_send_simple_command(FRAME_CMD_STATUS);
+        break;
+      case FRAME_CMD_SUBSCRIBE:
+        /* off -> status -> value table -> off */
+        if (push_frame_type == 0) {
+          tui_send_subscribe(FRAME_TYPE_STATUS);
+          fmlog("Device now pushes status frames every %u s",
+                STATUS_POLL_INTERVAL);
+        } else if (push_frame_type == FRAME_TYPE_STATUS) {
+          tui_send_subscribe(FRAME_TYPE_VALUE_TABLE);
+          fmlog("Device now pushes value tables every %.1f s",
+                readout_scheduler_interval(&tui_readout));
+        } else {
+          tui_send_subscribe(0);
+          fmlog("Device does not push frames any more");
+        }
+        break;
+      case 'z':
+        tui_send_table_range();
+        break;
+      case 'O':
+        roi_monitor_flag = !roi_monitor_flag;
+        fmlog("Periodic ROI summaries now %s",
+              (roi_monitor_flag)?"enabled":"disabled");
+        fmlog_rois();
+        break;
       default:
         /* Ignore all other input characters, but print a warning. */
         if (1) {
@@ -628,9 +1300,6 @@ void atexit_func(void)
 /** State data packet handler (TUI specific) */
 static void packet_handler_state(const char *state, void *UP(data))
 {
-  if (waiting_for > 0) {
-    waiting_for--;
-  }
   fmlog("<STATE: %s", state);
   bool new_is_measuring = (strcmp("MEASURING", state) == 0);
   if (new_is_measuring != is_measuring) {
@@ -642,12 +1311,207 @@ static void packet_handler_state(const char *state, void *UP(data))
 }
 
 
+/** Time sync packet handler (TUI specific) */
+static void packet_handler_time_sync(const uint64_t ticks,
+                                     const uint64_t start_ticks,
+                                     const uint32_t timebase_clock,
+                                     void *UP(data))
+{
+  const double now = clock_sync_now();
+  if (time_sync_sent == 0.0) {
+    fmlog("<TIME SYNC: unexpected reply, ignored");
+    return;
+  }
+  const double round_trip = now - time_sync_sent;
+  const bool used = clock_sync_add(&tui_clock_sync, ticks, start_ticks,
+                                   timebase_clock, time_sync_sent, now);
+  time_sync_sent = 0.0;
+  if (!timebase_clock) {
+    fmlog("<TIME SYNC: device has no timebase");
+  } else if (used) {
+    fmlog("<TIME SYNC: %.6f s, round trip %.1f ms, skew %.3f ppm (%zu points)",
+          ((double)ticks) / timebase_clock, round_trip * 1e3,
+          clock_sync_skew_ppm(&tui_clock_sync), tui_clock_sync.points);
+  } else {
+    fmlog("<TIME SYNC: dropped, round trip %.1f ms", round_trip * 1e3);
+  }
+}
+
+
+/** Name of an ADuC7026 interrupt source (bit number in IRQSTA) */
+static const char *isr_profile_irq_name(const uint8_t irq)
+{
+  switch (irq) {
+  case 2:  return "TIMER0";
+  case 3:  return "TIMER1";
+  case 4:  return "TIMER2";
+  case 5:  return "TIMER3";
+  case 7:  return "ADC";
+  case 8:  return "PLL_LOCK";
+  case 14: return "UART";
+  case 19: return "PLA_IRQ0";
+  default: return "?";
+  }
+}
+
+
+/** Log the non-empty bins of an ISR profile histogram */
+static void fmlog_isr_profile_hist(const char *what, const uint32_t *hist)
+{
+  char buf[PACKET_ISR_PROFILE_BINS * 24];
+  size_t ofs = 0;
+  buf[0] = '\0';
+  for (size_t bin = 0; bin < PACKET_ISR_PROFILE_BINS; bin++) {
+    if (hist[bin]) {
+      ofs += snprintf(&buf[ofs], sizeof(buf) - ofs, " %lu:%u",
+                      (bin) ? (1UL << bin) : 0UL, hist[bin]);
+    }
+  }
+  fmlog("      %-8s [ticks:calls]%s", what, buf);
+}
+
+
+/** ISR profile packet handler (TUI specific) */
+static void packet_handler_isr_profile(const uint32_t timer_clock,
+                                       const size_t source_count,
+                                       const packet_isr_profile_source_t *sources,
+                                       void *UP(data))
+{
+  if (!timer_clock) {
+    fmlog("<ISR PROFILE: firmware built without the ISR profiler");
+    return;
+  }
+  const double us_per_tick = 1e6 / timer_clock;
+  fmlog("<ISR PROFILE: %zu sources, stop watch %.3f MHz",
+        source_count, timer_clock / 1e6);
+  for (size_t i = 0; i < source_count; i++) {
+    const packet_isr_profile_source_t *p = &sources[i];
+    fmlog("    %-8s %u calls, latency %.2f..%.2f us, duration %.2f..%.2f us",
+          isr_profile_irq_name(p->irq), p->count,
+          p->latency_min * us_per_tick, p->latency_max * us_per_tick,
+          p->duration_min * us_per_tick, p->duration_max * us_per_tick);
+    /* the histograms in the packed struct may be unaligned */
+    uint32_t hist[PACKET_ISR_PROFILE_BINS];
+    memcpy(hist, p->latency_hist, sizeof(hist));
+    fmlog_isr_profile_hist("latency", hist);
+    memcpy(hist, p->duration_hist, sizeof(hist));
+    fmlog_isr_profile_hist("duration", hist);
+  }
+}
+
+
+/** ROI summary packet handler (TUI specific)
+ *
+ * The live time is the elapsed time minus the dead time. Without a
+ * timebase, the elapsed time is the duration.
+ */
+static void packet_handler_roi_summary(const packet_roi_summary_t *summary,
+                                       void *UP(data))
+{
+  if (!summary->rois) {
+    fmlog("<ROI SUMMARY: personality has no region of interest counters");
+    return;
+  }
+  double elapsed;
+  if (summary->timebase_clock) {
+    elapsed = ((double)summary->elapsed_ticks) / summary->timebase_clock;
+  } else if (personality_info) {
+    elapsed = ((double)summary->duration) / personality_info->units_per_second;
+  } else {
+    elapsed = summary->duration;
+  }
+  const double live_time = elapsed - summary->dead_time / 1000.0;
+  fmlog("<ROI SUMMARY: %.3f s, live time %.3f s, %u triggers while busy",
+        elapsed, live_time, summary->busy_triggers);
+  for (size_t r = 0; r < summary->rois; r++) {
+    if (roi_param.window[r].first > roi_param.window[r].last) {
+      continue;
+    }
+    const uint32_t sum = summary->sum[r];
+    fmlog("    ROI %zu (%u-%u): %u counts, %.3f cps", r,
+          roi_param.window[r].first, roi_param.window[r].last, sum,
+          (live_time > 0.0) ? (sum / live_time) : 0.0);
+  }
+}
+
+
+/** Status packet handler (TUI specific)
+ *
+ * With periodic updates enabled, the status is polled every
+ * #STATUS_POLL_INTERVAL. The status feeds the count rate into the
+ * readout scheduler, which decides when to request the full value
+ * table. It is only requested if the counts or the table size have
+ * changed since the last one.
+ */
+static void packet_handler_status(const packet_status_t *status,
+                                  void *UP(data))
+{
+  tui_check_push_seq(status->push_seq);
+  double elapsed;
+  if (status->timebase_clock) {
+    elapsed = ((double)status->elapsed_ticks) / status->timebase_clock;
+  } else if (personality_info) {
+    elapsed = ((double)status->duration) / personality_info->units_per_second;
+  } else {
+    elapsed = status->duration;
+  }
+  const bool new_is_measuring = (status->state == STATUS_STATE_MEASURING);
+  if (status_requested || (new_is_measuring != is_measuring)) {
+    fmlog("<STATUS: %c %.3f s, live %.3f s, %u counts, max %u at %u, "
+          "table %u bytes%s%s",
+          status->state, elapsed, elapsed - status->dead_time / 1000.0,
+          status->total_counts, status->max_value, status->max_index,
+          status->table_size,
+          (status->flags & STATUS_FLAG_PROMOTED) ? ", promoted" : "",
+          (status->flags & STATUS_FLAG_OVERFLOW) ? ", OVERFLOW" : "");
+    status_requested = false;
+  }
+  is_measuring = new_is_measuring;
+  status_max_index = status->max_index;
+
+  const double now = clock_sync_now();
+  readout_scheduler_counts(&tui_readout, now, status->total_counts);
+  if (is_measuring && periodic_update_flag &&
+      ((status->total_counts != periodic_update_total_counts) ||
+       (status->table_size != periodic_update_table_size)) &&
+      readout_scheduler_due(&tui_readout, now)) {
+    readout_scheduler_request(&tui_readout, now);
+    periodic_update_total_counts = status->total_counts;
+    periodic_update_table_size = status->table_size;
+    tui_request_readout();
+  }
+}
+
+
+/** Reply handler (TUI specific)
+ *
+ * Matches the frames to the commands in flight. Also gives the
+ * command tracker the chance to send commands again while the device
+ * keeps the main loop too busy for a timeout.
+ */
+static void packet_handler_reply(const uint8_t seq, const frame_type_t type,
+                                 void *UP(data))
+{
+  const double now = clock_sync_now();
+  command_tracker_reply(&tui_commands, now, seq, type);
+  command_tracker_poll(&tui_commands, now);
+}
+
+
+/** Resend chunks handler (TUI specific) */
+static uint8_t packet_handler_resend_chunks(const packet_resend_chunks_param_t *param,
+                                            void *UP(data))
+{
+  fmlog("<Value table chunks missing, asking for them again");
+  return command_tracker_send(&tui_commands, clock_sync_now(),
+                              FRAME_CMD_RESEND_CHUNKS,
+                              param, sizeof(*param));
+}
+
+
 /** Text data packet handler (TUI specific) */
 static void packet_handler_text(const char *text, void *UP(data))
 {
-  if (waiting_for > 0) {
-    waiting_for--;
-  }
   fmlog("<TEXT: %s", text);
 }
 
@@ -670,8 +1534,23 @@ static void packet_handler_personality_info(personality_info_t *pi,
         pi->personality_name, pi->units_per_second);
   fmlog("<                  sizeof_table:%zu bits_per_value:%zu",
         pi->sizeof_table, pi->bits_per_value);
-  fmlog("<                  sz(timer_count):%zu sz(skip_samples):%zu",
-        pi->param_data_size_timer_count, pi->param_data_size_skip_samples);
+  fmlog("<                  sz(timer_count):%zu sz(skip_samples):%zu sz(trigger):%zu",
+        pi->param_data_size_timer_count, pi->param_data_size_skip_samples,
+        pi->param_data_size_trigger);
+  if (pi->sample_clock) {
+    fmlog("<                  sz(sample_period):%zu sample rate %g Hz .. %g Hz",
+          pi->param_data_size_sample_period,
+          ((double)pi->sample_clock) / pi->max_sample_period,
+          ((double)pi->sample_clock) / pi->min_sample_period);
+  }
+  if (pi->sample_clock && pi->burst_sample_period) {
+    fmlog("<                  burst mode sample rate %g Hz",
+          ((double)pi->sample_clock) / pi->burst_sample_period);
+  }
+  if (pi->param_data_size_resolution) {
+    fmlog("<                  resolution %u .. %u bits",
+          pi->min_resolution, pi->max_resolution);
+  }
   fmlog("<                  %zu elements of %zu bits each",
 
         8*pi->sizeof_table / pi->bits_per_value, pi->bits_per_value);
@@ -687,8 +1566,57 @@ static void packet_handler_personality_info(personality_info_t *pi,
 static void packet_handler_value_table(packet_value_table_t *value_table_packet,
                                        void *UP(data))
 {
-  if (waiting_for > 0) {
-    waiting_for--;
+  const bool pushed = tui_check_push_seq(value_table_packet->push_seq);
+  if ((value_table_packet->bin_width == 1) &&
+      (value_table_packet->type == VALUE_TABLE_TYPE_TIME_SERIES) &&
+      time_series && !time_series_same_measurement(value_table_packet)) {
+    /* the next readout fetches the new time series as a whole */
+    fmlog("<New measurement, dropping the time series received so far");
+    time_series_drop();
+  }
+  if ((value_table_packet->bin_width == 1) &&
+      (value_table_packet->type == VALUE_TABLE_TYPE_TIME_SERIES) &&
+      time_series &&
+      (value_table_packet->first_bin <= time_series->element_count)) {
+    /* tail of the time series, continue with the whole time series */
+    fmlog("<Time series tail: %zu elements from %u",
+          value_table_packet->element_count, value_table_packet->first_bin);
+    value_table_packet = packet_value_table_append(time_series,
+                                                   value_table_packet);
+    packet_value_table_unref(time_series);
+    time_series = value_table_packet;
+  } else if (value_table_packet->bin_width) {
+    /* range value table, neither a readout nor worth exporting */
+    if (!value_table_packet->element_count) {
+      fmlog("<Empty range from bin %u: the value table has no such bins",
+            value_table_packet->first_bin);
+      return;
+    }
+    fmlog("<Bins %u.. of %u bins each (%zu elements, %.3f seconds):",
+          value_table_packet->first_bin, value_table_packet->bin_width,
+          value_table_packet->element_count,
+          packet_value_table_elapsed_time(value_table_packet));
+    fmlog_value_table("< ", value_table_packet->elements,
+                      value_table_packet->element_count);
+    return;
+  } else if (value_table_packet->type == VALUE_TABLE_TYPE_TIME_SERIES) {
+    time_series_drop();
+    packet_value_table_ref(value_table_packet);
+    time_series = value_table_packet;
+  }
+  if (!value_table_packet->bin_width) {
+    table_has_bins =
+      (value_table_packet->type == VALUE_TABLE_TYPE_HISTOGRAM) ||
+      (value_table_packet->type == VALUE_TABLE_TYPE_TIME_SERIES);
+  }
+  if (!pushed && (value_table_packet->reason == PACKET_VALUE_TABLE_INTERMEDIATE)) {
+    const double last_interval = readout_scheduler_interval(&tui_readout);
+    readout_scheduler_table(&tui_readout, clock_sync_now(), last_received_size);
+    const double interval = readout_scheduler_interval(&tui_readout);
+    if (periodic_update_flag &&
+        ((interval > 1.25 * last_interval) || (interval < 0.8 * last_interval))) {
+      fmlog_readout();
+    }
   }
   packet_value_table_ref(value_table_packet);
 
@@ -710,11 +1638,38 @@ static void packet_handler_value_table(packet_value_table_t *value_table_packet,
     snprintf(type_str, sizeof(type_str), "0x%02x=%d", type, type);
   }
   snprintf(buf, sizeof(buf),
-           "<Received %s type value table for reason %s: %%d elements, %%d seconds:",
+           "<Received %s type value table for reason %s: %%d elements, %%.3f seconds:",
            type_str, reason_str);
 
-  fmlog(buf, element_count, value_table_packet->duration);
-  fmlog_value_table("< ", value_table_packet->elements, element_count);
+  fmlog(buf, element_count, packet_value_table_elapsed_time(value_table_packet));
+  if (value_table_packet->overflow_entries) {
+    fmlog("<%u elements restored from the overflow table",
+          value_table_packet->overflow_entries);
+  }
+  if (value_table_packet->dead_time || value_table_packet->busy_triggers) {
+    fmlog("<Dead time %u ms, %u triggers while busy",
+          value_table_packet->dead_time, value_table_packet->busy_triggers);
+  }
+  if (type == VALUE_TABLE_TYPE_LIST_MODE) {
+    fmlog("<List mode chunk %u, backlog %u records, %u events lost",
+          value_table_packet->seq, value_table_packet->backlog,
+          value_table_packet->lost_events);
+  } else if (type == VALUE_TABLE_TYPE_SAMPLE_BLOCK) {
+    fmlog("<Sample block %u, first sample %u%s",
+          value_table_packet->seq, value_table_packet->first_sample,
+          (value_table_packet->flags & SAMPLE_BLOCK_FLAG_OVERRUN) ?
+          ", device overrun" : "");
+  } else if (type == VALUE_TABLE_TYPE_TRIGGER_WINDOW) {
+    if (element_count) {
+      fmlog("<Trigger window %u, trigger at sample %u",
+            value_table_packet->seq,
+            value_table_packet->first_sample + value_table_packet->pre_samples);
+    } else {
+      fmlog("<No trigger yet");
+    }
+  } else {
+    fmlog_value_table("< ", value_table_packet->elements, element_count);
+  }
 
   /* export current value table to file(s) */
   export_value_table(personality_info, value_table_packet);
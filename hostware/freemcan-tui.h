@@ -28,10 +28,19 @@
 #include <stdbool.h>
 
 #include "packet-parser.h"
+#include "command-tracker.h"
 
 bool quit_flag;
 bool periodic_update_flag;
-unsigned long periodic_update_interval;
+bool roi_monitor_flag;
+
+
+/** Interval in seconds for polling the status and ROI summaries */
+#define STATUS_POLL_INTERVAL 1
+
+
+/** Number of times a command is sent again if there is no reply */
+#define COMMAND_MAX_RETRIES 2
 
 
 void tui_init();
@@ -47,16 +56,16 @@ void update_last_received_size(const uint16_t size);
 extern packet_parser_t *tui_packet_parser;
 
 
-void tui_device_send_simple_command(const frame_cmd_t cmd);
+/** Commands in flight, initialized by the main loop */
+extern command_tracker_t tui_commands;
+
 
-void tui_device_send_command_16(const frame_cmd_t cmd,
-                                const time_t ts,
-                                const uint16_t a);
+void tui_device_send_simple_command(const frame_cmd_t cmd);
 
-void tui_device_send_command_16_16(const frame_cmd_t cmd,
-                                   const time_t ts,
-                                   const uint16_t a,
-                                   const uint16_t b);
+/** Send command with a parameter buffer already in device byte order */
+void tui_device_send_command_params(const frame_cmd_t cmd,
+                                    void *params,
+                                    const size_t params_size);
 
 
 void tui_startup_messages(void);
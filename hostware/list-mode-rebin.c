@@ -0,0 +1,364 @@
+/** \file hostware/list-mode-rebin.c
+ * \brief Build many histograms from list mode data in parallel
+ *
+ * \author Copyright (C) 2012 samplemaker
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ *
+ * \defgroup freemcan_list_mode_rebin List Mode Rebinning Engine
+ * \ingroup hostware_generic
+ *
+ * Builds K histograms (different binnings, time slices, energy
+ * calibrations) from one list mode event stream.
+ *
+ * The records are decoded in blocks into separate time and value
+ * arrays. Every worker thread takes a contiguous part of a block and
+ * increments its private copy of all K histograms, so no locking is
+ * needed. The private histograms are merged when a result is asked
+ * for.
+ *
+ * The increment loop does not calculate or check anything per event:
+ *
+ *   - The ADC values are 12 bit, so the calibration and binning of
+ *     histogram k is precomputed into a lookup table from ADC value
+ *     to bin. Values outside the histogram range go to a trash bin
+ *     behind the last bin.
+ *   - The event times of a block are sorted, so the time slice of
+ *     histogram k maps to a contiguous index range of the block.
+ *
+ * This leaves a plain gather/scatter loop hist[lut[value[i]]]++ which
+ * works through the block in pieces small enough to stay in the
+ * cache while looping over all K histograms.
+ *
+ * @{
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "list-mode.h"
+#include "list-mode-rebin.h"
+
+
+/** Number of entries in a lookup table: one per possible ADC value */
+#define LUT_SIZE (1<<LIST_MODE_VALUE_BITS)
+
+/** Number of records decoded and distributed at once */
+#define BLOCK_RECORDS (1<<20)
+
+/** Below this number of events per thread, threads cost more than
+ *  they save */
+#define MIN_EVENTS_PER_THREAD (1<<16)
+
+/** Number of events looped over for all K histograms in one go */
+#define SUB_BLOCK_EVENTS (1<<13)
+
+/** Private histograms of different threads start on different cache
+ *  lines (in uint32_t elements) */
+#define CACHE_LINE_ELEMENTS 16
+
+
+struct _list_mode_rebin_t {
+  /** Reference counter */
+  int refs;
+
+  /** Number of histograms */
+  size_t spec_count;
+
+  /** Histogram specifications */
+  list_mode_hist_spec_t *specs;
+
+  /** Lookup tables ADC value to bin, LUT_SIZE entries per histogram */
+  uint32_t *lut;
+
+  /** Offset of histogram k in a private histogram block */
+  size_t *hist_ofs;
+
+  /** Size of one thread's private histogram block in elements */
+  size_t block_size;
+
+  /** Number of worker threads */
+  unsigned int threads;
+
+  /** Private histograms, threads*block_size elements */
+  uint32_t *private_hists;
+
+  /** Decoder state carried from block to block */
+  list_mode_decoder_t decoder;
+
+  /** Decoded event times of the current block */
+  uint64_t *ticks;
+
+  /** Decoded ADC values of the current block */
+  uint16_t *values;
+
+  /** Per histogram index range [range_begin, range_end) of the
+   *  current block within the histogram's time slice */
+  size_t *range_begin;
+  size_t *range_end;
+};
+
+
+/** Work package for one worker thread */
+typedef struct {
+  list_mode_rebin_t *self;
+  unsigned int thread;
+  size_t begin;
+  size_t end;
+} rebin_work_t;
+
+
+/** Build lookup table ADC value to bin for one histogram */
+static
+void build_lut(uint32_t *lut, const list_mode_hist_spec_t *spec)
+{
+  const double width = (spec->max - spec->min) / spec->bins;
+  for (size_t v=0; v<LUT_SIZE; v++) {
+    const double x = spec->offset + spec->gain * v;
+    uint32_t bin = spec->bins; /* trash bin */
+    if ((x >= spec->min) && (x < spec->max)) {
+      bin = (uint32_t)((x - spec->min) / width);
+      if (bin >= spec->bins) {
+        bin = spec->bins - 1;
+      }
+    }
+    lut[v] = bin;
+  }
+}
+
+
+list_mode_rebin_t *list_mode_rebin_new(const list_mode_hist_spec_t *specs,
+                                       const size_t spec_count,
+                                       const unsigned int threads)
+{
+  list_mode_rebin_t *self = calloc(1, sizeof(*self));
+  assert(self);
+  self->refs = 1;
+
+  self->threads = threads;
+  if (self->threads == 0) {
+    const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    self->threads = (cpus > 0) ? cpus : 1;
+  }
+
+  self->spec_count = spec_count;
+  self->specs = malloc(spec_count * sizeof(*specs));
+  self->lut = malloc(spec_count * LUT_SIZE * sizeof(*self->lut));
+  self->hist_ofs = malloc(spec_count * sizeof(*self->hist_ofs));
+  self->range_begin = malloc(spec_count * sizeof(*self->range_begin));
+  self->range_end = malloc(spec_count * sizeof(*self->range_end));
+  assert(self->specs && self->lut && self->hist_ofs &&
+         self->range_begin && self->range_end);
+  memcpy(self->specs, specs, spec_count * sizeof(*specs));
+
+  size_t ofs = 0;
+  for (size_t k=0; k<spec_count; k++) {
+    assert(specs[k].bins > 0);
+    assert(specs[k].max > specs[k].min);
+    build_lut(&self->lut[k*LUT_SIZE], &specs[k]);
+    self->hist_ofs[k] = ofs;
+    /* one trash bin per histogram */
+    ofs += specs[k].bins + 1;
+  }
+  self->block_size =
+    ((ofs + CACHE_LINE_ELEMENTS - 1) / CACHE_LINE_ELEMENTS) * CACHE_LINE_ELEMENTS;
+  self->private_hists = calloc(self->threads * self->block_size,
+                               sizeof(*self->private_hists));
+  assert(self->private_hists);
+
+  self->ticks = malloc(BLOCK_RECORDS * sizeof(*self->ticks));
+  self->values = malloc(BLOCK_RECORDS * sizeof(*self->values));
+  assert(self->ticks && self->values);
+
+  list_mode_decoder_reset(&self->decoder, 0);
+  return self;
+}
+
+
+void list_mode_rebin_ref(list_mode_rebin_t *self)
+{
+  assert(self->refs > 0);
+  self->refs++;
+}
+
+
+static
+void list_mode_rebin_free(list_mode_rebin_t *self)
+{
+  free(self->specs);
+  free(self->lut);
+  free(self->hist_ofs);
+  free(self->range_begin);
+  free(self->range_end);
+  free(self->private_hists);
+  free(self->ticks);
+  free(self->values);
+  free(self);
+}
+
+
+void list_mode_rebin_unref(list_mode_rebin_t *self)
+{
+  assert(self->refs > 0);
+  self->refs--;
+  if (self->refs == 0) {
+    list_mode_rebin_free(self);
+  }
+}
+
+
+/** Index of the first event at or after time t (ticks are sorted) */
+static
+size_t lower_bound(const uint64_t *ticks, const size_t count, const uint64_t t)
+{
+  size_t lo = 0, hi = count;
+  while (lo < hi) {
+    const size_t mid = lo + (hi - lo) / 2;
+    if (ticks[mid] < t) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+
+/** Increment the private histograms for events [begin, end) */
+static
+void *rebin_worker(void *arg)
+{
+  const rebin_work_t *work = arg;
+  const list_mode_rebin_t *self = work->self;
+  uint32_t *hists = &self->private_hists[work->thread * self->block_size];
+  const uint16_t *values = self->values;
+
+  for (size_t sub=work->begin; sub<work->end; sub+=SUB_BLOCK_EVENTS) {
+    const size_t sub_end =
+      (sub + SUB_BLOCK_EVENTS < work->end) ? (sub + SUB_BLOCK_EVENTS) : work->end;
+    for (size_t k=0; k<self->spec_count; k++) {
+      const size_t a =
+        (self->range_begin[k] > sub) ? self->range_begin[k] : sub;
+      const size_t b =
+        (self->range_end[k] < sub_end) ? self->range_end[k] : sub_end;
+      uint32_t *restrict h = &hists[self->hist_ofs[k]];
+      const uint32_t *restrict lut = &self->lut[k*LUT_SIZE];
+      for (size_t i=a; i<b; i++) {
+        h[lut[values[i]]]++;
+      }
+    }
+  }
+  return NULL;
+}
+
+
+/** Distribute one decoded block of events over the worker threads */
+static
+void rebin_block(list_mode_rebin_t *self, const size_t count)
+{
+  for (size_t k=0; k<self->spec_count; k++) {
+    const list_mode_hist_spec_t *spec = &self->specs[k];
+    self->range_begin[k] = (spec->t_begin) ?
+      lower_bound(self->ticks, count, spec->t_begin) : 0;
+    self->range_end[k] = (spec->t_end) ?
+      lower_bound(self->ticks, count, spec->t_end) : count;
+  }
+
+  unsigned int threads = count / MIN_EVENTS_PER_THREAD;
+  if (threads > self->threads) {
+    threads = self->threads;
+  }
+  if (threads <= 1) {
+    rebin_work_t work = { self, 0, 0, count };
+    rebin_worker(&work);
+    return;
+  }
+
+  pthread_t tids[threads];
+  rebin_work_t work[threads];
+  const size_t per_thread = (count + threads - 1) / threads;
+  for (unsigned int t=0; t<threads; t++) {
+    work[t].self = self;
+    work[t].thread = t;
+    work[t].begin = t * per_thread;
+    work[t].end = (t+1 < threads) ? ((t+1) * per_thread) : count;
+  }
+  /* the calling thread does the work of thread 0 */
+  for (unsigned int t=1; t<threads; t++) {
+    const int ret = pthread_create(&tids[t], NULL, rebin_worker, &work[t]);
+    assert(ret == 0);
+  }
+  rebin_worker(&work[0]);
+  for (unsigned int t=1; t<threads; t++) {
+    pthread_join(tids[t], NULL);
+  }
+}
+
+
+void list_mode_rebin_records(list_mode_rebin_t *self,
+                             const uint32_t *records, const size_t count)
+{
+  for (size_t ofs=0; ofs<count; ofs+=BLOCK_RECORDS) {
+    const size_t n =
+      (count - ofs < BLOCK_RECORDS) ? (count - ofs) : BLOCK_RECORDS;
+    const size_t events =
+      list_mode_decode_block(&self->decoder, &records[ofs], n,
+                             self->ticks, self->values);
+    rebin_block(self, events);
+  }
+}
+
+
+uint64_t list_mode_rebin_ticks(const list_mode_rebin_t *self)
+{
+  return self->decoder.ticks;
+}
+
+
+packet_value_table_t *list_mode_rebin_value_table(list_mode_rebin_t *self,
+                                                  const size_t k,
+                                                  const packet_value_table_reason_t reason,
+                                                  const time_t receive_time,
+                                                  const unsigned int duration)
+{
+  assert(k < self->spec_count);
+  const size_t bins = self->specs[k].bins;
+  packet_value_table_t *result =
+    packet_value_table_new_zeroed(reason, VALUE_TABLE_TYPE_HISTOGRAM,
+                                  receive_time, bins, duration);
+  for (unsigned int t=0; t<self->threads; t++) {
+    const uint32_t *h =
+      &self->private_hists[t * self->block_size + self->hist_ofs[k]];
+    for (size_t i=0; i<bins; i++) {
+      result->elements[i] += h[i];
+    }
+  }
+  return result;
+}
+
+
+/** @} */
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,130 @@
+/** \file hostware/list-mode-rebin.h
+ * \brief Build many histograms from list mode data in parallel (interface)
+ *
+ * \author Copyright (C) 2012 samplemaker
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ *
+ * \addtogroup freemcan_list_mode_rebin
+ * @{
+ */
+
+#ifndef FREEMCAN_LIST_MODE_REBIN_H
+#define FREEMCAN_LIST_MODE_REBIN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "packet-value-table.h"
+
+
+/** Histogram specification
+ *
+ * Every event with ADC value v is calibrated to x = offset + gain*v
+ * and counted in one of bins equally sized bins covering [min, max)
+ * if its time lies within [t_begin, t_end).
+ */
+typedef struct {
+  /** Calibration offset */
+  double offset;
+  /** Calibration gain */
+  double gain;
+  /** Lower limit of the histogram range (calibrated) */
+  double min;
+  /** Upper limit of the histogram range (calibrated) */
+  double max;
+  /** Number of bins */
+  size_t bins;
+  /** Start of time slice in timestamp clock ticks */
+  uint64_t t_begin;
+  /** End of time slice in timestamp clock ticks, 0 for no limit */
+  uint64_t t_end;
+} list_mode_hist_spec_t;
+
+
+/** Rebinning engine (opaque data type) */
+struct _list_mode_rebin_t;
+
+/** Rebinning engine (opaque data type) */
+typedef struct _list_mode_rebin_t list_mode_rebin_t;
+
+
+/** Create a rebinning engine for the given histograms
+ *
+ * \param specs Array of histogram specifications (copied)
+ * \param spec_count Number of histograms
+ * \param threads Number of worker threads, 0 for one per CPU
+ */
+list_mode_rebin_t *list_mode_rebin_new(const list_mode_hist_spec_t *specs,
+                                       const size_t spec_count,
+                                       const unsigned int threads)
+  __attribute__(( warn_unused_result ))
+  __attribute__(( malloc ));
+
+
+void list_mode_rebin_ref(list_mode_rebin_t *self)
+  __attribute__(( nonnull(1) ));
+
+
+void list_mode_rebin_unref(list_mode_rebin_t *self)
+  __attribute__(( nonnull(1) ));
+
+
+/** Feed list mode records into all histograms
+ *
+ * Records must be fed in the order received. Event times are
+ * counted from the first record fed.
+ *
+ * \param records Records in host endianness
+ */
+void list_mode_rebin_records(list_mode_rebin_t *self,
+                             const uint32_t *records, const size_t count)
+  __attribute__(( nonnull(1) ));
+
+
+/** Time of the last event fed in timestamp clock ticks */
+uint64_t list_mode_rebin_ticks(const list_mode_rebin_t *self)
+  __attribute__(( nonnull(1) ));
+
+
+/** Merge the per thread histograms and return histogram k
+ *
+ * The result can be passed to export_value_table(). The caller owns
+ * the reference and has to call packet_value_table_unref().
+ *
+ * \param duration Duration of the measurement in seconds
+ */
+packet_value_table_t *list_mode_rebin_value_table(list_mode_rebin_t *self,
+                                                  const size_t k,
+                                                  const packet_value_table_reason_t reason,
+                                                  const time_t receive_time,
+                                                  const unsigned int duration)
+  __attribute__(( nonnull(1) ))
+  __attribute__(( warn_unused_result ));
+
+
+/** @} */
+
+#endif /* !FREEMCAN_LIST_MODE_REBIN_H */
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
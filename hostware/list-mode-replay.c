@@ -0,0 +1,257 @@
+/** \file hostware/list-mode-replay.c
+ * \brief Build histograms from a recorded list mode capture file
+ *
+ * \author Copyright (C) 2012 samplemaker
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ *
+ * \defgroup freemcan_list_mode_replay List Mode Replay Tool
+ * \ingroup hostware_generic
+ *
+ * Offline tool reading a list mode capture file as written by
+ * freemcan-tui (list.<date>.lmd) and writing one histogram file per
+ * calibration and time slice, in the same format freemcan-tui writes
+ * histograms in.
+ *
+ *   list-mode-replay [-j THREADS] [-t SECONDS]
+ *                    [-c OFFSET:GAIN:BINS:MIN:MAX]... CAPTUREFILE
+ *
+ * Without -c, one histogram of the raw ADC values is built. With -t,
+ * every calibration additionally gets one histogram per time slice
+ * of the given length.
+ *
+ * @{
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "endian-conversion.h"
+#include "freemcan-export.h"
+#include "freemcan-log.h"
+#include "list-mode.h"
+#include "list-mode-rebin.h"
+#include "personality-info.h"
+
+
+/** Maximum number of calibrations given with -c */
+#define MAX_CALIBRATIONS 16
+
+/** Number of records read from the capture file at once */
+#define READ_RECORDS (1<<20)
+
+
+/** There is no device to send a personality info packet
+ *
+ * Only needed for parsing received value table packets, which the
+ * replay tool never does.
+ */
+personality_info_t *personality_info = NULL;
+
+
+static
+void usage(const char *prog)
+{
+  fmlog("Usage: %s [-j THREADS] [-t SECONDS] [-c OFFSET:GAIN:BINS:MIN:MAX]... "
+        "CAPTUREFILE", prog);
+  fmlog("  -j THREADS   number of worker threads (default: one per CPU)");
+  fmlog("  -t SECONDS   also build one histogram per time slice");
+  fmlog("  -c CALIB     calibration and binning, may be repeated");
+  fmlog("               (default: 0:1:4096:0:4096, i.e. raw ADC values)");
+}
+
+
+/** Read the next block of records, return number of records read */
+static
+size_t read_records(FILE *capfile, uint32_t *records)
+{
+  const size_t count = fread(records, sizeof(uint32_t), READ_RECORDS, capfile);
+  for (size_t i=0; i<count; i++) {
+    records[i] = letoh32(records[i]);
+  }
+  return count;
+}
+
+
+/** Position capture file behind the header */
+static
+void rewind_capture(FILE *capfile)
+{
+  const int ret = fseek(capfile, 8, SEEK_SET);
+  assert(ret == 0);
+}
+
+
+static
+double wall_time(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+int main(int argc, char *argv[])
+{
+  unsigned int threads = 0;
+  unsigned int slice_seconds = 0;
+  list_mode_hist_spec_t calibs[MAX_CALIBRATIONS];
+  size_t calib_count = 0;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "j:t:c:h")) != -1) {
+    switch (opt) {
+    case 'j':
+      threads = atoi(optarg);
+      break;
+    case 't':
+      slice_seconds = atoi(optarg);
+      break;
+    case 'c':
+      if (calib_count >= MAX_CALIBRATIONS) {
+        fmlog_error("Too many calibrations (max %d)", MAX_CALIBRATIONS);
+        exit(EXIT_FAILURE);
+      } else {
+        list_mode_hist_spec_t *c = &calibs[calib_count];
+        memset(c, 0, sizeof(*c));
+        if ((5 != sscanf(optarg, "%lf:%lf:%zu:%lf:%lf",
+                         &c->offset, &c->gain, &c->bins, &c->min, &c->max)) ||
+            (c->bins == 0) || (c->max <= c->min)) {
+          fmlog_error("Invalid calibration: %s", optarg);
+          exit(EXIT_FAILURE);
+        }
+        calib_count++;
+      }
+      break;
+    case 'h':
+      usage(argv[0]);
+      exit(EXIT_SUCCESS);
+    default:
+      usage(argv[0]);
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (optind+1 != argc) {
+    usage(argv[0]);
+    exit(EXIT_FAILURE);
+  }
+  const char *capname = argv[optind];
+
+  if (calib_count == 0) {
+    const list_mode_hist_spec_t raw =
+      { 0.0, 1.0, 0.0, 1<<LIST_MODE_VALUE_BITS, 1<<LIST_MODE_VALUE_BITS, 0, 0 };
+    calibs[calib_count++] = raw;
+  }
+
+  FILE *capfile = fopen(capname, "rb");
+  if (!capfile) {
+    fmlog_error("Cannot open capture file %s", capname);
+    exit(EXIT_FAILURE);
+  }
+  char magic[4];
+  uint32_t tps;
+  if ((1 != fread(magic, sizeof(magic), 1, capfile)) ||
+      (0 != memcmp(magic, LIST_MODE_FILE_MAGIC, sizeof(magic))) ||
+      (1 != fread(&tps, sizeof(tps), 1, capfile))) {
+    fmlog_error("%s is not a list mode capture file", capname);
+    exit(EXIT_FAILURE);
+  }
+  tps = letoh32(tps);
+
+  uint32_t *records = malloc(READ_RECORDS * sizeof(uint32_t));
+  assert(records);
+  const double start = wall_time();
+
+  /* First pass: only needed to find the length of the capture */
+  list_mode_decoder_t decoder;
+  list_mode_decoder_reset(&decoder, tps);
+  size_t count;
+  while ((count = read_records(capfile, records)) > 0) {
+    list_mode_decode_records(&decoder, records, count, NULL, NULL);
+  }
+  const uint64_t end_ticks = decoder.ticks;
+  const unsigned int capture_seconds = (end_ticks + tps - 1) / tps;
+
+  /* Every calibration over the whole capture, then its time slices */
+  const uint64_t slice_ticks = (uint64_t)slice_seconds * tps;
+  const size_t slices = (slice_ticks) ?
+    ((end_ticks + slice_ticks - 1) / slice_ticks) : 0;
+  const size_t spec_count = calib_count * (1 + slices);
+  list_mode_hist_spec_t *specs = malloc(spec_count * sizeof(*specs));
+  assert(specs);
+  for (size_t c=0; c<calib_count; c++) {
+    list_mode_hist_spec_t *s = &specs[c * (1 + slices)];
+    s[0] = calibs[c];
+    for (size_t i=0; i<slices; i++) {
+      s[1+i] = calibs[c];
+      s[1+i].t_begin = i * slice_ticks;
+      s[1+i].t_end = (i+1) * slice_ticks;
+    }
+  }
+
+  /* Second pass: build all histograms at once */
+  list_mode_rebin_t *rebin = list_mode_rebin_new(specs, spec_count, threads);
+  rewind_capture(capfile);
+  while ((count = read_records(capfile, records)) > 0) {
+    list_mode_rebin_records(rebin, records, count);
+  }
+  fclose(capfile);
+  free(records);
+
+  fmlog("%s: %llu events, %u s of data, %zu histograms, %.2f s",
+        capname, (unsigned long long)decoder.events, capture_seconds,
+        spec_count, wall_time() - start);
+
+  const time_t now = time(NULL);
+  for (size_t c=0; c<calib_count; c++) {
+    for (size_t i=0; i<=slices; i++) {
+      const size_t k = c * (1 + slices) + i;
+      const unsigned int duration = (i == 0) ? capture_seconds :
+        ((i < slices) ? slice_seconds :
+         (capture_seconds - (slices-1) * slice_seconds));
+      packet_value_table_t *value_table =
+        list_mode_rebin_value_table(rebin, k, PACKET_VALUE_TABLE_DONE,
+                                    now, duration);
+      char fname[256];
+      if (i == 0) {
+        snprintf(fname, sizeof(fname), "%s.%02zu.all.dat", capname, c);
+      } else {
+        snprintf(fname, sizeof(fname), "%s.%02zu.%04zu.dat", capname, c, i-1);
+      }
+      export_value_table_file(NULL, value_table, fname);
+      packet_value_table_unref(value_table);
+    }
+  }
+
+  list_mode_rebin_unref(rebin);
+  free(specs);
+  return 0;
+}
+
+
+/** @} */
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
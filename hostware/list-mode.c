@@ -0,0 +1,143 @@
+/** \file hostware/list-mode.c
+ * \brief List mode event stream decoding
+ *
+ * \author Copyright (C) 2012 samplemaker
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ *
+ * \defgroup freemcan_list_mode List Mode Event Stream
+ * \ingroup hostware_generic
+ *
+ * The device sends the list mode records as a sequence of chunks,
+ * each one a value table packet of type #VALUE_TABLE_TYPE_LIST_MODE.
+ * Every record holds the time since the previous record, so the
+ * decoder accumulates the absolute event time from chunk to chunk.
+ *
+ * A missing chunk makes the absolute time of all following events
+ * uncertain. This is counted and reported, but not corrected.
+ *
+ * @{
+ */
+
+#include <string.h>
+
+#include "list-mode.h"
+#include "freemcan-log.h"
+
+
+void list_mode_decoder_reset(list_mode_decoder_t *self,
+                             const uint32_t ticks_per_second)
+{
+  memset(self, 0, sizeof(*self));
+  self->ticks_per_second = ticks_per_second;
+}
+
+
+void list_mode_decode_records(list_mode_decoder_t *self,
+                              const uint32_t *records, const size_t count,
+                              list_mode_event_handler_t handler, void *data)
+{
+  uint64_t ticks = self->ticks;
+  for (size_t i=0; i<count; i++) {
+    const uint32_t record = records[i];
+    const uint32_t delta = LIST_MODE_RECORD_DELTA(record);
+    const uint32_t value = LIST_MODE_RECORD_VALUE(record);
+    if (delta == LIST_MODE_DELTA_MARKER) {
+      /* time marker: value counts full delta periods, no event */
+      ticks += ((uint64_t)value) << LIST_MODE_DELTA_BITS;
+      continue;
+    }
+    ticks += delta;
+    self->events++;
+    if (handler) {
+      handler(ticks, value, data);
+    }
+  }
+  self->ticks = ticks;
+}
+
+
+size_t list_mode_decode_block(list_mode_decoder_t *self,
+                              const uint32_t *records, const size_t count,
+                              uint64_t *ticks, uint16_t *values)
+{
+  uint64_t t = self->ticks;
+  size_t n = 0;
+  for (size_t i=0; i<count; i++) {
+    const uint32_t record = records[i];
+    const uint32_t delta = LIST_MODE_RECORD_DELTA(record);
+    const uint32_t value = LIST_MODE_RECORD_VALUE(record);
+    if (delta == LIST_MODE_DELTA_MARKER) {
+      t += ((uint64_t)value) << LIST_MODE_DELTA_BITS;
+      continue;
+    }
+    t += delta;
+    ticks[n] = t;
+    values[n] = value;
+    n++;
+  }
+  self->ticks = t;
+  self->events += n;
+  return n;
+}
+
+
+bool list_mode_decode_chunk(list_mode_decoder_t *self,
+                            const packet_value_table_t *value_table_packet,
+                            list_mode_event_handler_t handler, void *data)
+{
+  const unsigned int seq = value_table_packet->seq;
+  bool complete = true;
+
+  if (packet_value_table_measurement_changed(&self->measurement,
+                                             value_table_packet)) {
+    list_mode_decoder_reset(self, value_table_packet->ticks_per_second);
+  }
+  packet_value_table_measurement_update(&self->measurement,
+                                        value_table_packet);
+  if (seq != self->next_seq) {
+    const unsigned int missed = (seq - self->next_seq) & 0xffff;
+    fmlog("List mode: %u chunk(s) missing before chunk %u, "
+          "event times are off from now on", missed, seq);
+    self->missed_chunks += missed;
+    complete = false;
+  }
+  self->next_seq = (seq + 1) & 0xffff;
+
+  if (value_table_packet->lost_events != self->lost_events) {
+    fmlog("List mode: device dropped %u events (ring buffer full), "
+          "backlog %u records",
+          value_table_packet->lost_events - self->lost_events,
+          value_table_packet->backlog);
+    self->lost_events = value_table_packet->lost_events;
+  }
+
+  list_mode_decode_records(self, value_table_packet->elements,
+                           value_table_packet->element_count,
+                           handler, data);
+  return complete;
+}
+
+
+/** @} */
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,131 @@
+/** \file hostware/list-mode.h
+ * \brief List mode event stream decoding (interface)
+ *
+ * \author Copyright (C) 2012 samplemaker
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ *
+ * \addtogroup freemcan_list_mode
+ * @{
+ */
+
+#ifndef FREEMCAN_LIST_MODE_H
+#define FREEMCAN_LIST_MODE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "packet-defs.h"
+#include "packet-value-table.h"
+
+
+/** Magic at the start of a list mode capture file
+ *
+ * A capture file consists of the magic, the timestamp clock
+ * frequency (uint32_t, little endian) and the list mode records
+ * (uint32_t, little endian) exactly as received from the device.
+ */
+#define LIST_MODE_FILE_MAGIC "FMLM"
+
+
+/** Callback function type called for every decoded event
+ *
+ * \param ticks Event time in timestamp clock ticks since the start
+ *              of the measurement.
+ * \param value ADC value
+ */
+typedef void (*list_mode_event_handler_t)(const uint64_t ticks,
+                                          const uint32_t value,
+                                          void *data);
+
+
+/** List mode decoder state carried from chunk to chunk */
+typedef struct {
+  /** Measurement the chunks decoded so far belong to */
+  packet_value_table_measurement_t measurement;
+  /** Time of the last decoded record in timestamp clock ticks */
+  uint64_t ticks;
+  /** Frequency of the timestamp clock in Hz */
+  uint32_t ticks_per_second;
+  /** Sequence number expected for the next chunk */
+  unsigned int next_seq;
+  /** Number of chunks missed (sequence number gaps) */
+  unsigned int missed_chunks;
+  /** Events dropped by the device (ring buffer full) */
+  uint32_t lost_events;
+  /** Number of events decoded */
+  uint64_t events;
+} list_mode_decoder_t;
+
+
+/** Reset decoder for a new measurement */
+void list_mode_decoder_reset(list_mode_decoder_t *self,
+                             const uint32_t ticks_per_second)
+  __attribute__((nonnull(1)));
+
+
+/** Decode list mode records and call handler for every event
+ *
+ * \param records Records in host endianness
+ */
+void list_mode_decode_records(list_mode_decoder_t *self,
+                              const uint32_t *records, const size_t count,
+                              list_mode_event_handler_t handler, void *data)
+  __attribute__((nonnull(1)));
+
+
+/** Decode list mode records into separate time and value arrays
+ *
+ * The structure of arrays layout is what the histogram increment
+ * loops in \ref freemcan_list_mode_rebin work on.
+ *
+ * \param records Records in host endianness
+ * \param ticks Output array for event times, at least count elements
+ * \param values Output array for ADC values, at least count elements
+ * \return Number of events written to ticks and values
+ */
+size_t list_mode_decode_block(list_mode_decoder_t *self,
+                              const uint32_t *records, const size_t count,
+                              uint64_t *ticks, uint16_t *values)
+  __attribute__((nonnull(1,4,5)));
+
+
+/** Decode a list mode value table packet (one chunk)
+ *
+ * Resets the decoder on the first chunk of a new measurement (see
+ * packet_value_table_measurement_changed()) and accounts for missing
+ * chunks. The sequence number may wrap around within a measurement.
+ *
+ * \return false if one or more chunks are missing before this one.
+ */
+bool list_mode_decode_chunk(list_mode_decoder_t *self,
+                            const packet_value_table_t *value_table_packet,
+                            list_mode_event_handler_t handler, void *data)
+  __attribute__((nonnull(1,2)));
+
+
+/** @} */
+
+#endif /* !FREEMCAN_LIST_MODE_H */
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -44,6 +44,30 @@
 #include "packet-parser.h"
 
 
+/** Number of times to ask for the missing chunks of a chunked value
+ *  table before giving up on it */
+#define CHUNK_RESEND_ROUNDS 3
+
+
+/** Chunked value table being assembled */
+typedef struct {
+  /** Value table header (device byte order) */
+  packet_value_table_header_t header;
+  /** Parameter buffer followed by the value table data, NULL if no
+   *  table is being assembled */
+  uint8_t *data;
+  /** Number of chunks */
+  unsigned int chunks;
+  /** Chunks still missing, bit n for chunk n */
+  uint32_t missing;
+  /** Number of times the missing chunks have been asked for */
+  unsigned int rounds;
+  /** Sequence ID of the last #FRAME_CMD_RESEND_CHUNKS command, 0 if
+   *  it has not been tracked */
+  uint8_t resend_seq;
+} chunked_table_t;
+
+
 /** Internals of opaque #packet_parser_t */
 struct _packet_parser_t {
   /** reference counter */
@@ -59,6 +83,21 @@ struct _packet_parser_t {
   packet_handler_personality_info_t packet_handler_personality_info;
   /** handler callback function for parameter from eeprom frames */
   packet_handler_params_from_eeprom_t packet_handler_params_from_eeprom;
+  /** handler callback function for time sync frames */
+  packet_handler_time_sync_t packet_handler_time_sync;
+  /** handler callback function for ISR profile frames */
+  packet_handler_isr_profile_t packet_handler_isr_profile;
+  /** handler callback function for ROI summary frames */
+  packet_handler_roi_summary_t packet_handler_roi_summary;
+  /** handler callback function for status frames */
+  packet_handler_status_t packet_handler_status;
+  /** Reply callback */
+  packet_handler_reply_t packet_handler_reply;
+  /** Callback asking for missing value table chunks */
+  packet_handler_resend_chunks_t packet_handler_resend_chunks;
+
+  /** Chunked value table being assembled */
+  chunked_table_t chunked;
 
   /** private data for callback functions*/
   void *                     packet_handler_data;
@@ -70,6 +109,12 @@ packet_parser_t *packet_parser_new(packet_handler_value_table_t value_table_pack
                                    packet_handler_text_t text_packet_handler,
                                    packet_handler_personality_info_t packet_handler_personality_info,
                                    packet_handler_params_from_eeprom_t ph_params_from_eeprom,
+                                   packet_handler_time_sync_t ph_time_sync,
+                                   packet_handler_isr_profile_t ph_isr_profile,
+                                   packet_handler_roi_summary_t ph_roi_summary,
+                                   packet_handler_status_t ph_status,
+                                   packet_handler_reply_t ph_reply,
+                                   packet_handler_resend_chunks_t ph_resend_chunks,
                                    void *data)
 {
   packet_parser_t *self = calloc(1, sizeof(packet_parser_t));
@@ -80,6 +125,12 @@ packet_parser_t *packet_parser_new(packet_handler_value_table_t value_table_pack
   self->packet_handler_text = text_packet_handler;
   self->packet_handler_personality_info = packet_handler_personality_info;
   self->packet_handler_params_from_eeprom = ph_params_from_eeprom;
+  self->packet_handler_time_sync = ph_time_sync;
+  self->packet_handler_isr_profile = ph_isr_profile;
+  self->packet_handler_roi_summary = ph_roi_summary;
+  self->packet_handler_status = ph_status;
+  self->packet_handler_reply = ph_reply;
+  self->packet_handler_resend_chunks = ph_resend_chunks;
   self->packet_handler_data = data;
   /* everything else set to NULL by calloc */
   return self;
@@ -98,13 +149,238 @@ void packet_parser_unref(packet_parser_t *self)
   assert(self->refs > 0);
   self->refs--;
   if (self->refs == 0) {
+    free(self->chunked.data);
     free(self);
   }
 }
 
 
+/** Size of the parameter buffer and the overflow table in front of
+ *  the value table data */
+static
+size_t value_table_prefix_size(const packet_value_table_header_t *header)
+{
+  return header->param_buf_length +
+    header->overflow_entries * sizeof(packet_overflow_entry_t);
+}
+
+
+/** Hand a value table to the value table handler
+ *
+ * \param header Value table header (device byte order)
+ * \param data Parameter buffer and overflow table followed by the
+ *             value table data
+ * \param size Size of data in bytes
+ */
+static
+void handle_value_table(packet_parser_t *self,
+                        const packet_value_table_header_t *header,
+                        const uint8_t *data, const size_t size)
+{
+  size_t value_table_size = size - value_table_prefix_size(header);
+  /* a range value table is empty if the device has none of its bins */
+  assert((value_table_size > 0) || header->bin_width);
+  if (header->type == VALUE_TABLE_TYPE_LIST_MODE) {
+    /* the chunk header is not part of the records */
+    assert(value_table_size >= sizeof(packet_list_mode_chunk_t));
+    value_table_size -= sizeof(packet_list_mode_chunk_t);
+  } else if (header->type == VALUE_TABLE_TYPE_SAMPLE_BLOCK) {
+    /* neither is the sample block header */
+    assert(value_table_size >= sizeof(packet_sample_block_t));
+    value_table_size -= sizeof(packet_sample_block_t);
+  } else if (header->type == VALUE_TABLE_TYPE_TRIGGER_WINDOW) {
+    /* nor is the trigger window header */
+    assert(value_table_size >= sizeof(packet_trigger_window_t));
+    value_table_size -= sizeof(packet_trigger_window_t);
+  }
+  const size_t element_count = 8*value_table_size/header->bits_per_value;
+  packet_value_table_t *vtab =
+    packet_value_table_new(header->reason,
+                           header->type,
+                           time(NULL),
+                           header->bits_per_value,
+                           element_count,
+                           header->duration,
+                           header->elapsed_ticks,
+                           header->timebase_clock,
+                           header->dead_time,
+                           header->busy_triggers,
+                           header->push_seq,
+                           header->first_bin,
+                           header->bin_width,
+                           header->overflow_entries,
+                           header->param_buf_length,
+                           data);
+  self->packet_handler_value_table(vtab, self->packet_handler_data);
+  packet_value_table_unref(vtab);
+}
+
+
+/** Whether we can decode value table elements of this size */
+static
+bool value_table_bits_valid(const uint8_t bits_per_value)
+{
+  switch (bits_per_value) {
+  case 8:
+  case 12:
+  case 16:
+  case 24:
+  case 32:
+    return true;
+  default:
+    return false;
+  }
+}
+
+
+/** Forget the chunked value table being assembled */
+static
+void chunked_drop(packet_parser_t *self)
+{
+  free(self->chunked.data);
+  memset(&self->chunked, 0, sizeof(self->chunked));
+}
+
+
+/** Hand the chunked value table to the handler if it is complete */
+static
+void chunked_check_complete(packet_parser_t *self)
+{
+  chunked_table_t *c = &self->chunked;
+  if (c->data && !c->missing) {
+    handle_value_table(self, &c->header, c->data,
+                       value_table_prefix_size(&c->header) +
+                       letoh16(c->header.table_size));
+    chunked_drop(self);
+  }
+}
+
+
+/** Start assembling a chunked value table from its header frame */
+static
+void chunked_start(packet_parser_t *self,
+                   const packet_value_table_header_t *header,
+                   const uint8_t *params)
+{
+  chunked_table_t *c = &self->chunked;
+  if (c->data) {
+    fmlog_error("Dropping incomplete value table %u",
+                letoh16(c->header.table_id));
+    chunked_drop(self);
+  }
+  const size_t table_size = letoh16(header->table_size);
+  const size_t chunk_size = letoh16(header->chunk_size);
+  const size_t chunks = (table_size + chunk_size - 1) / chunk_size;
+  if ((chunks == 0) || (chunks > TABLE_CHUNKS_MAX)) {
+    fmlog_error("Ignoring value table with %zu chunks", chunks);
+    return;
+  }
+  memcpy(&c->header, header, sizeof(c->header));
+  const size_t prefix_size = value_table_prefix_size(header);
+  c->data = malloc(prefix_size + table_size);
+  assert(c->data);
+  memcpy(c->data, params, prefix_size);
+  c->chunks = chunks;
+  c->missing = (chunks == 32) ? 0xffffffffUL : ((1UL << chunks) - 1);
+}
+
+
+/** Ask for the chunks still missing, or give up on the table */
+static
+void chunked_resend(packet_parser_t *self)
+{
+  chunked_table_t *c = &self->chunked;
+  if (!c->data || !c->missing) {
+    return;
+  }
+  if (!self->packet_handler_resend_chunks ||
+      (c->rounds >= CHUNK_RESEND_ROUNDS)) {
+    fmlog_error("Dropping value table %u with missing chunks 0x%08lx",
+                letoh16(c->header.table_id), (unsigned long)c->missing);
+    chunked_drop(self);
+    return;
+  }
+  c->rounds++;
+  const packet_resend_chunks_param_t param = {
+    c->header.table_id,
+    htole32(c->missing)
+  };
+  c->resend_seq =
+    self->packet_handler_resend_chunks(&param, self->packet_handler_data);
+}
+
+
+/** Put a chunk into the chunked value table
+ *
+ * Chunks of other tables (e.g. late replies for a dropped table) are
+ * ignored.
+ */
+static
+void chunked_put(packet_parser_t *self, const frame_t *frame)
+{
+  chunked_table_t *c = &self->chunked;
+  packet_table_chunk_t chunk;
+  if (!c->data || (frame->size < sizeof(chunk))) {
+    return;
+  }
+  memcpy(&chunk, &(frame->payload[0]), sizeof(chunk));
+  if (chunk.table_id != c->header.table_id) {
+    return;
+  }
+  const size_t table_size = letoh16(c->header.table_size);
+  const size_t chunk_size = letoh16(c->header.chunk_size);
+  const size_t offset = letoh16(chunk.offset);
+  const size_t size = frame->size - sizeof(chunk);
+  const size_t index = offset / chunk_size;
+  if ((offset % chunk_size) || (index >= c->chunks) ||
+      (size != (((table_size - offset) < chunk_size) ?
+                (table_size - offset) : chunk_size))) {
+    fmlog_error("Ignoring value table chunk at offset %zu, size %zu",
+                offset, size);
+    return;
+  }
+  memcpy(&c->data[value_table_prefix_size(&c->header) + offset],
+         &(frame->payload[sizeof(chunk)]), size);
+  c->missing &= ~(1UL << index);
+  if (c->missing && !c->rounds && (index == c->chunks - 1)) {
+    /* first round is over */
+    chunked_resend(self);
+  }
+  chunked_check_complete(self);
+}
+
+
+/** A frame other than a chunk has arrived while assembling a chunked
+ *  value table
+ *
+ * Unless the resend command is being answered, this ends the
+ * chunks. If chunks are missing, ask for them again. A resend is
+ * answered when its state reply arrives.
+ */
+static
+void chunked_other_frame(packet_parser_t *self, const frame_t *frame)
+{
+  chunked_table_t *c = &self->chunked;
+  if (!c->data || !c->missing) {
+    return;
+  }
+  if (!c->rounds || !c->resend_seq ||
+      ((frame->type == FRAME_TYPE_STATE) && (frame->seq == c->resend_seq))) {
+    chunked_resend(self);
+  }
+}
+
+
 void packet_parser_handle_frame(packet_parser_t *self, const frame_t *frame)
 {
+  if (frame->seq && self->packet_handler_reply) {
+    self->packet_handler_reply(frame->seq, frame->type,
+                               self->packet_handler_data);
+  }
+  if ((frame->type != FRAME_TYPE_TABLE_CHUNK) &&
+      (frame->type != FRAME_TYPE_VALUE_TABLE)) {
+    chunked_other_frame(self, frame);
+  }
   switch (frame->type) {
   case FRAME_TYPE_PARAMS_FROM_EEPROM:
     if (self->packet_handler_params_from_eeprom) {
@@ -124,6 +400,16 @@ void packet_parser_handle_frame(packet_parser_t *self, const frame_t *frame)
                                                     ppi->units_per_second,
                                                     ppi->param_data_size_timer_count,
                                                     ppi->param_data_size_skip_samples,
+                                                    ppi->param_data_size_trigger,
+                                                    ppi->param_data_size_sample_period,
+                                                    ppi->param_data_size_roi,
+                                                    ppi->param_data_size_resolution,
+                                                    ppi->sample_clock,
+                                                    ppi->min_sample_period,
+                                                    ppi->max_sample_period,
+                                                    ppi->burst_sample_period,
+                                                    ppi->min_resolution,
+                                                    ppi->max_resolution,
                                                     personality_name_size,
                                                     (const char *)&(frame->payload[sizeof(*ppi)]));
       self->packet_handler_personality_info(pi, self->packet_handler_data);
@@ -136,6 +422,93 @@ void packet_parser_handle_frame(packet_parser_t *self, const frame_t *frame)
                                  self->packet_handler_data);
     }
     return;
+  case FRAME_TYPE_TIME_SYNC:
+    if (self->packet_handler_time_sync) {
+      if (frame->size != sizeof(packet_time_sync_t)) {
+        fmlog_error("Ignoring time sync packet of size %d", frame->size);
+        return;
+      }
+      const packet_time_sync_t *sync =
+        (const packet_time_sync_t *)&(frame->payload[0]);
+      self->packet_handler_time_sync(letoh64(sync->ticks),
+                                     letoh64(sync->start_ticks),
+                                     letoh32(sync->timebase_clock),
+                                     self->packet_handler_data);
+    }
+    return;
+  case FRAME_TYPE_ISR_PROFILE:
+    if (self->packet_handler_isr_profile) {
+      const packet_isr_profile_header_t *header =
+        (const packet_isr_profile_header_t *)&(frame->payload[0]);
+      if ((frame->size < sizeof(*header)) ||
+          (frame->size != sizeof(*header) +
+           header->sources * sizeof(packet_isr_profile_source_t))) {
+        fmlog_error("Ignoring ISR profile packet of size %d", frame->size);
+        return;
+      }
+      const size_t count = header->sources;
+      packet_isr_profile_source_t sources[count ? count : 1];
+      memcpy(sources, &(frame->payload[sizeof(*header)]),
+             count * sizeof(sources[0]));
+      for (size_t i = 0; i < count; i++) {
+        sources[i].count = letoh32(sources[i].count);
+        sources[i].latency_min = letoh16(sources[i].latency_min);
+        sources[i].latency_max = letoh16(sources[i].latency_max);
+        sources[i].duration_min = letoh16(sources[i].duration_min);
+        sources[i].duration_max = letoh16(sources[i].duration_max);
+        for (size_t bin = 0; bin < PACKET_ISR_PROFILE_BINS; bin++) {
+          sources[i].latency_hist[bin] = letoh32(sources[i].latency_hist[bin]);
+          sources[i].duration_hist[bin] = letoh32(sources[i].duration_hist[bin]);
+        }
+      }
+      self->packet_handler_isr_profile(letoh32(header->timer_clock),
+                                       count, sources,
+                                       self->packet_handler_data);
+    }
+    return;
+  case FRAME_TYPE_ROI_SUMMARY:
+    if (self->packet_handler_roi_summary) {
+      if (frame->size != sizeof(packet_roi_summary_t)) {
+        fmlog_error("Ignoring ROI summary packet of size %d", frame->size);
+        return;
+      }
+      packet_roi_summary_t summary;
+      memcpy(&summary, &(frame->payload[0]), sizeof(summary));
+      summary.duration = letoh32(summary.duration);
+      summary.elapsed_ticks = letoh64(summary.elapsed_ticks);
+      summary.timebase_clock = letoh32(summary.timebase_clock);
+      summary.dead_time = letoh32(summary.dead_time);
+      summary.busy_triggers = letoh32(summary.busy_triggers);
+      if (summary.rois > ROI_MAX) {
+        summary.rois = ROI_MAX;
+      }
+      for (size_t r = 0; r < ROI_MAX; r++) {
+        summary.sum[r] = letoh32(summary.sum[r]);
+      }
+      self->packet_handler_roi_summary(&summary, self->packet_handler_data);
+    }
+    return;
+  case FRAME_TYPE_STATUS:
+    if (self->packet_handler_status) {
+      if (frame->size != sizeof(packet_status_t)) {
+        fmlog_error("Ignoring status packet of size %d", frame->size);
+        return;
+      }
+      packet_status_t status;
+      memcpy(&status, &(frame->payload[0]), sizeof(status));
+      status.duration = letoh32(status.duration);
+      status.elapsed_ticks = letoh64(status.elapsed_ticks);
+      status.timebase_clock = letoh32(status.timebase_clock);
+      status.dead_time = letoh32(status.dead_time);
+      status.busy_triggers = letoh32(status.busy_triggers);
+      status.total_counts = letoh32(status.total_counts);
+      status.max_value = letoh32(status.max_value);
+      status.max_index = letoh16(status.max_index);
+      status.table_size = letoh16(status.table_size);
+      status.push_seq = letoh16(status.push_seq);
+      self->packet_handler_status(&status, self->packet_handler_data);
+    }
+    return;
   case FRAME_TYPE_TEXT:
     if (self->packet_handler_text) {
       self->packet_handler_text((const char *)frame->payload,
@@ -146,21 +519,39 @@ void packet_parser_handle_frame(packet_parser_t *self, const frame_t *frame)
     if (self->packet_handler_value_table) {
       const packet_value_table_header_t *header =
         (const packet_value_table_header_t *)&(frame->payload[0]);
-      const size_t value_table_size =
-        frame->size - sizeof(*header) - header->param_buf_length;
-      assert(value_table_size > 0);
-      const size_t element_count = 8*value_table_size/header->bits_per_value;
-      packet_value_table_t *vtab =
-        packet_value_table_new(header->reason,
-                               header->type,
-                               time(NULL),
-                               header->bits_per_value,
-                               element_count,
-                               header->duration,
-                               header->param_buf_length,
-                               &(frame->payload[sizeof(*header)]));
-      self->packet_handler_value_table(vtab, self->packet_handler_data);
-      packet_value_table_unref(vtab);
+      if ((frame->size < sizeof(*header)) ||
+          (header->header_version != VALUE_TABLE_HEADER_VERSION)) {
+        /* do not guess at the layout of a header we do not know */
+        fmlog_error("Ignoring value table with header version %d "
+                    "(expected %d), size %d",
+                    (frame->size) ? header->header_version : -1,
+                    VALUE_TABLE_HEADER_VERSION, frame->size);
+        return;
+      }
+      if (!value_table_bits_valid(header->bits_per_value)) {
+        /* the device chooses the element size for every value table */
+        fmlog_error("Ignoring value table with %d bits per value",
+                    header->bits_per_value);
+        return;
+      }
+      if ((header->overflow_entries > OVERFLOW_TABLE_SIZE) ||
+          (frame->size < sizeof(*header) + value_table_prefix_size(header))) {
+        fmlog_error("Ignoring value table with %d overflow entries, size %d",
+                    header->overflow_entries, frame->size);
+        return;
+      }
+      if (header->chunk_size) {
+        /* the value table data follows in chunk frames */
+        chunked_start(self, header, &(frame->payload[sizeof(*header)]));
+        return;
+      }
+      handle_value_table(self, header, &(frame->payload[sizeof(*header)]),
+                         frame->size - sizeof(*header));
+    }
+    return;
+  case FRAME_TYPE_TABLE_CHUNK:
+    if (self->packet_handler_value_table) {
+      chunked_put(self, frame);
     }
     return;
   /* No "default:" case on purpose: Let compiler complain about
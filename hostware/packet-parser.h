@@ -42,6 +42,12 @@ packet_parser_t *packet_parser_new(packet_handler_value_table_t value_table_pack
                                    packet_handler_text_t text_packet_handler,
                                    packet_handler_personality_info_t packet_handler_personality_info,
                                    packet_handler_params_from_eeprom_t ph_params_from_eeprom,
+                                   packet_handler_time_sync_t ph_time_sync,
+                                   packet_handler_isr_profile_t ph_isr_profile,
+                                   packet_handler_roi_summary_t ph_roi_summary,
+                                   packet_handler_status_t ph_status,
+                                   packet_handler_reply_t ph_reply,
+                                   packet_handler_resend_chunks_t ph_resend_chunks,
                                    void *data)
   __attribute__(( warn_unused_result ))
   __attribute__(( malloc ));
@@ -35,16 +35,38 @@
 #include "frame-parser.h"
 #include "freemcan-packet.h"
 #include "endian-conversion.h"
+#include "sample-packing.h"
 
 #include "personality-info.h"
 
 
-typedef enum {
-  STATE_A,
-  STATE_B,
-  STATE_C,
-  STATE_D
-} state_compress_t;
+/** Add the counts lost to wrap arounds of a table element
+ *
+ * \param index Index of the table element on the device
+ * \param carry Counts lost to the wrap arounds
+ */
+static
+void packet_value_table_add_carry(packet_value_table_t *value_table,
+                                  const size_t index, const uint32_t carry)
+{
+  size_t element = index;
+  if (value_table->bin_width) {
+    if (index < value_table->first_bin) {
+      return;
+    }
+    element = (index - value_table->first_bin) / value_table->bin_width;
+  }
+  if (element >= value_table->element_count) {
+    return;
+  }
+  const uint32_t value = value_table->elements[element];
+  if (value + carry < value) {
+    fmlog("Element %zu exceeds 32 bits, saturating", element);
+    value_table->elements[element] = UINT32_MAX;
+  } else {
+    value_table->elements[element] = value + carry;
+  }
+}
 
 
 /** Create new value table object in host conventions.
@@ -59,7 +81,15 @@ packet_value_table_t *packet_value_table_new(const packet_value_table_reason_t r
                                              const time_t receive_time,
                                              const uint8_t bits_per_value,
                                              const size_t element_count,
-                                             const uint16_t _duration,
+                                             const uint32_t _duration,
+                                             const uint64_t _elapsed_ticks,
+                                             const uint32_t _timebase_clock,
+                                             const uint32_t _dead_time,
+                                             const uint32_t _busy_triggers,
+                                             const uint16_t _push_seq,
+                                             const uint16_t _first_bin,
+                                             const uint16_t _bin_width,
+                                             const uint8_t overflow_entries,
                                              const uint8_t param_buf_length,
                                              const void *data)
 {
@@ -73,7 +103,15 @@ packet_value_table_t *packet_value_table_new(const packet_value_table_reason_t r
   result->receive_time      = receive_time;
   result->element_count     = element_count;
   result->orig_bits_per_value = bits_per_value;
-  result->duration          = letoh16(_duration);
+  result->duration          = letoh32(_duration);
+  result->elapsed_ticks     = letoh64(_elapsed_ticks);
+  result->timebase_clock    = letoh32(_timebase_clock);
+  result->dead_time         = letoh32(_dead_time);
+  result->busy_triggers     = letoh32(_busy_triggers);
+  result->push_seq          = letoh16(_push_seq);
+  result->first_bin         = letoh16(_first_bin);
+  result->bin_width         = letoh16(_bin_width);
+  result->overflow_entries  = overflow_entries;
   size_t ofs = 0;
   const char *cdata = (const char *)data;
 
@@ -104,18 +142,96 @@ packet_value_table_t *packet_value_table_new(const packet_value_table_reason_t r
     result->skip_samples    = -1;
   }
 
+  /* skip trigger parameter, we do not need it here */
+  if (ofs < param_buf_length && personality_info->param_data_size_trigger) {
+    assert(sizeof(packet_trigger_param_t) == personality_info->param_data_size_trigger);
+    ofs += sizeof(packet_trigger_param_t);
+  }
+
+  if (ofs+4 <= param_buf_length && personality_info->param_data_size_sample_period) {
+    uint32_t _sample_period;
+    memcpy(&_sample_period, &cdata[ofs], sizeof(_sample_period));
+    assert(4 == personality_info->param_data_size_sample_period);
+    ofs += 4;
+    result->sample_period   = letoh32(_sample_period);
+  } else {
+    result->sample_period   = 0;
+  }
+
+  /* skip ROI parameter, the sums come with the ROI summary packet */
+  if (ofs < param_buf_length && personality_info->param_data_size_roi) {
+    assert(sizeof(packet_roi_param_t) == personality_info->param_data_size_roi);
+    ofs += sizeof(packet_roi_param_t);
+  }
+
+  /* skip resolution parameter, the table size tells the resolution */
+  if (ofs < param_buf_length && personality_info->param_data_size_resolution) {
+    assert(sizeof(packet_resolution_param_t) == personality_info->param_data_size_resolution);
+    ofs += sizeof(packet_resolution_param_t);
+  }
+
   /* read token from packet if present */
   result->token = NULL;
+  result->token_size = 0;
   if (ofs < param_buf_length) {
     const size_t token_size = param_buf_length-ofs;
     if (token_size) {
       result->token = malloc(token_size);
       assert(result->token);
       memcpy(result->token, &cdata[ofs], token_size);
+      result->token_size = token_size;
     }
   }
 
-  const void *elements = (const void *)&cdata[param_buf_length];
+  const packet_overflow_entry_t *overflow_table =
+    (const packet_overflow_entry_t *)&cdata[param_buf_length];
+  const size_t overflow_size = overflow_entries*sizeof(*overflow_table);
+  const void *elements = (const void *)&cdata[param_buf_length + overflow_size];
+
+  result->seq               = 0;
+  result->backlog           = 0;
+  result->lost_events       = 0;
+  result->ticks_per_second  = 0;
+  if (type == VALUE_TABLE_TYPE_LIST_MODE) {
+    const packet_list_mode_chunk_t *chunk = elements;
+    result->seq             = letoh16(chunk->seq);
+    result->backlog         = letoh16(chunk->backlog);
+    result->lost_events     = letoh32(chunk->lost_events);
+    result->ticks_per_second = letoh32(chunk->ticks_per_second);
+    elements = (const void *)&cdata[param_buf_length + overflow_size +
+                                     sizeof(*chunk)];
+  }
+
+  result->first_sample      = 0;
+  result->flags             = 0;
+  if (type == VALUE_TABLE_TYPE_SAMPLE_BLOCK) {
+    const packet_sample_block_t *block = elements;
+    result->seq             = letoh16(block->seq);
+    result->first_sample    = letoh32(block->first_sample);
+    result->flags           = block->flags;
+    /* a flushed last element may hold less than 4 packed samples */
+    const size_t samples    = letoh16(block->samples);
+    if (samples < result->element_count) {
+      result->element_count = samples;
+    }
+    elements = (const void *)&cdata[param_buf_length + overflow_size +
+                                     sizeof(*block)];
+  }
+
+  result->pre_samples       = 0;
+  if (type == VALUE_TABLE_TYPE_TRIGGER_WINDOW) {
+    const packet_trigger_window_t *window = elements;
+    result->seq             = letoh16(window->seq);
+    result->pre_samples     = letoh16(window->pre_samples);
+    result->first_sample    = letoh32(window->first_sample);
+    /* the last packed element may hold less than 4 samples */
+    const size_t samples    = letoh16(window->samples);
+    if (samples < result->element_count) {
+      result->element_count = samples;
+    }
+    elements = (const void *)&cdata[param_buf_length + overflow_size +
+                                     sizeof(*window)];
+  }
 
   if (!elements) {
     memset(result->elements, '\0', sizeof(result->elements[0])*element_count);
@@ -131,50 +247,15 @@ packet_value_table_t *packet_value_table_new(const packet_value_table_reason_t r
       result->elements[i] = v;
     }
     break;
-   /* for 12 bit 4 adjacent 12 bit samples (A,B,C,D) are coded as follows:
-    * [a|a|a|b], [b|b|c|c], [c|d|d|d]
-    */
   case 12:
-    if (1){
-    uint32_t v;
-    uint32_t temp = 0;
-    state_compress_t state = STATE_A;
-    uint32_t j = 0;
-    for (size_t i=0; j<element_count; i++) {
-     switch (state) {
-         case (STATE_A) :
-             temp = ((((uint32_t)e8[2*i+0]) << 0) +
-                    (((uint32_t)e8[2*i+1]) << 8));
-             result->elements[j] = (temp >> 4);
-             j++;
-             state = STATE_B;
-         break;
-         case (STATE_B) :
-             v = (temp << 8) & 0x0f00;
-             temp = ((((uint32_t)e8[2*i+0]) << 0) +
-                    (((uint32_t)e8[2*i+1]) << 8));
-             v = v + (temp >> 8);
-             result->elements[j] = v;
-             j++;
-             state = STATE_C;
-         break;
-         case (STATE_C) :
-             v = (temp & 0x00ff);
-             temp = ((((uint32_t)e8[2*i+0]) << 0) +
-                    (((uint32_t)e8[2*i+1]) << 8));
-             v = (v << 4) + (temp >> 12);
-             result->elements[j] = v;
-             j++;
-             result->elements[j] = (((((uint32_t)e8[2*i+0]) << 0) +
-                                   (((uint32_t)e8[2*i+1]) << 8)) & 0x0fff);
-             j++;
-             state = STATE_A;
-         default:
-
-         break;
+    /* see sample-packing.h for the format */
+    if (1) {
+      sample_unpacker_t unpacker;
+      sample_unpacker_init(&unpacker, e8);
+      for (size_t i=0; i<element_count; i++) {
+        result->elements[i] = sample_unpacker_get(&unpacker);
       }
     }
-    }
     break;
   case 16:
     for (size_t i=0; i<element_count; i++) {
@@ -209,10 +290,118 @@ packet_value_table_t *packet_value_table_new(const packet_value_table_reason_t r
     break;
   }
 
+  for (size_t i=0; i<overflow_entries; i++) {
+    packet_value_table_add_carry(result,
+                                 letoh16(overflow_table[i].index),
+                                 letoh32(overflow_table[i].carry));
+  }
+
   return result;
 }
 
 
+packet_value_table_t *packet_value_table_new_zeroed(const packet_value_table_reason_t reason,
+                                                    const packet_value_table_type_t type,
+                                                    const time_t receive_time,
+                                                    const size_t element_count,
+                                                    const unsigned int duration)
+{
+  packet_value_table_t *result =
+    calloc(1, sizeof(packet_value_table_t)+element_count*sizeof(uint32_t));
+  assert(result != NULL);
+
+  result->refs              = 1;
+  result->reason            = reason;
+  result->type              = type;
+  result->receive_time      = receive_time;
+  result->element_count     = element_count;
+  result->orig_bits_per_value = 32;
+  result->duration          = duration;
+  result->total_duration    = -1;
+  result->skip_samples      = -1;
+  result->token             = NULL;
+  return result;
+}
+
+
+packet_value_table_t *packet_value_table_append(const packet_value_table_t *series,
+                                                const packet_value_table_t *tail)
+{
+  assert(tail->bin_width == 1);
+  assert(tail->first_bin <= series->element_count);
+  const size_t tail_end = tail->first_bin + tail->element_count;
+  const size_t element_count =
+    (tail_end > series->element_count) ? tail_end : series->element_count;
+  packet_value_table_t *result =
+    malloc(sizeof(packet_value_table_t)+element_count*sizeof(uint32_t));
+  assert(result != NULL);
+
+  memcpy(result, tail, sizeof(*result));
+  result->refs              = 1;
+  result->element_count     = element_count;
+  result->first_bin         = 0;
+  result->bin_width         = 0;
+  result->token             = NULL;
+  if (tail->token) {
+    result->token = malloc(tail->token_size);
+    assert(result->token);
+    memcpy(result->token, tail->token, tail->token_size);
+  }
+  memcpy(&result->elements[0], &series->elements[0],
+         series->element_count*sizeof(uint32_t));
+  memcpy(&result->elements[tail->first_bin], &tail->elements[0],
+         tail->element_count*sizeof(uint32_t));
+  return result;
+}
+
+
+double packet_value_table_elapsed_time(const packet_value_table_t *value_table_packet)
+{
+  if (value_table_packet->timebase_clock) {
+    return ((double)value_table_packet->elapsed_ticks) /
+      value_table_packet->timebase_clock;
+  }
+  if (personality_info && personality_info->units_per_second) {
+    return ((double)value_table_packet->duration) /
+      personality_info->units_per_second;
+  }
+  return value_table_packet->duration;
+}
+
+
+bool packet_value_table_measurement_changed(const packet_value_table_measurement_t *self,
+                                            const packet_value_table_t *value_table_packet)
+{
+  if (!self->valid) {
+    return true;
+  }
+  if (value_table_packet->token_size == sizeof(time_t)) {
+    time_t start_time;
+    memcpy(&start_time, value_table_packet->token, sizeof(start_time));
+    if (!self->has_start_time || (start_time != self->start_time)) {
+      return true;
+    }
+  } else if (self->has_start_time) {
+    return true;
+  }
+  return (packet_value_table_elapsed_time(value_table_packet) <
+          self->elapsed_time);
+}
+
+
+void packet_value_table_measurement_update(packet_value_table_measurement_t *self,
+                                           const packet_value_table_t *value_table_packet)
+{
+  self->valid = true;
+  self->has_start_time = (value_table_packet->token_size == sizeof(time_t));
+  if (self->has_start_time) {
+    memcpy(&self->start_time, value_table_packet->token,
+           sizeof(self->start_time));
+  }
+  self->elapsed_time = packet_value_table_elapsed_time(value_table_packet);
+}
+
+
 void packet_value_table_ref(packet_value_table_t *value_table_packet)
 {
   assert(value_table_packet->refs > 0);
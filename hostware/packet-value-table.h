@@ -25,6 +25,7 @@
 #ifndef FREEMCAN_PACKET_VALUE_TABLE_H
 #define FREEMCAN_PACKET_VALUE_TABLE_H
 
+#include <stdbool.h>
 #include <time.h>
 
 #include "packet-defs.h"
@@ -54,17 +55,77 @@ typedef struct {
    * time spent recording the last item in the time series. */
   unsigned int duration;
 
+  /** Time since start of measurement in timebase clock ticks. Only
+   * defined if timebase_clock is non-zero. */
+  uint64_t elapsed_ticks;
+
+  /** Frequency of the device timebase clock in Hz. 0 if the
+   * personality has no timebase. */
+  uint32_t timebase_clock;
+
   /** Total scheduled duration of the measurement in progress, or the
    * time spent recording all but the last item in the time
    * series. "-1" if undefined. */
   unsigned int total_duration;
 
+  /** Dead time accumulated during the measurement in milliseconds.
+   * 0 if the personality does not account for dead time. */
+  unsigned int dead_time;
+
+  /** Number of triggers which arrived while the device was busy */
+  unsigned int busy_triggers;
+
+  /** Push sequence number, 0 if the value table has not been pushed */
+  unsigned int push_seq;
+
+  /** First bin of a range value table (#FRAME_CMD_TABLE_RANGE) */
+  unsigned int first_bin;
+
+  /** Number of bins summed up in each element of a range value
+   * table, 0 for a complete value table */
+  unsigned int bin_width;
+
+  /** Number of table elements which have wrapped around on the
+   * device and whose counts have been restored from the overflow
+   * table */
+  unsigned int overflow_entries;
+
+  /** Sequence number of the list mode chunk, sample block or trigger
+   * window */
+  unsigned int seq;
+
+  /** Records left in the device's list mode ring buffer after this chunk */
+  unsigned int backlog;
+
+  /** Events dropped by the device since start of measurement */
+  unsigned int lost_events;
+
+  /** Frequency of the list mode timestamp clock in Hz. 0 if undefined. */
+  unsigned int ticks_per_second;
+
+  /** Stream index of the first sample of a sample block or trigger
+   * window (wraps around at 2^32) */
+  unsigned int first_sample;
+
+  /** Sample block flags (SAMPLE_BLOCK_FLAG_*) */
+  unsigned int flags;
+
+  /** Number of samples before the trigger sample in a trigger window */
+  unsigned int pre_samples;
+
   /** Skip samples value. "-1" if undefined. */
   unsigned int skip_samples;
 
+  /** Sample period from the measurement command [sample clock ticks],
+   *  0 for the firmware default */
+  uint32_t sample_period;
+
   /** Token bytes (value sent back unchanged) */
   char *token;
 
+  /** Size of the token in bytes */
+  size_t token_size;
+
   /** Value table array (native endian uint32_t) */
   uint32_t elements[];
 } packet_value_table_t;
@@ -79,10 +140,30 @@ typedef struct {
  * \param element_count The number of elements received from device.
  * \param _duration The duration of the measurement which produced
  *                  the data in elements.
+ * \param _elapsed_ticks The time since start of measurement in
+ *                       timebase clock ticks.
+ * \param _timebase_clock The timebase clock frequency in Hz, 0 if
+ *                        the device has no timebase.
+ * \param _dead_time The dead time in milliseconds accumulated during
+ *                   _duration.
+ * \param _busy_triggers The number of triggers which arrived while
+ *                       the device was busy.
+ * \param _push_seq The push sequence number, 0 if not pushed.
+ * \param _first_bin The first bin of a range value table.
+ * \param _bin_width The number of bins per element of a range value
+ *                   table, 0 for a complete value table.
+ * \param overflow_entries The number of overflow table entries.
  * \param param_buf_length Length of parameter buffer in bytes.
  * \param data Pointer to the remaining memory as received from the
  *             device. The memory contains first the parameter buffer
- *             followed by the actual value table.
+ *             and the overflow table followed by the actual value
+ *             table. The overflow table carries are added to the
+ *             elements. For list mode
+ *             value tables, the value table starts with a
+ *             #packet_list_mode_chunk_t header, for sample stream
+ *             value tables with a #packet_sample_block_t header, for trigger
+ *             window value tables with a #packet_trigger_window_t
+ *             header.
  *             A NULL pointer is interpreted like an
  *             array consisting entirely of zeros.
  *
@@ -98,13 +179,104 @@ packet_value_table_t *packet_value_table_new(const packet_value_table_reason_t r
                                              const time_t receive_time,
                                              const uint8_t bits_per_value,
                                              const size_t element_count,
-                                             const uint16_t _duration,
+                                             const uint32_t _duration,
+                                             const uint64_t _elapsed_ticks,
+                                             const uint32_t _timebase_clock,
+                                             const uint32_t _dead_time,
+                                             const uint32_t _busy_triggers,
+                                             const uint16_t _push_seq,
+                                             const uint16_t _first_bin,
+                                             const uint16_t _bin_width,
+                                             const uint8_t overflow_entries,
                                              const uint8_t param_buf_length,
                                              const void *data)
   __attribute__((warn_unused_result))
   __attribute__((malloc));
 
 
+/** Create a new packet_value_table_t instance with all elements zero.
+ *
+ * For value tables generated by the hostware itself, e.g. from list
+ * mode data. All values not given as parameters are undefined ("-1")
+ * or zero.
+ */
+packet_value_table_t *packet_value_table_new_zeroed(const packet_value_table_reason_t reason,
+                                                    const packet_value_table_type_t type,
+                                                    const time_t receive_time,
+                                                    const size_t element_count,
+                                                    const unsigned int duration)
+  __attribute__((warn_unused_result))
+  __attribute__((malloc));
+
+
+/** Create a new value table from a value table and a range of bins
+ *  following on from it
+ *
+ * The result has the elements of series, with the elements of tail
+ * put in place from the first bin of tail on (a time series never
+ * shrinks, so series elements beyond tail are kept). All other
+ * values are taken from tail, as they describe the state of the measurement when tail has
+ * been sent. This is how the tail of a #VALUE_TABLE_TYPE_TIME_SERIES
+ * is appended to the time series received so far.
+ *
+ * \param series Complete value table
+ * \param tail Range value table with a bin width of 1, first_bin
+ *             must not be beyond the end of series.
+ */
+packet_value_table_t *packet_value_table_append(const packet_value_table_t *series,
+                                                const packet_value_table_t *tail)
+  __attribute__((nonnull(1,2)))
+  __attribute__((warn_unused_result))
+  __attribute__((malloc));
+
+
+/** Time since start of measurement in seconds
+ *
+ * Exact if the device has a timebase, otherwise the duration, which
+ * counts in units of 1/units_per_second seconds (whole seconds
+ * without personality info).
+ */
+double packet_value_table_elapsed_time(const packet_value_table_t *value_table)
+  __attribute__((nonnull(1)));
+
+
+/** Measurement a series of value table packets belongs to
+ *
+ * List mode chunks and sample blocks carry a 16 bit sequence number,
+ * which wraps around and therefore cannot tell where a new
+ * measurement starts. The measurement token (the start time sent
+ * with the measure command) can. Without a token, the time since the
+ * start of the measurement going backwards is taken as a new start.
+ */
+typedef struct {
+  /** A packet has been seen */
+  bool valid;
+  /** start_time holds the token of the measurement */
+  bool has_start_time;
+  /** Start time of the measurement from the token */
+  time_t start_time;
+  /** Time since start of measurement of the last packet in seconds */
+  double elapsed_time;
+} packet_value_table_measurement_t;
+
+
+/** Check whether a packet starts another measurement
+ *
+ * eturn true if value_table belongs to a measurement other than
+ *         the packets seen by self so far, or if self has not seen
+ *         any packets yet.
+ */
+bool packet_value_table_measurement_changed(const packet_value_table_measurement_t *self,
+                                            const packet_value_table_t *value_table)
+  __attribute__((nonnull(1,2)));
+
+
+/** Take note of a packet of the measurement */
+void packet_value_table_measurement_update(packet_value_table_measurement_t *self,
+                                           const packet_value_table_t *value_table)
+  __attribute__((nonnull(1,2)));
+
+
 /** Call this when you want to use value_table and store a pointer to it. */
 void packet_value_table_ref(packet_value_table_t *value_table)
   __attribute__((nonnull(1)));
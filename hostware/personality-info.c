@@ -43,6 +43,16 @@ personality_info_t *personality_info_new(const uint16_t _sizeof_table,
                                          const uint8_t units_per_second,
                                          const uint8_t param_data_size_timer_count,
                                          const uint8_t param_data_size_skip_samples,
+                                         const uint8_t param_data_size_trigger,
+                                         const uint8_t param_data_size_sample_period,
+                                         const uint8_t param_data_size_roi,
+                                         const uint8_t param_data_size_resolution,
+                                         const uint32_t _sample_clock,
+                                         const uint32_t _min_sample_period,
+                                         const uint32_t _max_sample_period,
+                                         const uint32_t _burst_sample_period,
+                                         const uint8_t min_resolution,
+                                         const uint8_t max_resolution,
                                          const uint16_t _personality_name_size,
                                          const char *personality_name)
 {
@@ -57,6 +67,16 @@ personality_info_t *personality_info_new(const uint16_t _sizeof_table,
   result->units_per_second = units_per_second;
   result->param_data_size_timer_count = param_data_size_timer_count;
   result->param_data_size_skip_samples = param_data_size_skip_samples;
+  result->param_data_size_trigger = param_data_size_trigger;
+  result->param_data_size_sample_period = param_data_size_sample_period;
+  result->param_data_size_roi = param_data_size_roi;
+  result->param_data_size_resolution = param_data_size_resolution;
+  result->sample_clock = letoh32(_sample_clock);
+  result->min_sample_period = letoh32(_min_sample_period);
+  result->max_sample_period = letoh32(_max_sample_period);
+  result->burst_sample_period = letoh32(_burst_sample_period);
+  result->min_resolution = min_resolution;
+  result->max_resolution = max_resolution;
   result->personality_name[0] = '\0';
   strncat(result->personality_name, personality_name, pn_size);
 
@@ -38,6 +38,20 @@ typedef struct {
   unsigned int units_per_second;
   size_t param_data_size_timer_count;
   size_t param_data_size_skip_samples;
+  size_t param_data_size_trigger;
+  size_t param_data_size_sample_period;
+  size_t param_data_size_roi;
+  size_t param_data_size_resolution;
+  /** Clock the sample period parameter counts in [Hz] */
+  uint32_t sample_clock;
+  /** Sample period range [sample_clock ticks] */
+  uint32_t min_sample_period;
+  uint32_t max_sample_period;
+  /** Sample period in burst mode [sample_clock ticks], 0 if none */
+  uint32_t burst_sample_period;
+  /** Histogram resolution range [bits], 0 if none */
+  unsigned int min_resolution;
+  unsigned int max_resolution;
   char personality_name[];
 } personality_info_t;
 
@@ -49,10 +63,20 @@ personality_info_t *personality_info_new(const uint16_t _sizeof_table,
                                          const uint8_t units_per_second,
                                          const uint8_t param_data_size_timer_count,
                                          const uint8_t param_data_size_skip_samples,
+                                         const uint8_t param_data_size_trigger,
+                                         const uint8_t param_data_size_sample_period,
+                                         const uint8_t param_data_size_roi,
+                                         const uint8_t param_data_size_resolution,
+                                         const uint32_t _sample_clock,
+                                         const uint32_t _min_sample_period,
+                                         const uint32_t _max_sample_period,
+                                         const uint32_t _burst_sample_period,
+                                         const uint8_t min_resolution,
+                                         const uint8_t max_resolution,
                                          const uint16_t _personality_name_size,
                                          const char *personality_name)
   __attribute__(( warn_unused_result ))
-  __attribute__(( nonnull(7) ))
+  __attribute__(( nonnull(17) ))
   __attribute__(( malloc ));
 
 
@@ -0,0 +1,199 @@
+/** \file hostware/readout-scheduler.c
+ * \brief Adaptive value table readout scheduling
+ *
+ * \author Copyright (C) 2012 samplemaker
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ *
+ * \defgroup freemcan_readout_scheduler Adaptive Readout Scheduling
+ * \ingroup hostware_generic
+ *
+ * Decides when to read the next intermediate value table while
+ * measuring. The interval is the longest of
+ *
+ *   - the time it takes to collect enough new counts for the target
+ *     statistical precision at the current count rate: a readout
+ *     with N new counts has a relative error of 1/sqrt(N),
+ *   - the time the device's share of the link budget needs to carry
+ *     a value table, from the measured throughput,
+ *   - the measured request to value table latency,
+ *
+ * limited to the configured range. Throughput and latency are
+ * measured from the readouts themselves, nothing is assumed about
+ * the baud rate.
+ *
+ * @{
+ */
+
+#include <string.h>
+
+#include "readout-scheduler.h"
+
+
+/** Give up waiting for a value table after this many latencies */
+#define READOUT_TIMEOUT 4.0
+
+
+/** Weight of a new latency or throughput measurement */
+#define READOUT_WEIGHT 0.5
+
+
+/** Recalculate the interval */
+static
+void readout_scheduler_update(readout_scheduler_t *self)
+{
+  double interval = 0.0;
+  if (self->count_rate > 0.0) {
+    const double counts = 1.0 / (self->precision * self->precision);
+    interval = counts / self->count_rate;
+  } else if (self->count_rate == 0.0) {
+    /* no counts, nothing new to read */
+    interval = self->max_interval;
+  }
+  const readout_link_t *link = self->link;
+  if ((link->throughput > 0.0) && (link->budget > 0.0)) {
+    const double share = link->throughput * link->budget / link->users;
+    const double link_interval = self->table_bytes / share;
+    if (link_interval > interval) {
+      interval = link_interval;
+    }
+  }
+  if (self->latency > interval) {
+    interval = self->latency;
+  }
+  if (interval < self->min_interval) {
+    interval = self->min_interval;
+  } else if (interval > self->max_interval) {
+    interval = self->max_interval;
+  }
+  self->interval = interval;
+}
+
+
+void readout_link_init(readout_link_t *link, const double budget)
+{
+  memset(link, 0, sizeof(*link));
+  link->budget = budget;
+}
+
+
+void readout_scheduler_init(readout_scheduler_t *self, readout_link_t *link,
+                            const double precision,
+                            const double min_interval,
+                            const double max_interval)
+{
+  memset(self, 0, sizeof(*self));
+  self->link = link;
+  self->precision = precision;
+  self->min_interval = min_interval;
+  self->max_interval = max_interval;
+  self->count_rate = -1.0;
+  link->users++;
+  readout_scheduler_update(self);
+}
+
+
+void readout_scheduler_fini(readout_scheduler_t *self)
+{
+  self->link->users--;
+}
+
+
+void readout_scheduler_counts(readout_scheduler_t *self, const double now,
+                              const uint64_t counts)
+{
+  if (counts < self->counts) {
+    /* new measurement */
+    self->counts = 0;
+    self->counts_time = 0.0;
+    self->count_rate = -1.0;
+  }
+  if ((counts == 0) && (self->count_rate < 0.0)) {
+    /* not tracked by the device, or no counts yet */
+    self->counts_time = now;
+    return;
+  }
+  if ((self->counts_time > 0.0) && (now > self->counts_time)) {
+    self->count_rate = (counts - self->counts) / (now - self->counts_time);
+  }
+  self->counts = counts;
+  self->counts_time = now;
+  readout_scheduler_update(self);
+}
+
+
+bool readout_scheduler_due(readout_scheduler_t *self, const double now)
+{
+  if (self->request_sent > 0.0) {
+    const double timeout = (self->latency > 0.0) ?
+      (READOUT_TIMEOUT * self->latency) : self->max_interval;
+    if (now - self->request_sent < timeout) {
+      return false;
+    }
+    /* lost, try again */
+    self->request_sent = 0.0;
+  }
+  return (now - self->last_request >= self->interval);
+}
+
+
+void readout_scheduler_request(readout_scheduler_t *self, const double now)
+{
+  self->request_sent = now;
+  self->last_request = now;
+}
+
+
+void readout_scheduler_table(readout_scheduler_t *self, const double now,
+                             const size_t bytes)
+{
+  self->table_bytes = bytes;
+  if (self->request_sent > 0.0) {
+    const double latency = now - self->request_sent;
+    self->request_sent = 0.0;
+    self->latency = (self->latency > 0.0) ?
+      (READOUT_WEIGHT * latency + (1.0 - READOUT_WEIGHT) * self->latency) :
+      latency;
+    if (latency > 0.0) {
+      /* includes the device's response time, so this errs on the
+       * safe side */
+      const double throughput = bytes / latency;
+      readout_link_t *link = self->link;
+      link->throughput = (link->throughput > 0.0) ?
+        (READOUT_WEIGHT * throughput +
+         (1.0 - READOUT_WEIGHT) * link->throughput) :
+        throughput;
+    }
+  }
+  readout_scheduler_update(self);
+}
+
+
+double readout_scheduler_interval(const readout_scheduler_t *self)
+{
+  return self->interval;
+}
+
+
+/** @} */
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,150 @@
+/** \file hostware/readout-scheduler.h
+ * \brief Adaptive value table readout scheduling (interface)
+ *
+ * \author Copyright (C) 2012 samplemaker
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ *
+ * \addtogroup freemcan_readout_scheduler
+ * @{
+ */
+
+#ifndef FREEMCAN_READOUT_SCHEDULER_H
+#define FREEMCAN_READOUT_SCHEDULER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/** A serial link, possibly shared by several devices */
+typedef struct {
+  /** Fraction of the link throughput value table readouts may use */
+  double budget;
+  /** Measured value table throughput [bytes/s], 0 if unknown */
+  double throughput;
+  /** Number of schedulers sharing the link */
+  unsigned int users;
+} readout_link_t;
+
+
+/** Readout scheduling state of one device */
+typedef struct {
+  /** The link the device is connected to */
+  readout_link_t *link;
+  /** Target relative statistical error of the counts in a readout */
+  double precision;
+  /** Interval range [s] */
+  double min_interval, max_interval;
+  /** Measured request to value table latency [s], 0 if unknown */
+  double latency;
+  /** Size of the last value table frame [bytes] */
+  size_t table_bytes;
+  /** Host time of the outstanding request, 0 if there is none */
+  double request_sent;
+  /** Host time of the last request */
+  double last_request;
+  /** Count rate [1/s], negative if unknown */
+  double count_rate;
+  /** Host time and total counts of the last count update */
+  double counts_time;
+  uint64_t counts;
+  /** Current readout interval [s] */
+  double interval;
+} readout_scheduler_t;
+
+
+/** Initialize a link
+ *
+ * \param budget Fraction of the throughput value tables may use (0..1]
+ */
+void readout_link_init(readout_link_t *link, const double budget)
+  __attribute__((nonnull(1)));
+
+
+/** Initialize a scheduler and attach it to a link
+ *
+ * \param precision Target relative statistical error of the new
+ *                  counts in each readout, e.g. 0.05 for 400 counts
+ * \param min_interval Shortest readout interval [s]
+ * \param max_interval Longest readout interval [s]
+ */
+void readout_scheduler_init(readout_scheduler_t *self, readout_link_t *link,
+                            const double precision,
+                            const double min_interval,
+                            const double max_interval)
+  __attribute__((nonnull(1,2)));
+
+
+/** Detach a scheduler from its link */
+void readout_scheduler_fini(readout_scheduler_t *self)
+  __attribute__((nonnull(1)));
+
+
+/** Update the count rate from the total counts of the measurement
+ *
+ * The rate is taken from the counts since the last update alone, so
+ * the interval follows a change of the rate within one update.
+ * Counts going backwards start a new measurement. Counts which have
+ * never been non-zero are taken as not tracked by the device.
+ */
+void readout_scheduler_counts(readout_scheduler_t *self, const double now,
+                              const uint64_t counts)
+  __attribute__((nonnull(1)));
+
+
+/** Whether the next readout is due
+ *
+ * Only one request is outstanding at a time, so requests are never
+ * queued faster than the link drains them. A request which has not
+ * been answered within #READOUT_TIMEOUT latencies is given up.
+ */
+bool readout_scheduler_due(readout_scheduler_t *self, const double now)
+  __attribute__((nonnull(1)));
+
+
+/** Note that a value table has been requested */
+void readout_scheduler_request(readout_scheduler_t *self, const double now)
+  __attribute__((nonnull(1)));
+
+
+/** Note that the requested value table has arrived
+ *
+ * Updates the latency and the link throughput.
+ *
+ * \param bytes Size of the value table frame
+ */
+void readout_scheduler_table(readout_scheduler_t *self, const double now,
+                             const size_t bytes)
+  __attribute__((nonnull(1)));
+
+
+/** Current readout interval [s] */
+double readout_scheduler_interval(const readout_scheduler_t *self)
+  __attribute__((nonnull(1)));
+
+
+/** @} */
+
+#endif /* !FREEMCAN_READOUT_SCHEDULER_H */
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,103 @@
+/** \file hostware/sample-stream.c
+ * \brief Sample stream reassembly
+ *
+ * \author Copyright (C) 2012 samplemaker
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ *
+ * \defgroup freemcan_sample_stream Sample Stream
+ * \ingroup hostware_generic
+ *
+ * The streaming data logger sends its samples as a sequence of
+ * blocks, each one a value table packet of type
+ * #VALUE_TABLE_TYPE_SAMPLE_BLOCK. Every block carries the stream
+ * index of its first sample, so the position of every sample in the
+ * stream is known even after samples have been dropped on the device
+ * or blocks have been lost in transmission.
+ *
+ * The device's 32 bit stream index is extended to 64 bit here.
+ *
+ * @{
+ */
+
+#include <string.h>
+
+#include "sample-stream.h"
+#include "freemcan-log.h"
+
+
+void sample_stream_reset(sample_stream_t *self)
+{
+  memset(self, 0, sizeof(*self));
+}
+
+
+uint64_t sample_stream_add_block(sample_stream_t *self,
+                                 const packet_value_table_t *value_table_packet,
+                                 uint64_t *missing)
+{
+  const unsigned int seq = value_table_packet->seq;
+
+  if (packet_value_table_measurement_changed(&self->measurement,
+                                             value_table_packet)) {
+    sample_stream_reset(self);
+  }
+  packet_value_table_measurement_update(&self->measurement,
+                                        value_table_packet);
+  if (seq != self->next_seq) {
+    const unsigned int missed = (seq - self->next_seq) & 0xffff;
+    fmlog("Sample stream: %u block(s) missing before block %u",
+          missed, seq);
+    self->missed_blocks += missed;
+  }
+  self->next_seq = (seq + 1) & 0xffff;
+
+  const size_t count = value_table_packet->element_count;
+  if (count == 0) {
+    /* nothing sampled since the last block */
+    *missing = 0;
+    return self->next_sample;
+  }
+
+  const uint32_t gap =
+    ((uint32_t)value_table_packet->first_sample) - ((uint32_t)self->next_sample);
+  const uint64_t first = self->next_sample + gap;
+  if (value_table_packet->flags & SAMPLE_BLOCK_FLAG_OVERRUN) {
+    self->overruns++;
+  }
+  if (gap) {
+    fmlog("Sample stream: %u samples missing before block %u%s",
+          gap, seq,
+          (value_table_packet->flags & SAMPLE_BLOCK_FLAG_OVERRUN) ?
+          " (device overrun)" : "");
+  }
+  self->missing_samples += gap;
+  self->samples += count;
+  self->next_sample = first + count;
+  *missing = gap;
+  return first;
+}
+
+
+/** @} */
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
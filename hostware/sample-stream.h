@@ -0,0 +1,87 @@
+/** \file hostware/sample-stream.h
+ * \brief Sample stream reassembly (interface)
+ *
+ * \author Copyright (C) 2012 samplemaker
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ *
+ * \addtogroup freemcan_sample_stream
+ * @{
+ */
+
+#ifndef FREEMCAN_SAMPLE_STREAM_H
+#define FREEMCAN_SAMPLE_STREAM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "packet-defs.h"
+#include "packet-value-table.h"
+
+
+/** Sample stream state carried from block to block */
+typedef struct {
+  /** Measurement the blocks received so far belong to */
+  packet_value_table_measurement_t measurement;
+  /** Sequence number expected for the next block */
+  unsigned int next_seq;
+  /** Number of blocks missed (sequence number gaps) */
+  unsigned int missed_blocks;
+  /** Number of device overruns (blocks with
+   *  #SAMPLE_BLOCK_FLAG_OVERRUN set) */
+  unsigned int overruns;
+  /** Stream index expected for the first sample of the next block */
+  uint64_t next_sample;
+  /** Number of samples missing in the stream so far */
+  uint64_t missing_samples;
+  /** Number of samples received */
+  uint64_t samples;
+} sample_stream_t;
+
+
+/** Reset stream for a new measurement */
+void sample_stream_reset(sample_stream_t *self)
+  __attribute__((nonnull(1)));
+
+
+/** Place a sample block value table packet in the stream
+ *
+ * Resets the stream on the first block of a new measurement (see
+ * packet_value_table_measurement_changed()). The block's samples
+ * belong to the stream indices starting at the returned index.
+ *
+ * \param missing Set to the number of samples missing right before
+ *                this block, be it from dropped samples on the
+ *                device or from blocks lost in transmission.
+ * \return Stream index of the first sample of the block
+ */
+uint64_t sample_stream_add_block(sample_stream_t *self,
+                                 const packet_value_table_t *value_table_packet,
+                                 uint64_t *missing)
+  __attribute__((nonnull(1,2,3)));
+
+
+/** @} */
+
+#endif /* !FREEMCAN_SAMPLE_STREAM_H */
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
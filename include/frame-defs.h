@@ -104,7 +104,8 @@
  * <table class="table header-top">
  *  <tr><th>size in bytes</th> <th>value</th> <th>C type define</th> <th>description</th></tr>
  *  <tr><td>4</td> <td>#FRAME_MAGIC_LE_U32<br>or #FRAME_MAGIC_STR</td> <td>uint32_t or uint8_t[4]</td> <td>magic value marking beginning of frame</td></tr>
- *  <tr><td>1</td> <td>command</td> <td>#frame_cmd_t</td> <td>frame command</td></tr>
+ *  <tr><td>1</td> <td>command</td> <td>#frame_cmd_t</td> <td>frame command, or'ed with #FRAME_CMD_SEQ_FLAG if a sequence ID follows</td></tr>
+ *  <tr><td>0 or 1</td> <td>seq</td> <td>uint8_t</td> <td>sequence ID (1 to 255), only with #FRAME_CMD_SEQ_FLAG</td></tr>
  *  <tr><td>1</td> <td>length</td> <td>uint8_t</td> <td>length of command parameters (0 or more)</td></tr>
  *  <tr><td><em>length</em></td> <td>params</td> <td>uint8_t []</td> <td>command parameters (or or more bytes)</td></tr>
  *  <tr><td>1</td> <td>checksum</td> <td>uint8_t</td> <td>checksum over all bytes beginning with magic value</td></tr>
@@ -116,6 +117,24 @@
  * the firmware personality info packet (#FRAME_CMD_PERSONALITY_INFO)
  * to determine the number and layout of the parameter bytes.
  *
+ * #FRAME_CMD_SUBSCRIBE, #FRAME_CMD_RESEND_CHUNKS and
+ * #FRAME_CMD_TABLE_RANGE are the exceptions: They always take a
+ * #packet_subscribe_param_t, #packet_resend_chunks_param_t and
+ * #packet_table_range_param_t, respectively, regardless of the
+ * personality.
+ *
+ * \subsection frame_seq Sequence IDs
+ *
+ * The sequence ID is optional. The device sends all frames it sends
+ * in reply to a command with a sequence ID with that sequence ID
+ * (see #FRAME_TYPE_SEQ_FLAG). Frames not sent in reply to such a
+ * command (pushed frames, "measurement finished") have none. This
+ * lets the host have several commands in flight and match the
+ * replies to the commands.
+ *
+ * The last frame of a reply is the state frame, or the single reply
+ * frame of the commands which have no state reply.
+ *
  * \subsection frame_emb_to_host Frames sent from firmware to hostware
  *
  * <table class="table header-top">
@@ -123,7 +142,8 @@
  *
  *  <tr><td>4</td> <td>#FRAME_MAGIC_LE_U32<br>or #FRAME_MAGIC_STR</td> <td>uint32_t or uint8_t[4]</td> <td>magic value marking beginning of frame</td></tr>
  *  <tr><td>2</td> <td>payload_size</td> <td>uint16_t</td> <td>size of payload data in bytes</td></tr>
- *  <tr><td>1</td> <td>frame_type</td> <td>#frame_type_t</td> <td>frame type</td></tr>
+ *  <tr><td>1</td> <td>frame_type</td> <td>#frame_type_t</td> <td>frame type, or'ed with #FRAME_TYPE_SEQ_FLAG if a sequence ID follows</td></tr>
+ *  <tr><td>0 or 1</td> <td>seq</td> <td>uint8_t</td> <td>sequence ID of the command this frame replies to, only with #FRAME_TYPE_SEQ_FLAG</td></tr>
  *  <tr><td><em>payload_size</em></td> <td>payload</td> <td>uint8_t []</td> <td>payload data</td></tr>
  *  <tr><td>1</td> <td>checksum</td><td>uint8_t</td> <td>checksum over all bytes beginning with magic value</td></tr>
  * </table>
@@ -155,9 +175,23 @@
  *   - "FMpf"
  *   - "FMpk"
  *   - "FMpk"
+ *   - "FMpX"
  *   - "FMpx"
+ *   - "FMpY"
+ *   - "FMpZ"
+ *   - "FMpW"
+ *   - "FMpV"
+ *   - "FMpU"
  */
-#define FRAME_MAGIC_STR "FMpX"
+#define FRAME_MAGIC_STR "FMpT"
+
+
+/** Command byte flag: A sequence ID follows the command byte */
+#define FRAME_CMD_SEQ_FLAG 0x80
+
+
+/** Frame type byte flag: A sequence ID follows the frame type byte */
+#define FRAME_TYPE_SEQ_FLAG 0x80
 
 
 /** Data frame types (data frame to host)
@@ -179,7 +213,22 @@ typedef enum {
   FRAME_TYPE_VALUE_TABLE = 'V',
 
   /** Device state message */
-  FRAME_TYPE_STATE = 'S'
+  FRAME_TYPE_STATE = 'S',
+
+  /** Device timebase (#packet_time_sync_t) */
+  FRAME_TYPE_TIME_SYNC = 'Y',
+
+  /** ISR profile (#packet_isr_profile_header_t) */
+  FRAME_TYPE_ISR_PROFILE = 'I',
+
+  /** Region of interest sums (#packet_roi_summary_t) */
+  FRAME_TYPE_ROI_SUMMARY = 'O',
+
+  /** Measurement status (#packet_status_t) */
+  FRAME_TYPE_STATUS = 'U',
+
+  /** Chunk of a chunked value table (#packet_table_chunk_t) */
+  FRAME_TYPE_TABLE_CHUNK = 'K'
 
 } frame_type_t;
 
@@ -218,7 +267,37 @@ typedef enum {
   FRAME_CMD_STATE = 's',
 
   /** Reset device */
-  FRAME_CMD_RESET = 'r'
+  FRAME_CMD_RESET = 'r',
+
+  /** Request the device timebase (#FRAME_TYPE_TIME_SYNC reply, no
+   *  state reply) */
+  FRAME_CMD_TIME_SYNC = 'y',
+
+  /** Request the ISR profile (#FRAME_TYPE_ISR_PROFILE reply, no state
+   *  reply) */
+  FRAME_CMD_ISR_PROFILE = 'p',
+
+  /** Request the region of interest sums (#FRAME_TYPE_ROI_SUMMARY
+   *  reply, no state reply) */
+  FRAME_CMD_ROI_SUMMARY = 'o',
+
+  /** Request the measurement status (#FRAME_TYPE_STATUS reply, no
+   *  state reply) */
+  FRAME_CMD_STATUS = 'u',
+
+  /** Have the device push value tables or status frames while
+   *  measuring (#packet_subscribe_param_t parameter, state reply) */
+  FRAME_CMD_SUBSCRIBE = 'S',
+
+  /** Send chunks of a chunked value table again
+   *  (#packet_resend_chunks_param_t parameter, #FRAME_TYPE_TABLE_CHUNK
+   *  replies, state reply) */
+  FRAME_CMD_RESEND_CHUNKS = 'k',
+
+  /** Send a range of bins of the value table, optionally summing up
+   *  adjacent bins (#packet_table_range_param_t parameter, value
+   *  table reply while measuring or done, state reply) */
+  FRAME_CMD_TABLE_RANGE = 'b'
 
 } frame_cmd_t;
 
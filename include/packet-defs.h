@@ -33,20 +33,113 @@
  * packet data size (i.e. the frame's payload size) by subtracting the
  * size of the #packet_value_table_header_t header that is sent in
  * front of the actual value table data, and then subtracting the
- * param_buf_length as taken from the header.
+ * param_buf_length and the overflow table as taken from the header.
  *
  * <table class="table header-top">
  *  <tr><th>size in bytes</th> <th>name</th> <th>C type define</th> <th>description</th></tr>
  *  <tr><td>sizeof(packet_value_table_header_t)</td> <td>header</td> <td>packet_value_table_header_t</td> <td>value table packet header</td></tr>
  *  <tr><td><em>header.param_buf_length</em></td> <td>param_buf</td> <td>uint8_t []</td> <td>firmware sends back the same parameter buffer that started the measurement</td></tr>
+ *  <tr><td><em>header.overflow_entries</em> * sizeof(packet_overflow_entry_t)</td> <td>overflow_table</td> <td>packet_overflow_entry_t []</td> <td>counts lost to table elements which have wrapped around</td></tr>
  *  <tr><td><em>see text</em></td> <td>data_table</td> <td>uintX_t []</td> <td>value table data</td></tr>
  * </table>
  *
- * \section packet_emb_to_host From firmware to hostware: Personality Information packet
+ * \section packet_emb_to_host_overflow From firmware to hostware: Overflow table
+ *
+ * A histogram or time series element which wraps around is promoted
+ * into the overflow table (see status.h): The firmware counts the
+ * counts lost to the wrap around in a #packet_overflow_entry_t. The
+ * host adds the entries' carry to their elements to get the exact
+ * counts. Only if the overflow table is full, or a carry would wrap
+ * around itself, counts are lost, and the status reports
+ * #STATUS_FLAG_OVERFLOW.
+ *
+ * The overflow table is sent before the value table data. An element
+ * which wraps around while the table is being sent during a
+ * measurement is short by a wrap around in that intermediate table.
+ *
+ * \section packet_emb_to_host_chunks From firmware to hostware: Chunked value table packet
+ *
+ * If the header's chunk_size is not 0, the value table packet ends
+ * after the parameter buffer. The value table data follows in
+ * #FRAME_TYPE_TABLE_CHUNK frames of chunk_size bytes each (the last
+ * one may be shorter), each with a #packet_table_chunk_t header in
+ * front of the data. As every chunk is a frame of its own, a
+ * transmission error only costs the chunk it hits. The host asks for
+ * the missing chunks with #FRAME_CMD_RESEND_CHUNKS.
+ *
+ * The firmware sends the chunks again from the current value table,
+ * with the sizes from the header of the table they belong to. While
+ * measuring, they are newer than the rest of the table, like the
+ * values in an intermediate table are not all from the same instant
+ * anyway. Once the measurement is over, they are the same. Only the
+ * last chunked table can be asked for. For an older table ID, the
+ * firmware only replies with its state.
+ *
+ * \section packet_emb_to_host_range From firmware to hostware: Range value table packet
+ *
+ * The reply to #FRAME_CMD_TABLE_RANGE is a value table packet with
+ * only the bins asked for. The header's first_bin is the first bin,
+ * and every element is the sum of bin_width adjacent bins of the
+ * value table (the last element may cover fewer bins). Sums are sent
+ * as 32 bit elements and saturate at 0xffffffff, single bins
+ * (bin_width 1) with the element size of the value table. For complete value tables, bin_width is 0.
+ *
+ * A range with an end beyond the last bin is cut short. This is how
+ * the hostware reads the tail of a #VALUE_TABLE_TYPE_TIME_SERIES: It
+ * asks for all bins from the last one it has seen, which was still
+ * being recorded then.
+ *
+ * \section packet_emb_to_host_list_mode From firmware to hostware: List mode value table packet
+ *
+ * For the #VALUE_TABLE_TYPE_LIST_MODE value table type, the value
+ * table data is a chunk of the event stream: A
+ * #packet_list_mode_chunk_t header followed by a number of 32 bit
+ * list mode records (see #LIST_MODE_RECORD).
+ *
+ * \section packet_emb_to_host_sample_block From firmware to hostware: Sample stream value table packet
+ *
+ * For the #VALUE_TABLE_TYPE_SAMPLE_BLOCK value table type, the value
+ * table data is one block of the sample stream: A
+ * #packet_sample_block_t header followed by the samples packed like
+ * in a #VALUE_TABLE_TYPE_SAMPLES value table.
+ *
+ * \section packet_emb_to_host_trigger_window From firmware to hostware: Trigger window value table packet
+ *
+ * For the #VALUE_TABLE_TYPE_TRIGGER_WINDOW value table type, the
+ * value table data is one captured trigger window: A
+ * #packet_trigger_window_t header followed by the samples packed like
+ * in a #VALUE_TABLE_TYPE_SAMPLES value table.
+ *
+ * \section packet_emb_to_host_pi From firmware to hostware: Personality Information packet
  *
  * The personality information packet just contains a single instance
  * of the #packet_personality_info_t data structure.
  *
+ * \section packet_emb_to_host_ts From firmware to hostware: Time sync packet
+ *
+ * The reply to #FRAME_CMD_TIME_SYNC just contains a single instance
+ * of the #packet_time_sync_t data structure.
+ *
+ * \section packet_emb_to_host_isr From firmware to hostware: ISR profile packet
+ *
+ * The reply to #FRAME_CMD_ISR_PROFILE is a #packet_isr_profile_header_t
+ * followed by one #packet_isr_profile_source_t for every interrupt
+ * source which has been serviced at least once. Firmware built
+ * without the ISR profiler sends the header only, with a stop watch
+ * clock of 0.
+ *
+ * \section packet_emb_to_host_roi From firmware to hostware: ROI summary packet
+ *
+ * The reply to #FRAME_CMD_ROI_SUMMARY just contains a single instance
+ * of the #packet_roi_summary_t data structure.
+ *
+ * \section packet_emb_to_host_status From firmware to hostware: Status packet
+ *
+ * The reply to #FRAME_CMD_STATUS just contains a single instance of
+ * the #packet_status_t data structure. It is small enough to be
+ * polled every second, the host only needs to fetch the value table
+ * when the status shows new counts.
+ *
  */
 
 #ifndef PACKET_DEFS_H
@@ -72,7 +165,16 @@ typedef enum {
   VALUE_TABLE_TYPE_TIME_SERIES = 'T',
 
   /** Timed samples */
-  VALUE_TABLE_TYPE_SAMPLES = 'S'
+  VALUE_TABLE_TYPE_SAMPLES = 'S',
+
+  /** List mode (event-by-event) records, see #packet_list_mode_chunk_t */
+  VALUE_TABLE_TYPE_LIST_MODE = 'L',
+
+  /** Block of a continuous sample stream, see #packet_sample_block_t */
+  VALUE_TABLE_TYPE_SAMPLE_BLOCK = 'B',
+
+  /** Samples around a trigger, see #packet_trigger_window_t */
+  VALUE_TABLE_TYPE_TRIGGER_WINDOW = 'W'
 } packet_value_table_type_t;
 
 
@@ -98,7 +200,16 @@ typedef enum {
 
 
 /** Maximum length of parameter block in bytes */
-#define MAX_PARAM_LENGTH 16
+#define MAX_PARAM_LENGTH 32
+
+
+/** Version of #packet_value_table_header_t
+ *
+ * Sent as the first byte of the header. Increment whenever the header
+ * layout changes so that the hostware can reject headers it does not
+ * understand instead of misinterpreting them.
+ */
+#define VALUE_TABLE_HEADER_VERSION 6
 
 
 /** Value table packet header
@@ -117,19 +228,362 @@ typedef enum {
  *   * native gcc-4.5.1 on i386
  */
 typedef struct {
-  /** value table element size in bits (8,16,24,32) */
+  /** header layout version (#VALUE_TABLE_HEADER_VERSION) */
+  uint8_t  header_version;
+  /** value table element size in bits (8,16,24,32), may be
+   *  narrower than the device's table elements if the values fit */
   uint8_t  bits_per_value;
   /** Reason for sending value table (#packet_value_table_reason_t cast to uint8_t) */
   uint8_t  reason;
   /** Type of value table (#packet_value_table_type_t cast to uint8_t) */
   uint8_t  type;
   /** duration of measurement that lead to the attached data */
-  uint16_t duration;
+  uint32_t duration;
+  /** time since start of measurement in timebase clock ticks */
+  uint64_t elapsed_ticks;
+  /** frequency of the timebase clock in Hz (0 if the personality has
+   * no timebase and elapsed_ticks is undefined) */
+  uint32_t timebase_clock;
+  /** dead time accumulated during the measurement in milliseconds
+   * (0 if the personality does not account for dead time) */
+  uint32_t dead_time;
+  /** number of events whose trigger arrived while the device was
+   * still busy with the previous event. These events have been
+   * counted into the table like all others, so they must not be
+   * added to the counts for dead time correction. */
+  uint32_t busy_triggers;
+  /** push sequence number, 0 if not pushed (see #FRAME_CMD_SUBSCRIBE) */
+  uint16_t push_seq;
+  /** table ID of a chunked value table (see #packet_table_chunk_t) */
+  uint16_t table_id;
+  /** value table data size in bytes */
+  uint16_t table_size;
+  /** chunk size in bytes, 0 if the value table data is not chunked */
+  uint16_t chunk_size;
+  /** first bin of a range value table (#FRAME_CMD_TABLE_RANGE) */
+  uint16_t first_bin;
+  /** bins summed up per element of a range value table, 0 for the
+   *  complete value table */
+  uint16_t bin_width;
+  /** number of #packet_overflow_entry_t after the parameter buffer */
+  uint8_t overflow_entries;
   /** length of the token (a number of bytes sent back unchanged) */
   uint8_t param_buf_length;
 } PACKED packet_value_table_header_t;
 
 
+/** Maximum number of entries in the overflow table */
+#define OVERFLOW_TABLE_SIZE 8
+
+
+/** Overflow table entry
+ *
+ * See \ref packet_emb_to_host_overflow.
+ */
+typedef struct {
+  /** Index of the table element which has wrapped around */
+  uint16_t index;
+  /** Counts lost to the wrap arounds of the element */
+  uint32_t carry;
+} PACKED packet_overflow_entry_t;
+
+
+/** Chunk size of chunked value tables in bytes
+ *
+ * Doubled for tables which would have more than #TABLE_CHUNKS_MAX
+ * chunks otherwise.
+ */
+#define TABLE_CHUNK_SIZE 256
+
+
+/** Maximum number of chunks of a chunked value table */
+#define TABLE_CHUNKS_MAX 32
+
+
+/** Value table chunk header
+ *
+ * Sent in front of the value table data in a #FRAME_TYPE_TABLE_CHUNK
+ * frame.
+ */
+typedef struct {
+  /** Table ID from the value table header */
+  uint16_t table_id;
+  /** Offset of the chunk data in the value table data in bytes */
+  uint16_t offset;
+} PACKED packet_table_chunk_t;
+
+
+/** Parameter of #FRAME_CMD_RESEND_CHUNKS
+ *
+ * This parameter does not depend on the personality.
+ */
+typedef struct {
+  /** Table ID from the value table header */
+  uint16_t table_id;
+  /** Chunks to send again, bit n for the chunk at offset
+   *  n*chunk_size */
+  uint32_t chunk_mask;
+} PACKED packet_resend_chunks_param_t;
+
+
+/** Parameter of #FRAME_CMD_TABLE_RANGE
+ *
+ * This parameter does not depend on the personality.
+ */
+typedef struct {
+  /** First bin */
+  uint16_t start;
+  /** Bin after the last bin (limited to the value table size) */
+  uint16_t end;
+  /** Number of adjacent bins to sum up per element (0 is taken as 1) */
+  uint16_t bin_width;
+} PACKED packet_table_range_param_t;
+
+
+/** List mode chunk header
+ *
+ * Sent in front of the list mode records of a
+ * #VALUE_TABLE_TYPE_LIST_MODE value table.
+ */
+typedef struct {
+  /** Chunk sequence number, counting from 0 for every measurement */
+  uint16_t seq;
+  /** Records not yet sent when this chunk was sent (backpressure) */
+  uint16_t backlog;
+  /** Total events dropped since start of measurement (ring buffer full) */
+  uint32_t lost_events;
+  /** Frequency of the timestamp clock in Hz */
+  uint32_t ticks_per_second;
+} PACKED packet_list_mode_chunk_t;
+
+
+/** Sample block header
+ *
+ * Sent in front of the samples of a #VALUE_TABLE_TYPE_SAMPLE_BLOCK
+ * value table.
+ */
+typedef struct {
+  /** Block sequence number, counting from 0 for every measurement */
+  uint16_t seq;
+  /** Number of samples in this block */
+  uint16_t samples;
+  /** Index of the first sample of this block in the sample stream,
+   *  counting dropped samples as well (wraps around) */
+  uint32_t first_sample;
+  /** Sample block flags (SAMPLE_BLOCK_FLAG_*) */
+  uint8_t flags;
+} PACKED packet_sample_block_t;
+
+
+/** Samples have been dropped right before this block because both
+ *  buffer halves were still waiting to be sent */
+#define SAMPLE_BLOCK_FLAG_OVERRUN 0x01
+
+
+/** Trigger window header
+ *
+ * Sent in front of the samples of a #VALUE_TABLE_TYPE_TRIGGER_WINDOW
+ * value table.
+ */
+typedef struct {
+  /** Window sequence number, counting from 0 for every measurement */
+  uint16_t seq;
+  /** Number of samples in this window (0 if nothing captured) */
+  uint16_t samples;
+  /** Number of samples before the trigger sample */
+  uint16_t pre_samples;
+  /** Index of the first sample of this window in the (decimated)
+   *  sample stream since the start of the measurement (wraps around) */
+  uint32_t first_sample;
+} PACKED packet_trigger_window_t;
+
+
+/** Software trigger parameters of the measurement command
+ *
+ * Sent by the host after the skip_samples parameter if the
+ * personality info announces param_data_size_trigger.
+ */
+typedef struct {
+  /** Trigger level (ADC value) */
+  uint16_t level;
+  /** Hysteresis (ADC value difference): The signal needs to go back
+   *  this far beyond the level before the trigger fires again */
+  uint16_t hysteresis;
+  /** Number of samples to transmit before the trigger sample */
+  uint16_t pre_samples;
+  /** Number of samples to transmit starting with the trigger sample.
+   *  0 disables the trigger. */
+  uint16_t post_samples;
+  /** Trigger flags (TRIGGER_FLAG_*) */
+  uint8_t flags;
+} PACKED packet_trigger_param_t;
+
+
+/** Trigger on the falling instead of the rising edge */
+#define TRIGGER_FLAG_FALLING 0x01
+
+/** Re-arm the trigger after a window has been sent instead of
+ *  finishing the measurement */
+#define TRIGGER_FLAG_REARM   0x02
+
+
+/** Maximum number of regions of interest */
+#define ROI_MAX 4
+
+
+/** Region of interest: histogram bins first..last (inclusive) */
+typedef struct {
+  uint16_t first;
+  uint16_t last;
+} PACKED packet_roi_window_t;
+
+
+/** Measurement state in the status packet */
+typedef enum {
+  STATUS_STATE_READY     = 'R',
+  STATUS_STATE_MEASURING = 'M',
+  STATUS_STATE_DONE      = 'D'
+} packet_status_state_t;
+
+
+/** Status flag: A table element has wrapped around, and counts have
+ *  been lost (see \ref packet_emb_to_host_overflow) */
+#define STATUS_FLAG_OVERFLOW 0x01
+
+/** Status flag: A table element has wrapped around, and has been
+ *  promoted into the overflow table */
+#define STATUS_FLAG_PROMOTED 0x02
+
+
+/** Measurement status packet
+ *
+ * The counters are updated by the ISRs as the events come in, so
+ * sending the status costs no more than sending the struct. The time
+ * fields are the same as in #packet_value_table_header_t.
+ */
+typedef struct {
+  /** measurement state (#packet_status_state_t) */
+  uint8_t state;
+  /** STATUS_FLAG_* */
+  uint8_t flags;
+  /** duration of the measurement so far */
+  uint32_t duration;
+  /** time since start of measurement in timebase clock ticks */
+  uint64_t elapsed_ticks;
+  /** frequency of the timebase clock in Hz (0 if none) */
+  uint32_t timebase_clock;
+  /** dead time in milliseconds (0 if not accounted for) */
+  uint32_t dead_time;
+  /** number of events which arrived while the device was busy
+   * (see #packet_value_table_header_t) */
+  uint32_t busy_triggers;
+  /** number of events counted into the table (0 if not tracked) */
+  uint32_t total_counts;
+  /** largest table element */
+  uint32_t max_value;
+  /** index of the largest table element */
+  uint16_t max_index;
+  /** size of the value table data sent with the next value table */
+  uint16_t table_size;
+  /** push sequence number, 0 if not pushed (see #FRAME_CMD_SUBSCRIBE) */
+  uint16_t push_seq;
+} PACKED packet_status_t;
+
+
+/** Parameter of #FRAME_CMD_SUBSCRIBE
+ *
+ * While measuring, the device sends a frame of the given type every
+ * interval units of the measurement duration (see units_per_second
+ * in #packet_personality_info_t). An interval of 0 ends the
+ * subscription.
+ *
+ * Pushed frames carry a push sequence number counting from 1, so the
+ * host can tell whether it has lost one. The subscription is lost
+ * when the device resets after the measurement.
+ */
+typedef struct {
+  /** push interval in units of the duration, 0 to unsubscribe */
+  uint16_t interval;
+  /** #FRAME_TYPE_VALUE_TABLE (intermediate) or #FRAME_TYPE_STATUS */
+  uint8_t frame_type;
+} PACKED packet_subscribe_param_t;
+
+
+/** Region of interest parameters of the measurement command
+ *
+ * Sent by the host after the sample period parameter if the
+ * personality info announces param_data_size_roi. Windows may
+ * overlap. A window with first > last is unused.
+ */
+typedef struct {
+  packet_roi_window_t window[ROI_MAX];
+} PACKED packet_roi_param_t;
+
+
+/** Histogram resolution parameter of the measurement command
+ *
+ * Sent by the host after the region of interest parameter if the
+ * personality info announces param_data_size_resolution: The number
+ * of ADC bits which make up the bin index, from min_resolution to
+ * max_resolution of #packet_personality_info_t. 0 selects
+ * max_resolution. The histogram has 2^resolution bins, and the
+ * region of interest windows count in these bins.
+ */
+typedef uint8_t packet_resolution_param_t;
+
+
+/** Region of interest summary packet
+ *
+ * The counts in the regions of interest plus what the host needs for
+ * the live time, at a fraction of the size of a histogram. The time
+ * fields are the same as in #packet_value_table_header_t.
+ */
+typedef struct {
+  /** duration of the measurement so far */
+  uint32_t duration;
+  /** time since start of measurement in timebase clock ticks */
+  uint64_t elapsed_ticks;
+  /** frequency of the timebase clock in Hz (0 if none) */
+  uint32_t timebase_clock;
+  /** dead time in milliseconds (0 if not accounted for) */
+  uint32_t dead_time;
+  /** number of events which arrived while the device was busy
+   * (see #packet_value_table_header_t) */
+  uint32_t busy_triggers;
+  /** number of valid sums (0 if the personality has no ROIs) */
+  uint8_t rois;
+  /** counts in window 0..rois-1 of #packet_roi_param_t */
+  uint32_t sum[ROI_MAX];
+} PACKED packet_roi_summary_t;
+
+
+/** Number of bits of the ADC value in a list mode record */
+#define LIST_MODE_VALUE_BITS 12
+
+/** Number of bits of the timestamp delta in a list mode record */
+#define LIST_MODE_DELTA_BITS 20
+
+/** Delta value marking a time marker record
+ *
+ * A time marker record carries no event. Its value field holds the
+ * number of 2^#LIST_MODE_DELTA_BITS tick periods to add to the time.
+ */
+#define LIST_MODE_DELTA_MARKER ((1UL << LIST_MODE_DELTA_BITS) - 1)
+
+/** List mode record: timestamp delta to the previous record in the
+ * upper 20 bits, ADC value in the lower 12 bits */
+#define LIST_MODE_RECORD(DELTA, VALUE) \
+  (((DELTA) << LIST_MODE_VALUE_BITS) | (VALUE))
+
+/** Get the ADC value from a list mode record */
+#define LIST_MODE_RECORD_VALUE(RECORD) \
+  ((RECORD) & ((1UL << LIST_MODE_VALUE_BITS) - 1))
+
+/** Get the timestamp delta from a list mode record */
+#define LIST_MODE_RECORD_DELTA(RECORD) \
+  ((RECORD) >> LIST_MODE_VALUE_BITS)
+
+
 /** Personality Information packet content */
 typedef struct {
   /** Maximum size of the complete table in byte */
@@ -141,9 +595,94 @@ typedef struct {
   /** Size of measurement command's parameter elements */
   uint8_t param_data_size_timer_count;
   uint8_t param_data_size_skip_samples;
+  uint8_t param_data_size_trigger;
+  uint8_t param_data_size_sample_period;
+  uint8_t param_data_size_roi;
+  uint8_t param_data_size_resolution;
+  /** Clock the sample period parameter counts in [Hz] (0 if the
+   *  personality has no sample period parameter) */
+  uint32_t sample_clock;
+  /** Shortest sample period the firmware can keep up with [clock ticks] */
+  uint32_t min_sample_period;
+  /** Longest sample period [clock ticks] */
+  uint32_t max_sample_period;
+  /** Sample period in burst mode [clock ticks] (0 if the personality
+   *  has no burst mode, see #SAMPLE_PERIOD_BURST) */
+  uint32_t burst_sample_period;
+  /** Histogram resolution range [bits] (0 if the personality has no
+   *  resolution parameter, see #packet_resolution_param_t) */
+  uint8_t min_resolution;
+  uint8_t max_resolution;
 } PACKED packet_personality_info_t;
 
 
+/** Time sync packet
+ *
+ * The device timebase at the time the #FRAME_CMD_TIME_SYNC command
+ * has been received. A value table's elapsed_ticks correspond to the
+ * timebase ticks start_ticks + elapsed_ticks.
+ */
+typedef struct {
+  /** free running timebase [timebase clock ticks] */
+  uint64_t ticks;
+  /** timebase at the start of the measurement [timebase clock ticks] */
+  uint64_t start_ticks;
+  /** frequency of the timebase clock in Hz (0 if the personality has
+   *  no timebase) */
+  uint32_t timebase_clock;
+} PACKED packet_time_sync_t;
+
+
+/** Number of log2 histogram bins in #packet_isr_profile_source_t */
+#define PACKET_ISR_PROFILE_BINS 16
+
+
+/** ISR profile packet header */
+typedef struct {
+  /** stop watch clock in Hz (0 if there is no ISR profiler) */
+  uint32_t timer_clock;
+  /** number of #packet_isr_profile_source_t following */
+  uint8_t sources;
+} PACKED packet_isr_profile_header_t;
+
+
+/** ISR profile of one interrupt source
+ *
+ * Latency is the time from entering the IRQ handler to entering the
+ * ISR, which includes the ISRs serviced before in the same IRQ.
+ * Duration is the time spent in the ISR. Both are in stop watch
+ * ticks. Bin n of the histograms counts the values in [2^n, 2^(n+1)),
+ * bin 0 also counts 0.
+ */
+typedef struct {
+  /** interrupt source (bit number in IRQSTA) */
+  uint8_t irq;
+  /** number of ISR calls */
+  uint32_t count;
+  /** shortest latency [ticks] */
+  uint16_t latency_min;
+  /** longest latency [ticks] */
+  uint16_t latency_max;
+  /** shortest duration [ticks] */
+  uint16_t duration_min;
+  /** longest duration [ticks] */
+  uint16_t duration_max;
+  /** log2 histogram of the latency */
+  uint32_t latency_hist[PACKET_ISR_PROFILE_BINS];
+  /** log2 histogram of the duration */
+  uint32_t duration_hist[PACKET_ISR_PROFILE_BINS];
+} PACKED packet_isr_profile_source_t;
+
+
+/** Sample period parameter value selecting burst mode
+ *
+ * In burst mode, the ADC converts continuously at its maximum rate
+ * until the data table is full. The resulting sample period is
+ * packet_personality_info_t.burst_sample_period.
+ */
+#define SAMPLE_PERIOD_BURST 1
+
+
 
 /** @} */
 
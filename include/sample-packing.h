@@ -0,0 +1,169 @@
+/** \file include/sample-packing.h
+ * \brief Packing of 12 bit samples into 16 bit halfwords
+ *
+ * \author Copyright (C) 2012 samplemaker
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ *
+ * \defgroup sample_packing 12 Bit Sample Packing
+ * \ingroup communication_protocol
+ * @{
+ *
+ * 12 bit samples are sent as a bit stream in 16 bit halfwords, most
+ * significant bit first. 4 adjacent samples (A,B,C,D) thus take 3
+ * halfwords:
+ *
+ *   [a|a|a|b], [b|b|c|c], [c|d|d|d]
+ *
+ * The halfwords are sent little endian (the firmware sends its
+ * memory as-is). The unused bits of the last halfword are zero.
+ *
+ * The firmware packs with #sample_packer_t and the hostware unpacks
+ * with #sample_unpacker_t, both defined here so that the two sides
+ * cannot disagree about the format.
+ *
+ * The packer is a shift register: The pending bits are kept left
+ * aligned in a 32 bit accumulator. Every sample is ORed in below the
+ * pending bits, the upper halfword is stored unconditionally, and
+ * the destination pointer only advances when 16 bits have been
+ * collected. There is no branch, so the packer takes the same time
+ * for every sample.
+ */
+
+#ifndef SAMPLE_PACKING_H
+#define SAMPLE_PACKING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/** Bits per packed sample */
+#define SAMPLE_PACK_BITS 12
+
+
+/** Number of halfwords needed for a number of packed samples */
+#define SAMPLE_PACK_HALFWORDS(samples) \
+  (((samples) * SAMPLE_PACK_BITS + 15) / 16)
+
+
+/** Packer state (firmware side) */
+typedef struct {
+  /** Pending bits, left aligned */
+  uint32_t acc;
+  /** Number of pending bits (0..15) */
+  uint32_t bits;
+  /** Halfword the pending bits go to */
+  volatile uint16_t *cur;
+} sample_packer_t;
+
+
+/** Start packing to dest */
+inline static
+void sample_packer_init(sample_packer_t *self, volatile uint16_t *dest)
+{
+  self->acc = 0;
+  self->bits = 0;
+  self->cur = dest;
+}
+
+
+/** Append one sample
+ *
+ * Stores to *self->cur on every call, so there must be room for one
+ * halfword at self->cur.
+ */
+inline static
+void sample_packer_put(sample_packer_t *self, const uint16_t value)
+{
+  const uint32_t bits = self->bits;
+  const uint32_t acc =
+    self->acc | (((uint32_t)value) << (32 - SAMPLE_PACK_BITS - bits));
+  *self->cur = acc >> 16;
+  /* 1 if the halfword is complete, 0 otherwise */
+  const uint32_t full = (bits + SAMPLE_PACK_BITS) >> 4;
+  self->cur += full;
+  self->acc = acc << (full << 4);
+  self->bits = bits + SAMPLE_PACK_BITS - (full << 4);
+}
+
+
+/** Finish packing
+ *
+ * Stores the partially filled halfword, if any, and moves self->cur
+ * behind it. Packing continues with a fresh halfword.
+ */
+inline static
+void sample_packer_flush(sample_packer_t *self)
+{
+  if (self->bits) {
+    *self->cur = self->acc >> 16;
+    self->cur++;
+  }
+  self->acc = 0;
+  self->bits = 0;
+}
+
+
+/** Unpacker state (hostware side) */
+typedef struct {
+  /** Bits read but not returned yet, right aligned */
+  uint32_t acc;
+  /** Number of valid bits in acc */
+  uint32_t bits;
+  /** Next little endian halfword to read */
+  const uint8_t *cur;
+} sample_unpacker_t;
+
+
+/** Start unpacking from src */
+inline static
+void sample_unpacker_init(sample_unpacker_t *self, const uint8_t *src)
+{
+  self->acc = 0;
+  self->bits = 0;
+  self->cur = src;
+}
+
+
+/** Return the next sample
+ *
+ * Reads at most SAMPLE_PACK_HALFWORDS(n) halfwords for n samples.
+ */
+inline static
+uint16_t sample_unpacker_get(sample_unpacker_t *self)
+{
+  if (self->bits < SAMPLE_PACK_BITS) {
+    self->acc = (self->acc << 16) |
+      (((uint32_t)self->cur[0]) << 0) | (((uint32_t)self->cur[1]) << 8);
+    self->cur += 2;
+    self->bits += 16;
+  }
+  self->bits -= SAMPLE_PACK_BITS;
+  return (self->acc >> self->bits) & ((1 << SAMPLE_PACK_BITS) - 1);
+}
+
+
+/** @} */
+
+#endif /* !SAMPLE_PACKING_H */
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */